@@ -0,0 +1,15 @@
+#ifndef BAKE_H
+#define BAKE_H
+
+#include "model.h"
+
+// Baked models: the result of importing a glTF file (see model.h), written next to it.
+// Vertices and indices are GPU-ready, images decoded, materials and transforms resolved. Loading one is mapping it.
+// A baked file is only used by builds with the same structures, and for the exact same source file and external buffers
+// (size and modification time).
+#define BAKE_EXTENSION ".baked"
+
+bool bake_write(const char *filepath, const struct model_import *import);
+struct model_import *bake_read(const char *filepath);
+
+#endif
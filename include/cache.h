@@ -0,0 +1,19 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Everything derived from assets that is expensive to compute and safe to throw away ends up in there.
+#define CACHE_DIRECTORY "cache"
+
+bool cache_path(char *path, size_t size, const char *category, uint64_t key);
+void *cache_read(const char *path, size_t *size);
+bool cache_write(const char *path, const void *data, size_t size);
+void cache_remove(const char *path);
+void *cache_map(const char *path, size_t *size);
+void cache_unmap(void *data, size_t size);
+bool cache_stat(const char *path, uint64_t *size, int64_t *mtime);
+
+#endif
@@ -7,20 +7,37 @@
 #include "stb_image.h"
 #include "toolkit.h"
 
+#include "bake.h"
+#include "cache.h"
 #include "camera.h"
+#include "compress.h"
+#include "dds.h"
 #include "entity.h"
 #include "environment.h"
 #include "framebuffer.h"
+#include "geometry.h"
 #include "gizmo.h"
+#include "hdr.h"
+#include "ibl.h"
+#include "indirect.h"
+#include "jobs.h"
+#include "ktx.h"
 #include "light.h"
 #include "material.h"
+#include "materialmanager.h"
 #include "mesh.h"
 #include "model.h"
 #include "modelmanager.h"
+#include "optimizer.h"
+#include "quantize.h"
 #include "renderer.h"
+#include "renderqueue.h"
 #include "scene.h"
 #include "shader.h"
+#include "shadermanager.h"
+#include "staging.h"
 #include "texture.h"
+#include "texturemanager.h"
 #include "ui.h"
 #include "utils.h"
 #include "window.h"
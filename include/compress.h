@@ -0,0 +1,23 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+// Block compression (BCn, aka S3TC/RGTC) of 8-bit pixels, for textures that stay compressed in VRAM.
+// Blocks are 4x4 texels. Partial blocks at the right and bottom edges repeat the last column and row.
+// The encoders favor speed over quality: endpoints come from the principal axis of each block, without refinement.
+
+#define COMPRESS_BLOCK_TEXELS 4
+
+size_t compress_blocks_count(int width, int height);
+
+// RGB, 8 bytes per block. Alpha is ignored.
+void compress_bc1(const unsigned char *pixels, int width, int height, int components, unsigned char *output);
+
+// RGBA, 16 bytes per block. Images without alpha are fully opaque.
+void compress_bc3(const unsigned char *pixels, int width, int height, int components, unsigned char *output);
+
+// The first two channels, 16 bytes per block. Meant for normal maps, whose Z gets reconstructed.
+void compress_bc5(const unsigned char *pixels, int width, int height, int components, unsigned char *output);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include "texture.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// DirectDraw Surface containers (https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide).
+// Only 2D images and complete cubemaps are supported, in RGBA8, half or full floats, or one of the BC formats we know.
+
+bool dds_detect(const unsigned char *data, size_t size);
+bool dds_decode(struct texture_image *image, const unsigned char *data, size_t size);
+
+#endif
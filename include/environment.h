@@ -1,22 +1,56 @@
 #ifndef ENVIRONMENT_H
 #define ENVIRONMENT_H
 
+#include "ibl.h"
 #include "texture.h"
 
+// Prefiltered specular maps, their mip levels go from smooth to rough.
+// The results are cached (see cache.h), changing any of these makes them again.
+#define ENVIRONMENT_MIP_COUNT 10
+#define ENVIRONMENT_SAMPLE_COUNT 1024
+#define ENVIRONMENT_SIZE 1024
+
+// Equirectangular environments get converted to cubemaps of this size before prefiltering.
+#define ENVIRONMENT_CUBEMAP_SIZE 2048
+
+// Uniform buffer binding of the irradiance coefficients, the `Irradiance` block of the PBR shader.
+#define ENVIRONMENT_IRRADIANCE_BINDING 0
+
+// Prefiltered maps (and the lookup tables) are read back once made and kept in the cache, see cache.h.
+// They are stored as RGB half floats, the sampler always writes an alpha of 1.
+#define ENVIRONMENT_CACHE_CATEGORY "environment"
+#define ENVIRONMENT_CACHE_MAGIC 0x4c424931 // "1IBL"
+#define ENVIRONMENT_CACHE_VERSION 3
+
+struct environment_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t length;
+};
+
 struct environment {
 	struct texture cubemap;
 
+	// Diffuse lighting, as spherical harmonics (see ibl.h) in a uniform buffer of std140 vec4s.
+	float irradiance[IBL_SH_COUNT][3];
+	GLuint irradiance_buffer;
+
 	size_t mip_count;
-	struct texture lambertian;
 	struct texture ggx;
-	struct texture ggx_lut;
+	struct texture ggx_lut; // Shared by all environments.
 	struct texture charlie;
-	struct texture charlie_lut;
+	struct texture charlie_lut; // Shared by all environments.
 };
 
 bool environment_init_from_file(struct environment *environment, const char *filepath);
 void environment_fini(struct environment *environment);
 
+// What the prefiltering starts from and where its results go, for checking them without a window (see ibl.h).
+bool environment_source_read(const char *filepath, struct texture_image *image, uint64_t *hash);
+uint64_t environment_cache_key(uint64_t source_hash);
+struct texture_image environment_cache_layout(bool cubemap);
+
 void environment_debug(const struct environment *environment);
 void environment_switch(const struct environment *environment);
 
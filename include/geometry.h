@@ -0,0 +1,39 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "mesh.h"
+#include <stdint.h>
+
+// Static meshes sharing the same vertex layout are suballocated out of the same few large buffers (an arena),
+// and drawn from the arena's single VAO with base-vertex draws.
+// Indices are always 32-bit in arenas, relative to the first vertex of their geometry.
+
+#define GEOMETRY_ARENA_MIN_VERTICES (1 << 16)
+#define GEOMETRY_ARENA_MIN_INDICES (1 << 18)
+
+// Per-instance attribute of every arena VAO (past the mesh attributes) when drawing GPU-driven, see indirect.h.
+#define GEOMETRY_INSTANCE_ATTRIBUTE MESH_ATTRIBUTES_COUNT
+
+struct geometry_arena;
+
+struct geometry {
+	struct geometry_arena *arena;
+
+	// In vertices and indices, not bytes. These move when the arena gets defragmented.
+	size_t first_vertex;
+	size_t vertices_count;
+	size_t first_index;
+	size_t indices_count;
+};
+
+struct geometry *geometry_create(const struct mesh_layout *layout, const void *const *streams, size_t vertices_count, const uint32_t *indices, size_t indices_count);
+void geometry_destroy(struct geometry *geometry);
+void geometry_bind(const struct geometry *geometry);
+GLuint geometry_vertex_array(const struct geometry *geometry);
+void geometry_unbind(void);
+void geometry_draw(const struct geometry *geometry);
+void geometry_draw_instanced(const struct geometry *geometry, size_t instances_count);
+void geometry_instance_indices(GLuint buffer);
+void geometry_fini(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HDR_H
+#define HDR_H
+
+#include "texture.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Radiance RGBE images (.hdr), decoded straight to RGB half floats.
+// Only the usual top to bottom, left to right orientation is supported, flipping puts the bottom row first instead.
+
+bool hdr_detect(const unsigned char *data, size_t size);
+bool hdr_decode(struct texture_image *image, const unsigned char *data, size_t size, bool flip);
+
+#endif
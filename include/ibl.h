@@ -0,0 +1,52 @@
+#ifndef IBL_H
+#define IBL_H
+
+#include "texture.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Prefiltering of environments for image based lighting, as done by the iblsampler shaders.
+// The GPU does the actual work (see environment.c), this is the CPU reference it can be checked against without a window,
+// see `layman --reference-ibl`. Both sides sample the same directions and use filtered importance sampling:
+// each sample reads a source level matching its solid angle, so narrow lobes need few samples.
+// Keep it in sync with shaders/iblsampler.
+// Diffuse irradiance is projected on spherical harmonics here for real, there is no GPU side to it.
+
+// Mirror-like GGX lobes get this many samples at least.
+#define IBL_SAMPLES_MIN 16
+
+// Diffuse irradiance is low frequency enough for 9 spherical harmonics (bands 0 to 2), RGB each.
+// The coefficients come premultiplied, see shaders/pbr for how they get evaluated.
+#define IBL_SH_COUNT 9
+
+// Cubemaps get projected from their first level at most this large.
+#define IBL_SH_SIZE 128
+
+enum ibl_distribution {
+	IBL_DISTRIBUTION_LAMBERTIAN,
+	IBL_DISTRIBUTION_GGX,
+	IBL_DISTRIBUTION_CHARLIE,
+	IBL_DISTRIBUTION_COUNT,
+};
+
+// RGB floats with a mip chain, levels one after the other, each with its 6 faces in the order of the OpenGL targets.
+struct ibl_cubemap {
+	int size;
+	size_t levels;
+	float *pixels;
+};
+
+uint32_t ibl_sample_count(enum ibl_distribution distribution, float roughness, uint32_t samples);
+
+bool ibl_cubemap_from_image(struct ibl_cubemap *cubemap, const struct texture_image *image);
+bool ibl_cubemap_from_equirectangular(struct ibl_cubemap *cubemap, const struct texture_image *image, int size);
+void ibl_cubemap_fini(struct ibl_cubemap *cubemap);
+
+bool ibl_irradiance_sh(const struct texture_image *image, float sh[IBL_SH_COUNT][3]);
+void ibl_irradiance_evaluate(const float sh[IBL_SH_COUNT][3], const float normal[3], float color[3]);
+
+void ibl_texel_direction(int face, int x, int y, int size, float direction[3]);
+void ibl_prefilter(const struct ibl_cubemap *source, enum ibl_distribution distribution, float roughness, uint32_t samples, const float normal[3], float color[3]);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include "renderqueue.h"
+#include "glad/glad.h"
+#include <stdbool.h>
+
+// GPU-driven drawing. A compute shader frustum culls the instances of every item of the render queue and writes
+// one glMultiDrawElementsIndirect() command per item, along with the indices of the instances that survived.
+// Items sharing the program, material and vertex array are then one draw call, however many entities there are.
+// Needs compute shaders, shader storage buffers, multi-draw indirect and base instances, the renderer draws instanced
+// without them.
+//
+// With bindless textures as well, nothing of a material needs binding: instances carry their material index and
+// draws only split on the program, the vertex array and face culling (see indirect_materials()). Without them,
+// textures are bound per material and draws split on every material.
+
+// Shader storage buffer bindings, past the material table.
+#define INDIRECT_INSTANCES_BINDING 1
+#define INDIRECT_RANGES_BINDING 2
+#define INDIRECT_COMMANDS_BINDING 3
+#define INDIRECT_INDICES_BINDING 4
+
+// Laid out like OpenGL expects them.
+struct indirect_command {
+	uint32_t count;
+	uint32_t instances_count;
+	uint32_t first_index;
+	int32_t base_vertex;
+	uint32_t base_instance;
+};
+
+bool indirect_init(void);
+void indirect_fini(void);
+bool indirect_enabled(void);
+bool indirect_materials(void);
+void indirect_cull(const struct renderqueue *queue, GLuint instances_buffer, mat4 view_projection_matrix);
+void indirect_draw(size_t first, size_t count);
+
+#endif
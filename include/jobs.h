@@ -0,0 +1,22 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*job_function)(void *data);
+
+// Groups jobs together so that their completion can be waited upon.
+// Must be zero-initialized and outlive the jobs submitted with it.
+struct jobs_batch {
+	size_t pending;
+};
+
+bool jobs_init(void);
+void jobs_fini(void);
+size_t jobs_worker_count(void);
+void jobs_submit(struct jobs_batch *batch, job_function function, void *data);
+void jobs_wait(struct jobs_batch *batch);
+bool jobs_done(struct jobs_batch *batch);
+
+#endif
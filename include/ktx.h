@@ -0,0 +1,15 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include "texture.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// KTX2 containers (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html).
+// Only 2D images and cubemaps without supercompression are supported, in RGB(A)8, half or full floats, or one of the BC formats we know.
+// Basis Universal payloads (the KHR_texture_basisu glTF extension) need a transcoder, which we don't have.
+
+bool ktx_detect(const unsigned char *data, size_t size);
+bool ktx_decode(struct texture_image *image, const unsigned char *data, size_t size);
+
+#endif
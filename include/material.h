@@ -5,6 +5,7 @@
 
 struct material {
 	char *name;
+	uint32_t id; // Assigned by the material manager.
 
 	// Mettalic/roughness.
 	vec4 base_color_factor;
@@ -24,8 +25,30 @@ struct material {
 	bool double_sided;
 };
 
+// Entry of the material table (see materialmanager.h), read by the PBR shader as uvec4 texels.
+// Texture handles are only filled in with bindless textures, they otherwise get bound to their units.
+struct material_uniforms {
+	vec4 base_color_factor;
+	vec3 emissive_factor;
+	float normal_scale;
+	float metallic_factor;
+	float roughness_factor;
+	float occlusion_strength;
+	float padding;
+	uint64_t base_color_texture;
+	uint64_t metallic_roughness_texture;
+	uint64_t normal_texture;
+	uint64_t occlusion_texture;
+	uint64_t emissive_texture;
+	uint64_t padding_textures;
+};
+
 void material_init(struct material *material);
 void material_fini(struct material *material);
 void material_switch(const struct material *material);
+void material_switch_culling(const struct material *material);
+void material_uniforms_init(struct material_uniforms *uniforms, const struct material *material);
+uint64_t material_hash(const struct material *material);
+bool material_equal(const struct material *a, const struct material *b);
 
 #endif
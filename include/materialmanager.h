@@ -0,0 +1,21 @@
+#ifndef MATERIALMANAGER_H
+#define MATERIALMANAGER_H
+
+#include "material.h"
+#include "texture.h"
+
+// The uniforms of every material (see struct material_uniforms) live in one buffer, the material table, at their ID.
+// Shaders read it as a shader storage buffer when there are some, through a buffer texture otherwise.
+#define MATERIALMANAGER_TABLE_BINDING 0 // Of the shader storage buffer.
+#define MATERIALMANAGER_TABLE_UNIT TEXTURE_KIND_COUNT // Of the buffer texture, past the units of the other textures.
+
+void materialmanager_init(void);
+void materialmanager_fini(void);
+void materialmanager_update(void);
+bool materialmanager_storage(void);
+void materialmanager_program(GLuint program_id);
+
+struct material *materialmanager_load_material(struct material *material);
+void materialmanager_unload_material(const struct material *material);
+
+#endif
@@ -4,6 +4,7 @@
 #include "glad/glad.h"
 #include "material.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 enum mesh_attribute {
 	MESH_ATTRIBUTE_POSITION,
@@ -13,38 +14,47 @@ enum mesh_attribute {
 	MESH_ATTRIBUTE_WEIGHTS,
 	MESH_ATTRIBUTE_JOINTS,
 	MESH_ATTRIBUTE_COLORS,
+	MESH_ATTRIBUTES_COUNT,
+};
+
+// Vertex buffers per mesh. Attributes are interleaved within each of them.
+#define MESH_STREAMS_MAX 2
+
+struct mesh_attribute_format {
+	bool enabled;
+	GLint components;
+	GLenum type;
+	bool normalized;
+	size_t stream;
+	size_t offset; // In bytes, from the start of a vertex in its stream.
+	size_t size;
+};
+
+struct mesh_layout {
+	struct mesh_attribute_format attributes[MESH_ATTRIBUTES_COUNT];
+	size_t strides[MESH_STREAMS_MAX];
+	size_t streams_count;
 };
 
 struct mesh {
-	GLuint vao;
-	GLuint vbo_positions;
-	GLuint vbo_normals;
-	GLuint vbo_uvs;
-	GLuint ebo_indices;
-	GLuint vbo_tangents;
-	GLuint vbo_weights;
-	GLuint vbo_joints;
-	GLuint vbo_colors;
-
-	size_t indices_count;
-	GLenum indices_type;
+	// Vertices and indices live in shared buffers, see geometry.h.
+	struct geometry *geometry;
+	struct mesh_layout layout;
 
 	struct shader *shader;
-	struct material material;
+	struct material *material; // Shared, see the material manager.
 
 	mat4 initial_transform;
+	vec4 bounds; // Bounding sphere in model space, center then radius. The radius is negative when unknown.
 };
 
+void mesh_layout_init(struct mesh_layout *layout);
+void mesh_layout_add(struct mesh_layout *layout, enum mesh_attribute attribute, size_t stream, GLint components, GLenum type, bool normalized);
+void mesh_layout_finish(struct mesh_layout *layout);
+bool mesh_layout_equal(const struct mesh_layout *a, const struct mesh_layout *b);
+
 bool mesh_init(struct mesh *mesh);
 void mesh_fini(struct mesh *mesh);
-void mesh_provide_vertices(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_normals(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_uvs(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_indices(struct mesh *mesh, const void *data, size_t count, GLenum type);
-void mesh_provide_tangents(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_weights(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_joints(struct mesh *mesh, const float *data, size_t count, size_t stride);
-void mesh_provide_colors(struct mesh *mesh, const float *data, size_t count, size_t stride, int components);
-void mesh_switch(const struct mesh *mesh);
+bool mesh_provide_geometry(struct mesh *mesh, const struct mesh_layout *layout, const void *const *streams, size_t vertices_count, const uint32_t *indices, size_t indices_count);
 
 #endif
@@ -1,15 +1,101 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+// Store normals, tangents, UVs and colors in compact formats (see quantize.h), about half the vertex size.
+// Use `layman --report-quantization model.glb` to check the precision loss.
+#define MODEL_COMPACT_VERTICES true
+
+// Reorder triangles and vertices at import for the vertex cache and fetches, and optionally for overdraw (see optimizer.h).
+// Use `layman --report-geometry model.glb` to see the difference.
+#define MODEL_OPTIMIZE_GEOMETRY true
+#define MODEL_OPTIMIZE_OVERDRAW true
+
+// Keep textures block compressed in VRAM (see compress.h), the compressed mip chains get baked with the rest.
+// Color textures become BC1 (BC3 with transparency) and normal maps BC5.
+#define MODEL_COMPRESS_TEXTURES true
+
+// Filter for the mip chains made at import (see texture.h), they get baked so the slower Kaiser one only costs once.
+// Use `layman --benchmark-mipmaps model.glb` to compare them.
+#define MODEL_MIPMAPS_FILTER TEXTURE_FILTER_KAISER
+
+enum model_state {
+	MODEL_STATE_LOADING,
+	MODEL_STATE_READY,
+	MODEL_STATE_FAILED,
+};
+
 struct model {
 	char *filepath;
 	struct mesh *meshes;
 	size_t meshes_count;
+	enum model_state state;
+};
+
+// PBR textures of a material, indexed by texture kind.
+#define MODEL_MATERIAL_TEXTURES (TEXTURE_KIND_EMISSION + 1)
+
+// Material parameters, resolved at import.
+struct model_import_material {
+	const char *name;
+	vec4 base_color_factor;
+	float metallic_factor;
+	float roughness_factor;
+	vec3 emissive_factor;
+	bool double_sided;
+
+	// Index of the image of each texture, -1 when there is no such texture.
+	int32_t images[MODEL_MATERIAL_TEXTURES];
+};
+
+struct model_import_primitive {
+	struct shader_options options;
+	mat4 transform;
+	vec4 bounds; // See mesh.h.
+
+	bool has_material;
+	struct model_import_material material;
+
+	// GPU-ready, see mesh_provide_geometry().
+	struct mesh_layout layout;
+	const void *streams[MESH_STREAMS_MAX];
+	size_t vertices_count;
+	const uint32_t *indices;
+	size_t indices_count;
+};
+
+// Everything about a model that could be prepared without OpenGL, see model.c.
+struct model_import {
+	// Decoded images. Only the ones referenced by materials get decoded, the others have no pixels.
+	// The hashes of their encoded content identify them with the texture manager.
+	struct texture_image *images;
+	uint64_t *images_hashes;
+	size_t images_count;
+
+	struct model_import_primitive *primitives;
+	size_t primitives_count;
+
+	// External buffers of the glTF file, as paths relative to it. Baked files are only valid as long as they don't change.
+	const char **dependencies;
+	size_t dependencies_count;
+
+	// When set, the data above points into this mapping of a baked file (see bake.h) instead of being owned.
+	void *mapping;
+	size_t mapping_size;
 };
 
 struct model *model_load(const char *filepath);
 void model_destroy(struct model *model);
 
+struct model_import *model_import(const char *filepath);
+void model_import_free(struct model_import *import);
+struct model *model_create(const char *filepath);
+bool model_upload(struct model *model, const struct model_import *import, double deadline);
+
 #endif
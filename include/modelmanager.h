@@ -1,7 +1,13 @@
 #ifndef MODELMANAGER_H
 #define MODELMANAGER_H
 
+// Time spent uploading models to the GPU per frame, in seconds.
+#define MODELMANAGER_UPLOAD_BUDGET 0.004
+
 struct model *modelmanager_load_model(const char *filepath);
+struct model *modelmanager_load_model_async(const char *filepath);
 void modelmanager_unload_model(const struct model *model);
+void modelmanager_update(double budget);
+void modelmanager_fini(void);
 
 #endif
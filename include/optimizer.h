@@ -0,0 +1,30 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Import-time reordering of indexed triangle lists, for cheaper rendering every frame after:
+//  1. Vertex cache: triangles reordered for post-transform cache hits (Forsyth).
+//  2. Overdraw (optional): clusters of triangles reordered so that outer surfaces get drawn first.
+//  3. Vertex fetch: vertices reordered in first use order, indices remapped to match.
+
+// Size of the FIFO cache simulated for the statistics, typical of current hardware.
+#define OPTIMIZER_STATS_CACHE_SIZE 16
+
+// Clusters may be up to this much worse (in ACMR) than the whole mesh, the larger the better for overdraw.
+#define OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+struct optimizer_stats {
+	float acmr; // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is the worst).
+	float atvr; // Average transformed vertex ratio, transformed vertices per vertex (1 is ideal).
+};
+
+void optimizer_reorder_for_cache(uint32_t *indices, size_t indices_count, size_t vertices_count);
+void optimizer_reorder_for_overdraw(uint32_t *indices, size_t indices_count, const float *positions, size_t positions_stride, size_t vertices_count, float threshold);
+size_t optimizer_reorder_for_fetch(uint32_t *indices, size_t indices_count, size_t vertices_count, uint32_t *remap);
+void optimizer_remap_vertices(void *destination, const void *source, size_t vertices_count, size_t stride, const uint32_t *remap);
+struct optimizer_stats optimizer_analyze(const uint32_t *indices, size_t indices_count, size_t vertices_count, size_t cache_size);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact vertex formats.
+// Inputs are strided floats (straight from glTF accessors), outputs are tightly packed.
+void quantize_octahedral(const void *input, size_t stride, size_t count, int16_t *output);
+void quantize_snorm16(const void *input, size_t stride, size_t count, int components, int16_t *output);
+void quantize_half(const void *input, size_t stride, size_t count, int components, uint16_t *output);
+void quantize_unorm8(const void *input, size_t stride, size_t count, int components, uint8_t *output);
+
+// Decoding, as done by the GPU. Used to measure the precision loss.
+void dequantize_octahedral(const int16_t encoded[2], float decoded[3]);
+float dequantize_snorm16(int16_t value);
+float dequantize_half(uint16_t value);
+float dequantize_unorm8(uint8_t value);
+
+#endif
@@ -1,11 +1,21 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include "renderqueue.h"
 #include "scene.h"
 #include "ui.h"
 
 #define FPS_HISTORY_MAX_COUNT 20
 
+// What the last frame did, shown in the debug window.
+struct renderer_stats {
+	size_t draws;
+	size_t instances;
+	size_t programs; // Program switches.
+	size_t materials; // Material switches (textures and culling).
+	size_t vertex_arrays; // Vertex array switches.
+};
+
 struct renderer {
 	// Viewport.
 	float viewport_width;
@@ -23,9 +33,23 @@ struct renderer {
 	// Debugging features.
 	bool wireframe;
 
-	// Mouse picking.
+	// Mouse picking. The plain shader is also the one of the gizmos.
 	struct shader *plain_shader;
+	struct shader *picking_shader;
 	uint32_t mousepicking_entity_id;
+
+	// Draws of the current frame, see renderqueue.h.
+	struct renderqueue queue;
+	struct renderer_stats stats;
+
+	// Uniform buffers shared by every program, see shader.h.
+	GLuint frame_buffer;
+	GLuint lights_buffer;
+
+	// Instances of the frame (see renderqueue.h), read through a buffer texture.
+	GLuint instances_buffer;
+	GLuint instances_texture;
+	size_t instances_capacity;
 };
 
 void renderer_init(struct renderer *renderer);
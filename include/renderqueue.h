@@ -0,0 +1,92 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "cglm/cglm.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Draws of a frame, collected first then sorted so that the ones sharing state end up next to each other.
+// Keys are, from the most significant bits: pass, shader, material, vertex array and depth (front to back).
+// Only the low bits of the shader, material and vertex array names make it in, collisions just sort less well.
+
+#define RENDERQUEUE_PASS_BITS 4
+#define RENDERQUEUE_SHADER_BITS 16
+#define RENDERQUEUE_MATERIAL_BITS 16
+#define RENDERQUEUE_VERTEX_ARRAY_BITS 12
+#define RENDERQUEUE_DEPTH_BITS 16
+
+enum renderqueue_pass {
+	RENDERQUEUE_PASS_PICKING,
+	RENDERQUEUE_PASS_OPAQUE,
+};
+
+// Copies of a mesh (entities sharing a model) are drawn at once, instanced.
+// Instances of the frame are collected first, then grouped by mesh into batches, see renderqueue_group().
+// Shaders fetch them from a buffer texture, RENDERQUEUE_INSTANCE_TEXELS RGBA32F texels each.
+#define RENDERQUEUE_INSTANCE_TEXELS 10
+
+struct renderqueue_instance {
+	mat4 model_matrix;
+	vec4 normal_matrix[3]; // Columns of the 3x3 matrix.
+	vec4 picking_color;
+	vec4 bounds; // Bounding sphere in world space, center then radius. The radius is negative when unknown.
+	uint32_t material_index; // Only read when indirect draws mix materials, see indirect.h.
+	uint32_t padding[3];
+};
+
+struct renderqueue_batch {
+	const struct mesh *mesh;
+	size_t first; // Instance, once grouped.
+	size_t count;
+	float depth; // Of the nearest instance.
+};
+
+struct renderqueue_item {
+	const struct mesh *mesh;
+	const struct shader *shader;
+	size_t first_instance;
+	size_t instances_count;
+};
+
+struct renderqueue_entry {
+	uint64_t key;
+	size_t item;
+};
+
+struct renderqueue {
+	struct renderqueue_item *items;
+	size_t count;
+	size_t capacity;
+
+	// Sorted by key once renderqueue_sort() is done, the scratch space is for the radix sort.
+	struct renderqueue_entry *order;
+	struct renderqueue_entry *scratch;
+
+	// In submission order until renderqueue_group() sorts them by batch, `instance_batches` says which one they are in.
+	struct renderqueue_instance *instances;
+	struct renderqueue_instance *grouped;
+	size_t *instance_batches;
+	size_t instances_count;
+	size_t instances_capacity;
+
+	struct renderqueue_batch *batches;
+	size_t batches_count;
+	size_t batches_capacity;
+
+	// Open addressing from meshes to their batch (plus one, zero is empty).
+	size_t *lookup;
+	size_t lookup_capacity;
+};
+
+void renderqueue_init(struct renderqueue *queue);
+void renderqueue_fini(struct renderqueue *queue);
+void renderqueue_clear(struct renderqueue *queue);
+struct renderqueue_item *renderqueue_push(struct renderqueue *queue, uint64_t key);
+void renderqueue_sort(struct renderqueue *queue);
+struct renderqueue_instance *renderqueue_instance(struct renderqueue *queue, const struct mesh *mesh, float depth);
+void renderqueue_group(struct renderqueue *queue);
+
+uint64_t renderqueue_key(enum renderqueue_pass pass, uint32_t shader, uint32_t material, uint32_t vertex_array, float depth);
+enum renderqueue_pass renderqueue_key_pass(uint64_t key);
+
+#endif
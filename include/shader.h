@@ -5,48 +5,62 @@
 #include "environment.h"
 #include "light.h"
 #include "material.h"
+#include "materialmanager.h"
 
 struct shader {
 	GLuint program_id;
 
-	// Material uniforms.
-	GLint uniform_base_color_factor;
-	GLint uniform_base_color_sampler;
-	GLint uniform_normal_sampler;
-	GLint uniform_normal_scale;
-	GLint uniform_metallic_roughness_sampler;
-	GLint uniform_metallic_factor;
-	GLint uniform_roughness_factor;
-	GLint uniform_occlusion_sampler;
-	GLint uniform_occlusion_strength;
-	GLint uniform_emissive_sampler;
-	GLint uniform_emissive_factor;
-
-	// Environment IBL.
-	GLint uniform_environment_mip_count;
-	GLint uniform_environment_lambertian;
-	GLint uniform_environment_ggx;
-	GLint uniform_environment_ggx_lut;
-	GLint uniform_environment_charlie;
-	GLint uniform_environment_charlie_lut;
-
-	// Camera uniforms.
-	GLint uniform_camera;
-
-	// Light uniforms.
-	GLint uniform_lights_type[MAX_LIGHTS];
-	GLint uniform_lights_position[MAX_LIGHTS];
-	GLint uniform_lights_direction[MAX_LIGHTS];
-	GLint uniform_lights_color[MAX_LIGHTS];
-	GLint uniform_lights_intensity[MAX_LIGHTS];
-
-	// Model/View/Projection (MVP matrices).
-	GLint uniform_view_projection_matrix;
+	// Index of the material in the material table, see materialmanager.h.
+	GLint uniform_material_index;
+
+	// Where the instances of the draw start in the instance buffer, see renderqueue.h.
+	GLint uniform_instance_offset;
+
+	// Everything shared by the frame is in uniform buffers, this is only for the gizmos (drawn with the plain shader).
 	GLint uniform_model_matrix;
-	GLint uniform_normal_matrix;
-	GLint uniform_exposure;
 };
 
+// Uniform buffer bindings of the blocks every program shares, updated once per frame by the renderer.
+// Blocks can't pick their binding in GLSL 4.1, find_uniforms() in shader.c assigns them.
+#define SHADER_FRAME_BINDING 1
+#define SHADER_LIGHTS_BINDING 2
+
+// Texture unit of the instance buffer texture, past the material table.
+#define SHADER_INSTANCES_UNIT (MATERIALMANAGER_TABLE_UNIT + 1)
+
+// The `Frame` block of the shaders, laid out for std140.
+struct shader_frame {
+	mat4 view_projection_matrix;
+	vec3 camera;
+	float exposure;
+	int32_t mip_count;
+	int32_t padding[3];
+};
+
+// The `Light` struct of the PBR shader, laid out for std140.
+struct shader_light {
+	vec3 direction;
+	float range;
+	vec3 color;
+	float intensity;
+	vec3 position;
+	float inner_cone_cos;
+	float outer_cone_cos;
+	int32_t type;
+	float padding[2];
+};
+
+// The `Lights` block of the PBR shader.
+// Only the first MAX_LIGHTS lights of the scene make it in, the ones past that are dropped in order.
+struct shader_lights {
+	struct shader_light lights[MAX_LIGHTS];
+	int32_t count;
+	int32_t padding[3];
+};
+
+void shader_frame_init(struct shader_frame *frame, mat4 view_projection_matrix, const struct camera *camera, const struct environment *environment, float exposure);
+void shader_lights_init(struct shader_lights *lights, const struct light **scene_lights, size_t count);
+
 struct shader_options {
 	// Attributes.
 	bool has_normals;
@@ -56,6 +70,7 @@ struct shader_options {
 	bool has_joint_set1;
 	bool has_color_vec3;
 	bool has_color_vec4;
+	bool has_octahedral_normals;
 
 	// Textures.
 	bool has_base_color_map;
@@ -103,10 +118,11 @@ struct shader *shader_load_from_files(const struct shader_options *options, cons
 struct shader *shader_load_from_memory(const struct shader_options *options, const unsigned char *vertex_content, size_t vertex_length, const unsigned char *fragment_content, size_t fragment_length, const unsigned char *compute_content, size_t compute_length);
 void shader_destroy(struct shader *shader);
 
+uint64_t shader_options_hash(const struct shader_options *options);
+bool shader_options_equal(const struct shader_options *a, const struct shader_options *b);
+
 void shader_bind_uniform_material(const struct shader *shader, const struct material *material);
-void shader_bind_uniform_camera(const struct shader *shader, const struct camera *camera);
-void shader_bind_uniform_lights(const struct shader *shader, const struct light **lights, size_t count);
-void shader_bind_uniform_environment(const struct shader *shader, const struct environment *environment);
-void shader_bind_uniform_mvp(const struct shader *shader, mat4 view_projection_matrix, mat4 model_matrix, float exposure);
+void shader_bind_uniform_model(const struct shader *shader, mat4 model_matrix);
+void shader_bind_uniform_instances(const struct shader *shader, size_t first_instance);
 
 #endif
@@ -0,0 +1,9 @@
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+#include "shader.h"
+
+struct shader *shadermanager_load_shader(const struct shader_options *options, const unsigned char *vertex_content, size_t vertex_length, const unsigned char *fragment_content, size_t fragment_length, const unsigned char *compute_content, size_t compute_length);
+void shadermanager_unload_shader(const struct shader *shader);
+
+#endif
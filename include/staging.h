@@ -0,0 +1,26 @@
+#ifndef STAGING_H
+#define STAGING_H
+
+#include "glad/glad.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Uploads go through a persistently mapped ring buffer, the GPU then copies out of it into buffers and textures.
+// Unlike uploading straight from client memory, the driver never has to copy the data synchronously or stall on a buffer in use.
+// Ring space is recycled once the fence of the frame that used it has been passed.
+// Needs GL_ARB_buffer_storage, without it staging is unavailable and callers upload directly.
+// Everything has to happen on the main thread.
+
+#define STAGING_RING_SIZE (32 << 20)
+#define STAGING_ALIGNMENT 256
+#define STAGING_FENCES_MAX 64
+
+bool staging_init(void);
+void staging_fini(void);
+bool staging_available(void);
+bool staging_write(const void *data, size_t size, size_t *offset);
+GLuint staging_buffer(void);
+bool staging_upload_buffer(GLuint buffer, size_t offset, const void *data, size_t size);
+void staging_flush(void);
+
+#endif
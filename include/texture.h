@@ -2,6 +2,9 @@
 #define TEXTURE_H
 
 #include "glad/glad.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 enum texture_kind {
 	// PBR textures.
@@ -30,6 +33,7 @@ enum texture_kind {
 
 enum texture_type {
 	TEXTURE_TYPE_UNSIGNED_BYTE,
+	TEXTURE_TYPE_HALF_FLOAT,
 	TEXTURE_TYPE_FLOAT
 };
 
@@ -47,6 +51,32 @@ enum texture_format_internal {
 	TEXTURE_FORMAT_INTERNAL_RGBA8,
 	TEXTURE_FORMAT_INTERNAL_RGBA16F,
 	TEXTURE_FORMAT_INTERNAL_RGBA32F,
+	TEXTURE_FORMAT_INTERNAL_BC1,
+	TEXTURE_FORMAT_INTERNAL_BC3,
+	TEXTURE_FORMAT_INTERNAL_BC5,
+	TEXTURE_FORMAT_INTERNAL_BC7,
+};
+
+// Block compressed pixel data, see compress.h.
+enum texture_compression {
+	TEXTURE_COMPRESSION_NONE,
+	TEXTURE_COMPRESSION_BC1, // RGB, 8 bytes per 4x4 block.
+	TEXTURE_COMPRESSION_BC3, // RGBA, 16 bytes per block.
+	TEXTURE_COMPRESSION_BC5, // Two channels (normal maps), 16 bytes per block.
+	TEXTURE_COMPRESSION_BC7, // RGBA, 16 bytes per block. Only ever loaded from KTX2 files, we have no encoder for it.
+};
+
+// How mip levels are filtered down from the one above, see texture_image_mipmaps().
+enum texture_filter {
+	TEXTURE_FILTER_BOX, // 2x2 average, vectorized for linear content.
+	TEXTURE_FILTER_KAISER, // Kaiser windowed sinc over 6x6 texels, sharper and without the box blur.
+};
+
+// What the pixels hold, so that averaging them makes sense.
+enum texture_content {
+	TEXTURE_CONTENT_LINEAR, // Averaged as they are (metallic/roughness, occlusion).
+	TEXTURE_CONTENT_SRGB, // Color in RGB averaged in linear space, alpha as it is (albedo, emission).
+	TEXTURE_CONTENT_NORMAL, // Unit vectors in RGB averaged then renormalized.
 };
 
 struct texture {
@@ -54,10 +84,16 @@ struct texture {
 	size_t height;
 	size_t levels;
 
+	// Streaming textures only have levels from the base one (the finest resident) down, see texturemanager.h.
+	size_t base_level;
+	size_t wanted_level; // Finest level asked for this frame, `levels` when none was.
+	uint64_t last_used; // Frame it was last asked for.
+
 	enum texture_kind kind;
 
 	// Object stuff.
 	GLuint gl_id;
+	GLuint64 gl_handle; // Bindless, 0 until texture_handle() asks for one.
 
 	// Sampler stuff.
 	GLenum gl_target;
@@ -69,13 +105,61 @@ struct texture {
 	GLenum gl_internal_format;
 };
 
+// Decoded pixel data, not yet uploaded. Producing one doesn't involve OpenGL and can happen on any thread.
+// Images with a mip chain have all their levels one after the other in `pixels`, finest first.
+// Cubemaps have their 6 faces one after the other in each level, in the order of the OpenGL targets.
+// Mip chains and compression are only for 8 bit 2D images, HDR ones (half or full floats) are used as they are.
+struct texture_image {
+	int width;
+	int height;
+	int components; // Of the uncompressed pixels.
+	enum texture_type type; // Of each component.
+	enum texture_compression compression;
+	size_t faces; // 1, or 6 for cubemaps.
+	size_t levels;
+	size_t size; // In bytes, of all the levels.
+	unsigned char *pixels;
+};
+
+// One image to decode as part of a batch, see texture_images_decode().
+// Decoded images can also get their mip chain generated and be compressed, still on the worker.
+// Asking for BC1 gets BC3 instead when the image has transparency.
+struct texture_decode {
+	const unsigned char *data;
+	size_t size;
+	struct texture_image *image;
+	bool mipmaps;
+	enum texture_content content;
+	enum texture_filter filter;
+	enum texture_compression compression;
+	bool ok;
+};
+
+bool texture_image_decode(struct texture_image *image, const unsigned char *data, size_t size);
+void texture_images_decode(struct texture_decode *decodes, size_t count);
+void texture_image_fini(struct texture_image *image);
+size_t texture_levels_count(size_t width, size_t height);
+size_t texture_image_level(const struct texture_image *image, size_t level, int *width, int *height, size_t *offset);
+bool texture_image_is_8bit_2d(const struct texture_image *image);
+bool texture_image_mipmaps(const struct texture_image *image, struct texture_image *chain, enum texture_content content, enum texture_filter filter);
+enum texture_content texture_kind_content(enum texture_kind kind);
+bool texture_image_compress(const struct texture_image *image, struct texture_image *compressed, enum texture_compression compression);
+
 void texture_init(struct texture *texture, enum texture_kind kind, size_t width, size_t height, bool mipmapping, enum texture_type type, enum texture_format format, enum texture_format_internal format_internal);
 bool texture_init_from_file(struct texture *texture, enum texture_kind kind, const char *filepath);
 bool texture_init_from_memory(struct texture *texture, enum texture_kind kind, const unsigned char *data, size_t size);
+bool texture_init_from_image(struct texture *texture, enum texture_kind kind, const struct texture_image *image);
+bool texture_init_streaming(struct texture *texture, enum texture_kind kind, const struct texture_image *image, size_t base_level);
 void texture_fini(struct texture *texture);
 
 void texture_replace_data(struct texture *texture, unsigned int level, unsigned int width, unsigned int height, const void *data);
+void texture_stream_levels(struct texture *texture, const struct texture_image *image, size_t base_level);
 void texture_anisotropic_filtering(struct texture *texture, float anisotropy);
 void texture_switch(const struct texture *texture);
 
+// Bindless textures (GL_ARB_bindless_texture), shaders then take handles instead of texture units.
+// A texture with a handle can't change anymore, streaming levels in starts it over with a new object (and handle).
+bool texture_bindless(void);
+GLuint64 texture_handle(struct texture *texture);
+
 #endif
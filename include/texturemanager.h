@@ -0,0 +1,24 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include "texture.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes of texture levels resident on the GPU, the least recently used textures lose their finer levels past that.
+#define TEXTUREMANAGER_BUDGET (256 << 20)
+
+// Levels this small (in texels, along the largest side) and coarser are always resident.
+#define TEXTUREMANAGER_INITIAL_SIZE 32
+
+// Bytes of texture levels uploaded per frame, counting the levels re-uploaded when a texture has to start over.
+#define TEXTUREMANAGER_UPLOAD_BUDGET (8 << 20)
+
+struct texture *texturemanager_load_texture(uint64_t hash, enum texture_kind kind, const struct texture_image *image);
+void texturemanager_unload_texture(const struct texture *texture);
+void texturemanager_request(struct texture *texture, size_t level);
+void texturemanager_update(size_t upload_budget);
+void texturemanager_budget(size_t budget);
+size_t texturemanager_resident(void);
+
+#endif
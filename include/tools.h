@@ -0,0 +1,10 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
+#include <stdbool.h>
+
+// Offline command-line tools (benchmarks, reports), e.g. `layman --benchmark-decode assets/DamagedHelmet.glb`.
+bool tools_exists(const char *name);
+int tools_run(int argc, char *argv[]);
+
+#endif
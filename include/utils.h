@@ -16,6 +16,9 @@
 #define ARRAY_COUNT(x) (sizeof (x) / sizeof (x)[0])
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
+// Starting value for utils_hash(), also usable as the seed of a first hash in a chain.
+#define UTILS_HASH_SEED 14695981039346656037ULL
+
 #include "cglm/cglm.h"
 
 void utils_render_cube(void);
@@ -24,6 +27,7 @@ void utils_render_ngon(int n, float radius, mat4 transform, vec4 color);
 float utils_closest_distance_between_two_rays(vec3 r1_origin, vec3 r1_direction, vec3 r2_origin, vec3 r2_direction, float *d1, float *d2);
 float utils_closest_distance_between_ray_and_circle(vec3 ray_origin, vec3 ray_direction, vec3 circle_origin, vec3 circle_orientation, float circle_radius, vec3 closest);
 bool utils_ray_plane_intersection(vec3 plane_origin, vec3 plane_normal, vec3 ray_origin, vec3 ray_direction, float *t);
+uint64_t utils_hash(const void *data, size_t size, uint64_t seed);
 struct entity *find_selected_entity(void);
 
 #endif
@@ -230,10 +230,17 @@ typedef struct cgltf_extension {
 	char *data;
 } cgltf_extension;
 
+typedef enum cgltf_data_free_method {
+	cgltf_data_free_method_none,
+	cgltf_data_free_method_file_release,
+	cgltf_data_free_method_memory_free,
+} cgltf_data_free_method;
+
 typedef struct cgltf_buffer {
 	cgltf_size size;
 	char *uri;
 	void *data; /* loaded by cgltf_load_buffers */
+	cgltf_data_free_method data_free_method;
 	cgltf_extras extras;
 	cgltf_size extensions_count;
 	cgltf_extension *extensions;
@@ -345,6 +352,8 @@ typedef struct cgltf_texture {
 	char *name;
 	cgltf_image *image;
 	cgltf_sampler *sampler;
+	cgltf_bool has_basisu;
+	cgltf_image *basisu_image;
 	cgltf_extras extras;
 	cgltf_size extensions_count;
 	cgltf_extension *extensions;
@@ -681,6 +690,10 @@ typedef struct cgltf_data {
 	cgltf_file_options file;
 } cgltf_data;
 
+/* File callbacks that map files read-only instead of reading them, for cgltf_options.file */
+cgltf_result cgltf_mapped_file_read(const struct cgltf_memory_options *memory_options, const struct cgltf_file_options *file_options, const char *path, cgltf_size *size, void **data);
+void cgltf_mapped_file_release(const struct cgltf_memory_options *memory_options, const struct cgltf_file_options *file_options, void *data);
+
 cgltf_result cgltf_parse(
     const cgltf_options *options,
     const void *data,
@@ -1,3 +1,7 @@
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE /* For MAP_ANONYMOUS */
+#endif
+
 #include "gltf.h"
 
 #include <limits.h> /* For UINT_MAX etc */
@@ -6,6 +10,16 @@
 #include <stdlib.h> /* For malloc, free, atoi, atof */
 #include <string.h> /* For strncpy */
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> /* For CreateFileMapping, MapViewOfFile */
+#else
+#include <fcntl.h> /* For open */
+#include <sys/mman.h> /* For mmap, munmap */
+#include <sys/stat.h> /* For fstat */
+#include <unistd.h> /* For close, sysconf */
+#endif
+
 /* JSMN_PARENT_LINKS is necessary to make parsing large structures linear in input size */
 #define JSMN_PARENT_LINKS
 
@@ -150,6 +164,115 @@ static void cgltf_default_file_release(const struct cgltf_memory_options *memory
 	memfree(memory_options->user_data, data);
 }
 
+/*
+ * Mapped files are read-only views of the file contents, so parsing a GLB leaves its JSON and BIN chunks in place and
+ * buffer data points straight into the mapping. On POSIX the view is placed one page into an anonymous reservation
+ * whose first page remembers the total length, because munmap needs it and the release callback only gets a pointer.
+ */
+cgltf_result cgltf_mapped_file_read(const struct cgltf_memory_options *memory_options, const struct cgltf_file_options *file_options, const char *path, cgltf_size *size, void **data) {
+	(void) memory_options;
+	(void) file_options;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return cgltf_result_file_not_found;
+	}
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart <= 0 || (unsigned long long) length.QuadPart > SIZE_MAX) {
+		CloseHandle(file);
+		return cgltf_result_io_error;
+	}
+
+	cgltf_size file_size = size && *size ? *size : (cgltf_size) length.QuadPart;
+	if (file_size > (cgltf_size) length.QuadPart) {
+		CloseHandle(file);
+		return cgltf_result_io_error;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) {
+		return cgltf_result_io_error;
+	}
+
+	void *file_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, file_size);
+	CloseHandle(mapping);
+	if (!file_data) {
+		return cgltf_result_io_error;
+	}
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) {
+		return cgltf_result_file_not_found;
+	}
+
+	struct stat stats;
+	if (fstat(file, &stats) != 0 || stats.st_size <= 0) {
+		close(file);
+		return cgltf_result_io_error;
+	}
+
+	cgltf_size file_size = size && *size ? *size : (cgltf_size) stats.st_size;
+	if (file_size > (cgltf_size) stats.st_size) {
+		close(file);
+		return cgltf_result_io_error;
+	}
+
+	cgltf_size page_size = (cgltf_size) sysconf(_SC_PAGESIZE);
+	cgltf_size reserved_size = page_size + file_size;
+
+	char *reserved = (char *) mmap(NULL, reserved_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (reserved == MAP_FAILED) {
+		close(file);
+		return cgltf_result_out_of_memory;
+	}
+
+	void *file_data = mmap(reserved + page_size, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, file, 0);
+	close(file);
+	if (file_data == MAP_FAILED) {
+		munmap(reserved, reserved_size);
+		return cgltf_result_io_error;
+	}
+
+	memcpy(reserved, &reserved_size, sizeof(reserved_size));
+	madvise(file_data, file_size, MADV_WILLNEED);
+#endif
+
+	if (size) {
+		*size = file_size;
+	}
+	if (data) {
+		*data = file_data;
+	} else {
+		cgltf_mapped_file_release(memory_options, file_options, file_data);
+	}
+
+	return cgltf_result_success;
+}
+
+void cgltf_mapped_file_release(const struct cgltf_memory_options *memory_options, const struct cgltf_file_options *file_options, void *data) {
+	(void) memory_options;
+	(void) file_options;
+
+	if (!data) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	cgltf_size page_size = (cgltf_size) sysconf(_SC_PAGESIZE);
+	char *reserved = (char *) data - page_size;
+
+	cgltf_size reserved_size;
+	memcpy(&reserved_size, reserved, sizeof(reserved_size));
+
+	munmap(reserved, reserved_size);
+#endif
+}
+
 static cgltf_result cgltf_parse_json(cgltf_options *options, const uint8_t *json_chunk, cgltf_size size, cgltf_data **out_data);
 
 cgltf_result cgltf_parse(const cgltf_options *options, const void *data, cgltf_size size, cgltf_data **out_data) {
@@ -414,6 +537,7 @@ cgltf_result cgltf_load_buffers(const cgltf_options *options, cgltf_data *data,
 		}
 
 		data->buffers[0].data = (void *) data->bin;
+		data->buffers[0].data_free_method = cgltf_data_free_method_none;
 	}
 
 	for (cgltf_size i = 0; i < data->buffers_count; ++i) {
@@ -432,6 +556,7 @@ cgltf_result cgltf_load_buffers(const cgltf_options *options, cgltf_data *data,
 
 			if (comma && comma - uri >= 7 && strncmp(comma - 7, ";base64", 7) == 0) {
 				cgltf_result res = cgltf_load_buffer_base64(options, data->buffers[i].size, comma + 1, &data->buffers[i].data);
+				data->buffers[i].data_free_method = cgltf_data_free_method_memory_free;
 
 				if (res != cgltf_result_success) {
 					return res;
@@ -441,6 +566,7 @@ cgltf_result cgltf_load_buffers(const cgltf_options *options, cgltf_data *data,
 			}
 		} else if (strstr(uri, "://") == NULL && gltf_path) {
 			cgltf_result res = cgltf_load_buffer_file(options, data->buffers[i].size, uri, gltf_path, &data->buffers[i].data);
+			data->buffers[i].data_free_method = cgltf_data_free_method_file_release;
 
 			if (res != cgltf_result_success) {
 				return res;
@@ -757,8 +883,10 @@ void cgltf_free(cgltf_data *data) {
 	data->memory.free(data->memory.user_data, data->buffer_views);
 
 	for (cgltf_size i = 0; i < data->buffers_count; ++i) {
-		if (data->buffers[i].data != data->bin) {
+		if (data->buffers[i].data_free_method == cgltf_data_free_method_file_release) {
 			file_release(&data->memory, &data->file, data->buffers[i].data);
+		} else if (data->buffers[i].data_free_method == cgltf_data_free_method_memory_free) {
+			data->memory.free(data->memory.user_data, data->buffers[i].data);
 		}
 		data->memory.free(data->memory.user_data, data->buffers[i].uri);
 
@@ -2362,7 +2490,55 @@ static int cgltf_parse_json_texture(cgltf_options *options, jsmntok_t const *tok
 		} else if (cgltf_json_strcmp(tokens + i, json_chunk, "extras") == 0) {
 			i = cgltf_parse_json_extras(tokens, i + 1, json_chunk, &out_texture->extras);
 		} else if (cgltf_json_strcmp(tokens + i, json_chunk, "extensions") == 0) {
-			i = cgltf_parse_json_unprocessed_extensions(options, tokens, i, json_chunk, &out_texture->extensions_count, &out_texture->extensions);
+			++i;
+
+			CGLTF_CHECK_TOKTYPE(tokens[i], JSMN_OBJECT);
+			if (out_texture->extensions) {
+				return CGLTF_ERROR_JSON;
+			}
+
+			int extensions_size = tokens[i].size;
+			++i;
+			out_texture->extensions = (cgltf_extension *) cgltf_calloc(options, sizeof(cgltf_extension), extensions_size);
+			out_texture->extensions_count = 0;
+
+			if (!out_texture->extensions) {
+				return CGLTF_ERROR_NOMEM;
+			}
+
+			for (int k = 0; k < extensions_size; ++k) {
+				CGLTF_CHECK_KEY(tokens[i]);
+
+				if (cgltf_json_strcmp(tokens + i, json_chunk, "KHR_texture_basisu") == 0) {
+					out_texture->has_basisu = 1;
+					++i;
+					CGLTF_CHECK_TOKTYPE(tokens[i], JSMN_OBJECT);
+					int num_properties = tokens[i].size;
+					++i;
+
+					for (int t = 0; t < num_properties; ++t) {
+						CGLTF_CHECK_KEY(tokens[i]);
+
+						if (cgltf_json_strcmp(tokens + i, json_chunk, "source") == 0) {
+							++i;
+							out_texture->basisu_image = CGLTF_PTRINDEX(cgltf_image, cgltf_json_to_int(tokens + i, json_chunk));
+							++i;
+						} else {
+							i = cgltf_skip_json(tokens, i + 1);
+						}
+
+						if (i < 0) {
+							return i;
+						}
+					}
+				} else {
+					i = cgltf_parse_json_unprocessed_extension(options, tokens, i, json_chunk, &(out_texture->extensions[out_texture->extensions_count++]));
+				}
+
+				if (i < 0) {
+					return i;
+				}
+			}
 		} else {
 			i = cgltf_skip_json(tokens, i + 1);
 		}
@@ -3737,6 +3913,7 @@ static int cgltf_fixup_pointers(cgltf_data *data) {
 
 	for (cgltf_size i = 0; i < data->textures_count; ++i) {
 		CGLTF_PTRFIXUP(data->textures[i].image, data->images, data->images_count);
+		CGLTF_PTRFIXUP(data->textures[i].basisu_image, data->images, data->images_count);
 		CGLTF_PTRFIXUP(data->textures[i].sampler, data->samplers, data->samplers_count);
 	}
 
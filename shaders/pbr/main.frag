@@ -4,7 +4,14 @@ precision highp float;
 //                                                 TONEMAPPING
 // =====================================================================================================================
 
-uniform float u_Exposure;
+// Per-frame data, see struct shader_frame.
+layout(std140) uniform Frame
+{
+    mat4 u_ViewProjectionMatrix;
+    vec3 u_Camera;
+    float u_Exposure;
+    int u_MipCount;
+};
 
 const float GAMMA = 2.2;
 const float INV_GAMMA = 1.0 / GAMMA;
@@ -88,6 +95,101 @@ vec3 toneMap(vec3 color)
     return linearTosRGB(color);
 }
 
+// =====================================================================================================================
+//                                                  MATERIAL TABLE
+// =====================================================================================================================
+
+// Every material has MATERIAL_TEXELS texels in the table, at its ID. See struct material_uniforms.
+const int MATERIAL_TEXELS = 6;
+
+#ifdef USE_INSTANCE_MATERIALS
+// From the instance, draws mix materials.
+flat in int v_MaterialIndex;
+#define MATERIAL_INDEX v_MaterialIndex
+#else
+uniform int u_MaterialIndex;
+#define MATERIAL_INDEX u_MaterialIndex
+#endif
+
+#ifdef USE_MATERIAL_STORAGE
+layout(std430) readonly buffer Materials
+{
+    uvec4 u_Materials[];
+};
+
+uvec4 getMaterialTexel(int i)
+{
+    return u_Materials[MATERIAL_INDEX * MATERIAL_TEXELS + i];
+}
+#else
+uniform usamplerBuffer u_Materials;
+
+uvec4 getMaterialTexel(int i)
+{
+    return texelFetch(u_Materials, MATERIAL_INDEX * MATERIAL_TEXELS + i);
+}
+#endif
+
+struct Material
+{
+    vec4 baseColorFactor;
+    vec3 emissiveFactor;
+    float normalScale;
+    float metallicFactor;
+    float roughnessFactor;
+    float occlusionStrength;
+
+#ifdef USE_BINDLESS_TEXTURES
+    uvec2 baseColorTexture;
+    uvec2 metallicRoughnessTexture;
+    uvec2 normalTexture;
+    uvec2 occlusionTexture;
+    uvec2 emissiveTexture;
+#endif
+};
+
+// Read once at the start of main().
+Material g_material;
+
+Material getMaterial()
+{
+    Material material;
+
+    material.baseColorFactor = uintBitsToFloat(getMaterialTexel(0));
+
+    vec4 emissive = uintBitsToFloat(getMaterialTexel(1));
+    material.emissiveFactor = emissive.rgb;
+    material.normalScale = emissive.a;
+
+    vec4 factors = uintBitsToFloat(getMaterialTexel(2));
+    material.metallicFactor = factors.x;
+    material.roughnessFactor = factors.y;
+    material.occlusionStrength = factors.z;
+
+#ifdef USE_BINDLESS_TEXTURES
+    uvec4 handles = getMaterialTexel(3);
+    material.baseColorTexture = handles.xy;
+    material.metallicRoughnessTexture = handles.zw;
+
+    handles = getMaterialTexel(4);
+    material.normalTexture = handles.xy;
+    material.occlusionTexture = handles.zw;
+
+    material.emissiveTexture = getMaterialTexel(5).xy;
+#endif
+
+    return material;
+}
+
+#ifdef USE_BINDLESS_TEXTURES
+// The handles stand in for the sampler uniforms.
+#define u_BaseColorSampler sampler2D(g_material.baseColorTexture)
+#define u_MetallicRoughnessSampler sampler2D(g_material.metallicRoughnessTexture)
+#define u_NormalSampler sampler2D(g_material.normalTexture)
+#define u_OcclusionSampler sampler2D(g_material.occlusionTexture)
+#define u_EmissiveSampler sampler2D(g_material.emissiveTexture)
+#endif
+
 // =====================================================================================================================
 //                                                   TEXTURES
 // =====================================================================================================================
@@ -96,27 +198,27 @@ in vec2 v_UVCoord1;
 in vec2 v_UVCoord2;
 
 // General Material
+#ifndef USE_BINDLESS_TEXTURES
 uniform sampler2D u_NormalSampler;
-uniform float u_NormalScale;
+uniform sampler2D u_EmissiveSampler;
+uniform sampler2D u_OcclusionSampler;
+uniform sampler2D u_BaseColorSampler;
+uniform sampler2D u_MetallicRoughnessSampler;
+#endif
+
 uniform int u_NormalUVSet;
 uniform mat3 u_NormalUVTransform;
 
-uniform vec3 u_EmissiveFactor;
-uniform sampler2D u_EmissiveSampler;
 uniform int u_EmissiveUVSet;
 uniform mat3 u_EmissiveUVTransform;
 
-uniform sampler2D u_OcclusionSampler;
 uniform int u_OcclusionUVSet;
-uniform float u_OcclusionStrength;
 uniform mat3 u_OcclusionUVTransform;
 
 // Metallic Roughness Material
-uniform sampler2D u_BaseColorSampler;
 uniform int u_BaseColorUVSet;
 uniform mat3 u_BaseColorUVTransform;
 
-uniform sampler2D u_MetallicRoughnessSampler;
 uniform int u_MetallicRoughnessUVSet;
 uniform mat3 u_MetallicRoughnessUVTransform;
 
@@ -130,13 +232,17 @@ uniform int u_SpecularGlossinessUVSet;
 uniform mat3 u_SpecularGlossinessUVTransform;
 
 // IBL
-uniform int u_MipCount;
-uniform samplerCube u_LambertianEnvSampler;
 uniform samplerCube u_GGXEnvSampler;
 uniform sampler2D u_GGXLUT;
 uniform samplerCube u_CharlieEnvSampler;
 uniform sampler2D u_CharlieLUT;
 
+// Diffuse irradiance as L2 spherical harmonics, premultiplied (see src/ibl.c).
+layout(std140) uniform Irradiance
+{
+    vec4 u_IrradianceSH[9];
+};
+
 //clearcoat
 uniform sampler2D u_ClearcoatSampler;
 uniform int u_ClearcoatUVSet;
@@ -766,9 +872,23 @@ vec3 getIBLRadianceTransmission(vec3 n, vec3 v, float perceptualRoughness, float
    return specularLight * (brdf.x + brdf.y);
 }
 
+vec3 getIrradiance(vec3 n)
+{
+    return u_IrradianceSH[0].rgb
+        + u_IrradianceSH[1].rgb * n.y
+        + u_IrradianceSH[2].rgb * n.z
+        + u_IrradianceSH[3].rgb * n.x
+        + u_IrradianceSH[4].rgb * (n.x * n.y)
+        + u_IrradianceSH[5].rgb * (n.y * n.z)
+        + u_IrradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + u_IrradianceSH[7].rgb * (n.x * n.z)
+        + u_IrradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+}
+
 vec3 getIBLRadianceLambertian(vec3 n, vec3 diffuseColor)
 {
-    vec3 diffuseLight = texture(u_LambertianEnvSampler, n).rgb;
+    // Ringing can take the band limited lighting slightly below zero.
+    vec3 diffuseLight = max(getIrradiance(n), vec3(0.0));
 
     #ifndef USE_HDR
         diffuseLight = sRGBToLinear(diffuseLight);
@@ -798,7 +918,7 @@ vec3 getIBLRadianceCharlie(vec3 n, vec3 v, float sheenRoughness, vec3 sheenColor
 
 vec3 getIBLRadianceSubsurface(vec3 n, vec3 v, float scale, float distortion, float power, vec3 color, float thickness)
 {
-    vec3 diffuseLight = texture(u_LambertianEnvSampler, n).rgb;
+    vec3 diffuseLight = max(getIrradiance(n), vec3(0.0));
 
     #ifndef USE_HDR
         diffuseLight = sRGBToLinear(diffuseLight);
@@ -814,14 +934,14 @@ vec3 getIBLRadianceSubsurface(vec3 n, vec3 v, float scale, float distortion, flo
 out vec4 g_finalColor;
 
 #ifdef USE_PUNCTUAL
-uniform Light u_Lights[LIGHT_COUNT];
+// See struct shader_lights.
+layout(std140) uniform Lights
+{
+    Light u_Lights[LIGHT_COUNT];
+    int u_LightCount;
+};
 #endif
 
-// Metallic Roughness
-uniform float u_MetallicFactor;
-uniform float u_RoughnessFactor;
-uniform vec4 u_BaseColorFactor;
-
 // Specular Glossiness
 uniform vec3 u_SpecularFactor;
 uniform vec4 u_DiffuseFactor;
@@ -870,8 +990,6 @@ uniform float u_Transmission;
 // Alpha mode
 uniform float u_AlphaCutoff;
 
-uniform vec3 u_Camera;
-
 struct MaterialInfo
 {
     float perceptualRoughness;      // roughness value, as authored by the model creator (input to shader)
@@ -967,8 +1085,10 @@ NormalInfo getNormalInfo(vec3 v)
 
     // Compute pertubed normals:
     #ifdef HAS_NORMAL_MAP
-        n = texture(u_NormalSampler, UV).rgb * 2.0 - vec3(1.0);
-        n *= vec3(u_NormalScale, u_NormalScale, 1.0);
+        // Z is reconstructed, normal maps may be compressed down to their first two channels (BC5).
+        n.xy = texture(u_NormalSampler, UV).rg * 2.0 - vec2(1.0);
+        n.z = sqrt(clamp(1.0 - dot(n.xy, n.xy), 0.0, 1.0));
+        n *= vec3(g_material.normalScale, g_material.normalScale, 1.0);
         n = mat3(t, b, ng) * normalize(n);
     #else
         n = ng;
@@ -989,7 +1109,7 @@ vec4 getBaseColor()
     #if defined(MATERIAL_SPECULARGLOSSINESS)
         baseColor = u_DiffuseFactor;
     #elif defined(MATERIAL_METALLICROUGHNESS)
-        baseColor = u_BaseColorFactor;
+        baseColor = g_material.baseColorFactor;
     #endif
 
     #if defined(MATERIAL_SPECULARGLOSSINESS) && defined(HAS_DIFFUSE_MAP)
@@ -1031,8 +1151,8 @@ float getMetallicRoughnessSpecularFactor()
 
 MaterialInfo getMetallicRoughnessInfo(MaterialInfo info, float f0_ior)
 {
-    info.metallic = u_MetallicFactor;
-    info.perceptualRoughness = u_RoughnessFactor;
+    info.metallic = g_material.metallicFactor;
+    info.perceptualRoughness = g_material.roughnessFactor;
 
 #ifdef HAS_METALLIC_ROUGHNESS_MAP
     // Roughness is stored in the 'g' channel, metallic is stored in the 'b' channel.
@@ -1200,6 +1320,8 @@ MaterialInfo getClearCoatInfo(MaterialInfo info, NormalInfo normalInfo)
 
 void main()
 {
+    g_material = getMaterial();
+
     vec4 baseColor = getBaseColor();
 
 #ifdef ALPHAMODE_OPAQUE
@@ -1320,7 +1442,7 @@ void main()
 #endif
 
 #ifdef USE_PUNCTUAL
-    for (int i = 0; i < LIGHT_COUNT; ++i)
+    for (int i = 0; i < u_LightCount; ++i)
     {
         Light light = u_Lights[i];
 
@@ -1396,7 +1518,7 @@ void main()
     }
 #endif // !USE_PUNCTUAL
 
-    f_emissive = u_EmissiveFactor;
+    f_emissive = g_material.emissiveFactor;
 #ifdef HAS_EMISSIVE_MAP
     f_emissive *= sRGBToLinear(texture(u_EmissiveSampler, getEmissiveUV())).rgb;
 #endif
@@ -1431,7 +1553,7 @@ void main()
     // Apply optional PBR terms for additional (optional) shading
 #ifdef HAS_OCCLUSION_MAP
     ao = texture(u_OcclusionSampler,  getOcclusionUV()).r;
-    color = mix(color, color * ao, u_OcclusionStrength);
+    color = mix(color, color * ao, g_material.occlusionStrength);
 #endif
 
 #ifndef DEBUG_OUTPUT // no debug
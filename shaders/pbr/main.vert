@@ -231,8 +231,12 @@ in vec3 a_Position;
 out vec3 v_Position;
 
 #ifdef HAS_NORMALS
+#ifdef HAS_OCTAHEDRAL_NORMALS
+in vec2 a_Normal;
+#else
 in vec3 a_Normal;
 #endif
+#endif
 
 #ifdef HAS_TANGENTS
 in vec4 a_Tangent;
@@ -267,9 +271,58 @@ in vec4 a_Color;
 out vec4 v_Color;
 #endif
 
-uniform mat4 u_ViewProjectionMatrix;
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_NormalMatrix;
+// Per-frame data, see struct shader_frame.
+layout(std140) uniform Frame
+{
+    mat4 u_ViewProjectionMatrix;
+    vec3 u_Camera;
+    float u_Exposure;
+    int u_MipCount;
+};
+
+// Instances of the draw, RENDERQUEUE_INSTANCE_TEXELS texels each. See struct renderqueue_instance.
+const int INSTANCE_TEXELS = 10;
+
+uniform samplerBuffer u_Instances;
+
+#ifdef USE_INDIRECT
+// Instances that survived culling, see indirect.h.
+in uint a_InstanceIndex;
+
+int getInstance()
+{
+    return int(a_InstanceIndex);
+}
+#else
+uniform int u_InstanceOffset;
+
+int getInstance()
+{
+    return u_InstanceOffset + gl_InstanceID;
+}
+#endif
+
+mat4 getModelMatrix()
+{
+    int texel = getInstance() * INSTANCE_TEXELS;
+    return mat4(texelFetch(u_Instances, texel), texelFetch(u_Instances, texel + 1), texelFetch(u_Instances, texel + 2), texelFetch(u_Instances, texel + 3));
+}
+
+mat3 getNormalMatrix()
+{
+    int texel = getInstance() * INSTANCE_TEXELS + 4;
+    return mat3(texelFetch(u_Instances, texel).xyz, texelFetch(u_Instances, texel + 1).xyz, texelFetch(u_Instances, texel + 2).xyz);
+}
+
+#ifdef USE_INSTANCE_MATERIALS
+// Draws mix materials, each instance brings its own.
+flat out int v_MaterialIndex;
+
+int getMaterialIndex()
+{
+    return floatBitsToInt(texelFetch(u_Instances, getInstance() * INSTANCE_TEXELS + 9).x);
+}
+#endif
 
 vec4 getPosition()
 {
@@ -286,10 +339,26 @@ vec4 getPosition()
     return pos;
 }
 
+#ifdef HAS_OCTAHEDRAL_NORMALS
+// Unfolds the octahedron back onto the unit sphere, see quantize.c.
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+#endif
+
 #ifdef HAS_NORMALS
 vec3 getNormal()
 {
+#ifdef HAS_OCTAHEDRAL_NORMALS
+    vec3 normal = decodeOctahedral(a_Normal);
+#else
     vec3 normal = a_Normal;
+#endif
 
 #ifdef USE_MORPHING
     normal += getTargetNormal();
@@ -322,18 +391,21 @@ vec3 getTangent()
 
 void main()
 {
-    vec4 pos = u_ModelMatrix * getPosition();
+    mat4 modelMatrix = getModelMatrix();
+    mat3 normalMatrix = getNormalMatrix();
+
+    vec4 pos = modelMatrix * getPosition();
     v_Position = vec3(pos.xyz) / pos.w;
 
     #ifdef HAS_NORMALS
     #ifdef HAS_TANGENTS
         vec3 tangent = getTangent();
-        vec3 normalW = normalize(vec3(u_NormalMatrix * vec4(getNormal(), 0.0)));
-        vec3 tangentW = normalize(vec3(u_ModelMatrix * vec4(tangent, 0.0)));
+        vec3 normalW = normalize(normalMatrix * getNormal());
+        vec3 tangentW = normalize(vec3(modelMatrix * vec4(tangent, 0.0)));
         vec3 bitangentW = cross(normalW, tangentW) * a_Tangent.w;
         v_TBN = mat3(tangentW, bitangentW, normalW);
     #else // !HAS_TANGENTS
-        v_Normal = normalize(vec3(u_NormalMatrix * vec4(getNormal(), 0.0)));
+        v_Normal = normalize(normalMatrix * getNormal());
     #endif
     #endif // !HAS_NORMALS
 
@@ -352,5 +424,9 @@ void main()
         v_Color = a_Color;
     #endif
 
+    #ifdef USE_INSTANCE_MATERIALS
+        v_MaterialIndex = getMaterialIndex();
+    #endif
+
     gl_Position = u_ViewProjectionMatrix * pos;
 }
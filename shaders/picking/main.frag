@@ -0,0 +1,8 @@
+flat in vec4 v_Color;
+
+out vec4 color;
+
+void main()
+{
+    color = v_Color;
+}
@@ -0,0 +1,45 @@
+in vec3 a_Position;
+
+// Per-frame data, see struct shader_frame.
+layout(std140) uniform Frame
+{
+    mat4 u_ViewProjectionMatrix;
+    vec3 u_Camera;
+    float u_Exposure;
+    int u_MipCount;
+};
+
+// Instances of the draw, RENDERQUEUE_INSTANCE_TEXELS texels each. See struct renderqueue_instance.
+const int INSTANCE_TEXELS = 10;
+
+uniform samplerBuffer u_Instances;
+
+#ifdef USE_INDIRECT
+// Instances that survived culling, see indirect.h.
+in uint a_InstanceIndex;
+
+int getInstance()
+{
+    return int(a_InstanceIndex);
+}
+#else
+uniform int u_InstanceOffset;
+
+int getInstance()
+{
+    return u_InstanceOffset + gl_InstanceID;
+}
+#endif
+
+flat out vec4 v_Color;
+
+void main()
+{
+    int texel = getInstance() * INSTANCE_TEXELS;
+    mat4 modelMatrix = mat4(texelFetch(u_Instances, texel), texelFetch(u_Instances, texel + 1), texelFetch(u_Instances, texel + 2), texelFetch(u_Instances, texel + 3));
+
+    // Entities are told apart by the color of their instances.
+    v_Color = texelFetch(u_Instances, texel + 7);
+
+    gl_Position = u_ViewProjectionMatrix * modelMatrix * vec4(a_Position, 1.0);
+}
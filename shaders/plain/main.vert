@@ -229,7 +229,15 @@ vec3 getTargetTangent()
 
 in vec3 a_Position;
 
-uniform mat4 u_ViewProjectionMatrix;
+// Per-frame data, see struct shader_frame.
+layout(std140) uniform Frame
+{
+    mat4 u_ViewProjectionMatrix;
+    vec3 u_Camera;
+    float u_Exposure;
+    int u_MipCount;
+};
+
 uniform mat4 u_ModelMatrix;
 
 vec4 getPosition() {
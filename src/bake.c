@@ -0,0 +1,426 @@
+#include "client.h"
+
+// Layout of a baked file:
+//  - header
+//  - image table (struct bake_image per image)
+//  - primitive table (struct bake_primitive per primitive)
+//  - dependency table (struct bake_dependency per external buffer of the glTF file)
+//  - blobs (pixels, names, vertex streams, indices, dependency paths), each aligned to BAKE_ALIGNMENT
+// The tables reference the blobs by their offset from the start of the file.
+
+#define BAKE_MAGIC 0x4b424d4c // "LMBK"
+#define BAKE_VERSION 4
+#define BAKE_ALIGNMENT 16
+
+struct bake_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t build_key;
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t images_count;
+	uint64_t primitives_count;
+	uint64_t dependencies_count;
+};
+
+struct bake_image {
+	uint64_t hash;
+	int32_t width;
+	int32_t height;
+	int32_t components;
+	int32_t compression;
+	uint64_t levels;
+	uint64_t size;
+	uint64_t pixels_offset; // 0 when the image wasn't decoded.
+};
+
+// The primitive is written as it is in memory, with its pointers cleared and replaced by offsets.
+struct bake_primitive {
+	struct model_import_primitive primitive;
+	uint64_t name_offset;
+	uint64_t streams_offsets[MESH_STREAMS_MAX];
+	uint64_t indices_offset;
+};
+
+// Like the source file, checked by size and modification time.
+struct bake_dependency {
+	uint64_t path_offset; // Relative to the glTF file, NUL terminated.
+	uint64_t size;
+	int64_t mtime;
+};
+
+struct blob {
+	const void *data;
+	size_t size;
+	size_t offset;
+};
+
+// Structures are written as is, a build where they differ (or where the import would produce something else) can't use the file.
+static uint64_t build_key(void) {
+	uint64_t parameters[] = {
+		sizeof (struct model_import_primitive),
+		sizeof (struct model_import_material),
+		sizeof (struct mesh_layout),
+		sizeof (struct shader_options),
+		MODEL_COMPACT_VERTICES,
+		MODEL_OPTIMIZE_GEOMETRY,
+		MODEL_OPTIMIZE_OVERDRAW,
+		MODEL_COMPRESS_TEXTURES,
+		MODEL_MIPMAPS_FILTER,
+	};
+
+	return utils_hash(parameters, sizeof parameters, UTILS_HASH_SEED);
+}
+
+static bool bake_path(char *path, size_t size, const char *filepath) {
+	int length = snprintf(path, size, "%s%s", filepath, BAKE_EXTENSION);
+	return length > 0 && (size_t) length < size;
+}
+
+// Dependencies are relative to the directory of the glTF file, like cgltf resolves them.
+static bool dependency_stat(const char *filepath, const char *dependency, uint64_t *size, int64_t *mtime) {
+	const char *slash = strrchr(filepath, '/');
+	const char *backslash = strrchr(filepath, '\\');
+	if (backslash && (!slash || backslash > slash)) {
+		slash = backslash;
+	}
+
+	int prefix = slash ? (int) (slash - filepath + 1) : 0;
+
+	char path[1024];
+	int length = snprintf(path, sizeof path, "%.*s%s", prefix, filepath, dependency);
+	if (length < 0 || (size_t) length >= sizeof path) {
+		return false;
+	}
+
+	return cache_stat(path, size, mtime);
+}
+
+static size_t align(size_t offset) {
+	return (offset + BAKE_ALIGNMENT - 1) & ~(size_t) (BAKE_ALIGNMENT - 1);
+}
+
+static uint64_t add_blob(struct blob *blobs, size_t *blobs_count, size_t *offset, const void *data, size_t size) {
+	if (!data || size == 0) {
+		return 0;
+	}
+
+	*offset = align(*offset);
+	blobs[(*blobs_count)++] = (struct blob) {data, size, *offset};
+
+	uint64_t blob_offset = *offset;
+	*offset += size;
+	return blob_offset;
+}
+
+static bool write_file(const char *path, const struct bake_header *header, const struct bake_image *images, const struct bake_primitive *primitives, const struct bake_dependency *dependencies, const struct blob *blobs, size_t blobs_count) {
+	// Write to a temporary file first, so that a crash never leaves a truncated file behind.
+	char temporary_path[1024];
+	snprintf(temporary_path, sizeof temporary_path, "%s.tmp", path);
+
+	FILE *file = fopen(temporary_path, "wb");
+	if (!file) {
+		return false;
+	}
+
+	bool ok = fwrite(header, sizeof *header, 1, file) == 1;
+	ok = ok && fwrite(images, sizeof *images, header->images_count, file) == header->images_count;
+	ok = ok && fwrite(primitives, sizeof *primitives, header->primitives_count, file) == header->primitives_count;
+	ok = ok && fwrite(dependencies, sizeof *dependencies, header->dependencies_count, file) == header->dependencies_count;
+
+	size_t offset = sizeof *header + header->images_count * sizeof *images + header->primitives_count * sizeof *primitives + header->dependencies_count * sizeof *dependencies;
+	static const char padding[BAKE_ALIGNMENT];
+
+	for (size_t i = 0; ok && i < blobs_count; i++) {
+		ok = fwrite(padding, 1, blobs[i].offset - offset, file) == blobs[i].offset - offset;
+		ok = ok && fwrite(blobs[i].data, 1, blobs[i].size, file) == blobs[i].size;
+		offset = blobs[i].offset + blobs[i].size;
+	}
+
+	ok &= fclose(file) == 0;
+
+	// Windows refuses to rename over an existing file, the old one only goes once the new one is complete.
+	#ifdef _WIN32
+	if (ok) {
+		remove(path);
+	}
+	#endif
+
+	if (!ok || rename(temporary_path, path) != 0) {
+		remove(temporary_path);
+		return false;
+	}
+
+	return true;
+}
+
+bool bake_write(const char *filepath, const struct model_import *import) {
+	char path[1024];
+	if (!bake_path(path, sizeof path, filepath)) {
+		return false;
+	}
+
+	struct bake_header header = {
+		.magic = BAKE_MAGIC,
+		.version = BAKE_VERSION,
+		.build_key = build_key(),
+		.images_count = import->images_count,
+		.primitives_count = import->primitives_count,
+		.dependencies_count = import->dependencies_count,
+	};
+
+	if (!cache_stat(filepath, &header.source_size, &header.source_mtime)) {
+		return false;
+	}
+
+	struct bake_image *images = calloc(import->images_count, sizeof *images);
+	struct bake_primitive *primitives = calloc(import->primitives_count, sizeof *primitives);
+	struct bake_dependency *dependencies = calloc(import->dependencies_count, sizeof *dependencies);
+	struct blob *blobs = malloc((import->images_count + import->primitives_count * (MESH_STREAMS_MAX + 2) + import->dependencies_count) * sizeof *blobs);
+
+	if ((import->images_count && !images) || (import->primitives_count && !primitives) || (import->dependencies_count && !dependencies) || !blobs) {
+		free(images);
+		free(primitives);
+		free(dependencies);
+		free(blobs);
+		return false;
+	}
+
+	size_t blobs_count = 0;
+	size_t offset = sizeof header + import->images_count * sizeof *images + import->primitives_count * sizeof *primitives + import->dependencies_count * sizeof *dependencies;
+
+	for (size_t i = 0; i < import->images_count; i++) {
+		const struct texture_image *image = &import->images[i];
+
+		images[i] = (struct bake_image) {
+			.hash = import->images_hashes[i],
+			.width = image->width,
+			.height = image->height,
+			.components = image->components,
+			.compression = image->compression,
+			.levels = image->levels,
+			.size = image->size,
+			.pixels_offset = add_blob(blobs, &blobs_count, &offset, image->pixels, image->size),
+		};
+	}
+
+	for (size_t i = 0; i < import->primitives_count; i++) {
+		const struct model_import_primitive *ip = &import->primitives[i];
+		struct bake_primitive *bp = &primitives[i];
+
+		bp->primitive = *ip;
+		bp->primitive.material.name = NULL;
+		bp->primitive.indices = NULL;
+
+		if (ip->material.name) {
+			bp->name_offset = add_blob(blobs, &blobs_count, &offset, ip->material.name, strlen(ip->material.name) + 1);
+		}
+
+		for (size_t j = 0; j < MESH_STREAMS_MAX; j++) {
+			bp->primitive.streams[j] = NULL;
+			bp->streams_offsets[j] = add_blob(blobs, &blobs_count, &offset, ip->streams[j], ip->vertices_count * ip->layout.strides[j]);
+		}
+
+		bp->indices_offset = add_blob(blobs, &blobs_count, &offset, ip->indices, ip->indices_count * sizeof *ip->indices);
+	}
+
+	// A dependency that can't be checked would make the file always out of date.
+	bool ok = true;
+	for (size_t i = 0; ok && i < import->dependencies_count; i++) {
+		const char *dependency = import->dependencies[i];
+		ok = dependency_stat(filepath, dependency, &dependencies[i].size, &dependencies[i].mtime);
+		dependencies[i].path_offset = add_blob(blobs, &blobs_count, &offset, dependency, strlen(dependency) + 1);
+	}
+
+	ok = ok && write_file(path, &header, images, primitives, dependencies, blobs, blobs_count);
+
+	free(images);
+	free(primitives);
+	free(dependencies);
+	free(blobs);
+
+	return ok;
+}
+
+static bool in_bounds(uint64_t offset, uint64_t length, size_t size) {
+	return offset <= size && length <= size - offset;
+}
+
+static const char *map_string(const char *base, size_t size, uint64_t offset) {
+	if (!in_bounds(offset, 1, size) || !memchr(base + offset, '\0', size - offset)) {
+		return NULL;
+	}
+
+	return base + offset;
+}
+
+static bool map_primitive(struct model_import *import, const struct bake_primitive *bp, struct model_import_primitive *ip) {
+	const char *base = import->mapping;
+	size_t size = import->mapping_size;
+
+	*ip = bp->primitive;
+
+	if (ip->layout.streams_count > MESH_STREAMS_MAX) {
+		return false;
+	}
+
+	ip->material.name = NULL;
+	if (bp->name_offset && !(ip->material.name = map_string(base, size, bp->name_offset))) {
+		return false;
+	}
+
+	for (size_t i = 0; i < MESH_STREAMS_MAX; i++) {
+		uint64_t length = (uint64_t) ip->vertices_count * ip->layout.strides[i];
+		if (bp->streams_offsets[i] && !in_bounds(bp->streams_offsets[i], length, size)) {
+			return false;
+		}
+
+		ip->streams[i] = bp->streams_offsets[i] ? base + bp->streams_offsets[i] : NULL;
+	}
+
+	uint64_t length = (uint64_t) ip->indices_count * sizeof *ip->indices;
+	if (bp->indices_offset && !in_bounds(bp->indices_offset, length, size)) {
+		return false;
+	}
+
+	ip->indices = bp->indices_offset ? (const uint32_t *) (base + bp->indices_offset) : NULL;
+
+	return true;
+}
+
+// Nothing is copied out of the mapping but the small tables, vertices, indices and pixels get uploaded straight from it.
+struct model_import *bake_read(const char *filepath) {
+	char path[1024];
+	uint64_t source_size;
+	int64_t source_mtime;
+
+	if (!bake_path(path, sizeof path, filepath) || !cache_stat(filepath, &source_size, &source_mtime)) {
+		return NULL;
+	}
+
+	size_t size = 0;
+	void *mapping = cache_map(path, &size);
+	if (!mapping) {
+		return NULL;
+	}
+
+	struct bake_header header = {0};
+	if (size >= sizeof header) {
+		memcpy(&header, mapping, sizeof header);
+	}
+
+	// Out of date, or from another build.
+	bool valid = header.magic == BAKE_MAGIC
+		&& header.version == BAKE_VERSION
+		&& header.build_key == build_key()
+		&& header.source_size == source_size
+		&& header.source_mtime == source_mtime
+		&& header.images_count <= size / sizeof (struct bake_image)
+		&& header.primitives_count <= size / sizeof (struct bake_primitive)
+		&& header.dependencies_count <= size / sizeof (struct bake_dependency)
+		&& in_bounds(sizeof header, header.images_count * sizeof (struct bake_image) + header.primitives_count * sizeof (struct bake_primitive) + header.dependencies_count * sizeof (struct bake_dependency), size);
+
+	struct model_import *import = valid ? calloc(1, sizeof *import) : NULL;
+	if (!import) {
+		cache_unmap(mapping, size);
+		return NULL;
+	}
+
+	import->mapping = mapping;
+	import->mapping_size = size;
+	import->images = calloc(header.images_count, sizeof *import->images);
+	import->images_hashes = calloc(header.images_count, sizeof *import->images_hashes);
+	import->primitives = calloc(header.primitives_count, sizeof *import->primitives);
+	import->dependencies = calloc(header.dependencies_count, sizeof *import->dependencies);
+
+	if ((header.images_count && (!import->images || !import->images_hashes)) || (header.primitives_count && !import->primitives) || (header.dependencies_count && !import->dependencies)) {
+		model_import_free(import);
+		return NULL;
+	}
+
+	const char *base = mapping;
+	size_t images_offset = sizeof header;
+	size_t primitives_offset = images_offset + header.images_count * sizeof (struct bake_image);
+	size_t dependencies_offset = primitives_offset + header.primitives_count * sizeof (struct bake_primitive);
+
+	// The external buffers have to be the ones the file was baked from too.
+	bool outdated = false;
+	for (size_t i = 0; i < header.dependencies_count; i++) {
+		struct bake_dependency bd;
+		memcpy(&bd, base + dependencies_offset + i * sizeof bd, sizeof bd);
+
+		const char *dependency = map_string(base, size, bd.path_offset);
+		if (!dependency) {
+			valid = false;
+			break;
+		}
+
+		import->dependencies[import->dependencies_count++] = dependency;
+
+		uint64_t dependency_size;
+		int64_t dependency_mtime;
+		if (!dependency_stat(filepath, dependency, &dependency_size, &dependency_mtime) || dependency_size != bd.size || dependency_mtime != bd.mtime) {
+			outdated = true;
+			break;
+		}
+	}
+
+	if (outdated) {
+		model_import_free(import);
+		return NULL;
+	}
+
+	for (size_t i = 0; valid && i < header.images_count; i++) {
+		struct bake_image bi;
+		memcpy(&bi, base + images_offset + i * sizeof bi, sizeof bi);
+
+		struct texture_image *image = &import->images[i];
+		import->images_hashes[i] = bi.hash;
+		import->images_count++;
+
+		if (!bi.pixels_offset) {
+			continue;
+		}
+
+		image->width = bi.width;
+		image->height = bi.height;
+		image->components = bi.components;
+		image->type = TEXTURE_TYPE_UNSIGNED_BYTE;
+		image->compression = bi.compression;
+		image->faces = 1;
+		image->levels = bi.levels;
+		image->size = bi.size;
+
+		if (bi.width <= 0 || bi.height <= 0 || bi.components <= 0 || bi.compression < TEXTURE_COMPRESSION_NONE || bi.compression > TEXTURE_COMPRESSION_BC7
+			|| bi.levels == 0 || bi.levels > texture_levels_count(bi.width, bi.height) || !in_bounds(bi.pixels_offset, bi.size, size)) {
+			valid = false;
+			break;
+		}
+
+		// The levels have to exactly fill the pixels.
+		size_t last_offset;
+		size_t last_size = texture_image_level(image, image->levels - 1, NULL, NULL, &last_offset);
+		if (last_offset + last_size != bi.size) {
+			valid = false;
+			break;
+		}
+
+		image->pixels = (unsigned char *) (base + bi.pixels_offset);
+	}
+
+	for (size_t i = 0; valid && i < header.primitives_count; i++) {
+		struct bake_primitive bp;
+		memcpy(&bp, base + primitives_offset + i * sizeof bp, sizeof bp);
+
+		valid = map_primitive(import, &bp, &import->primitives[i]);
+		import->primitives_count++;
+	}
+
+	if (!valid) {
+		fprintf(stderr, "Ignoring corrupted baked file %s\n", path);
+		model_import_free(import);
+		return NULL;
+	}
+
+	return import;
+}
@@ -0,0 +1,172 @@
+#include "client.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static bool ensure_directory(void) {
+	#ifdef _WIN32
+	int result = _mkdir(CACHE_DIRECTORY);
+	#else
+	int result = mkdir(CACHE_DIRECTORY, 0755);
+	#endif
+
+	return result == 0 || errno == EEXIST;
+}
+
+bool cache_path(char *path, size_t size, const char *category, uint64_t key) {
+	int length = snprintf(path, size, "%s/%s-%016llx.bin", CACHE_DIRECTORY, category, (unsigned long long) key);
+	return length > 0 && (size_t) length < size;
+}
+
+void *cache_read(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	long length = ftell(file);
+	if (length <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	void *data = malloc(length);
+	if (!data) {
+		fclose(file);
+		return NULL;
+	}
+
+	if (fread(data, 1, length, file) != (size_t) length) {
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+
+	*size = length;
+	return data;
+}
+
+bool cache_write(const char *path, const void *data, size_t size) {
+	if (!ensure_directory()) {
+		return false;
+	}
+
+	// Write to a temporary file first, so that a crash never leaves a truncated entry behind.
+	char temporary_path[1024];
+	snprintf(temporary_path, sizeof temporary_path, "%s.tmp", path);
+
+	FILE *file = fopen(temporary_path, "wb");
+	if (!file) {
+		return false;
+	}
+
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok &= fclose(file) == 0;
+
+	// Windows refuses to rename over an existing file, the old one only goes once the new one is complete.
+	#ifdef _WIN32
+	if (ok) {
+		remove(path);
+	}
+	#endif
+
+	if (!ok || rename(temporary_path, path) != 0) {
+		remove(temporary_path);
+		return false;
+	}
+
+	return true;
+}
+
+void cache_remove(const char *path) {
+	remove(path);
+}
+
+// Read-only mapping of a whole file, pages get loaded by the OS as they are touched.
+void *cache_map(const char *path, size_t *size) {
+	#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) {
+		return NULL;
+	}
+
+	// The view keeps the mapping alive.
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!data) {
+		return NULL;
+	}
+
+	*size = length.QuadPart;
+	return data;
+	#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) {
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		close(file);
+		return NULL;
+	}
+
+	// The mapping stays valid after closing the file.
+	void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	*size = info.st_size;
+	return data;
+	#endif
+}
+
+void cache_unmap(void *data, size_t size) {
+	#ifdef _WIN32
+	UNUSED(size);
+	UnmapViewOfFile(data);
+	#else
+	munmap(data, size);
+	#endif
+}
+
+// Size and modification time, to tell when something derived from a file is out of date.
+bool cache_stat(const char *path, uint64_t *size, int64_t *mtime) {
+	struct stat info;
+	if (stat(path, &info) != 0) {
+		return false;
+	}
+
+	*size = info.st_size;
+	*mtime = info.st_mtime;
+	return true;
+}
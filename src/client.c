@@ -3,11 +3,28 @@
 struct client client;
 
 bool setup(void) {
+	// Not fatal, jobs simply run on the main thread without workers.
+	if (!jobs_init()) {
+		fprintf(stderr, "Unable to start worker threads\n");
+	}
+
 	if (!window_init(&client.window, 1280, 720, DEFAULT_TITLE, false)) {
 		fprintf(stderr, "Unable to create the window\n");
 		return false;
 	}
 
+	// Not fatal either, uploads then come straight from client memory.
+	if (!staging_init()) {
+		fprintf(stderr, "Staging uploads unavailable\n");
+	}
+
+	materialmanager_init();
+
+	// Not fatal either, entities are then drawn instanced from the CPU.
+	if (!indirect_init()) {
+		fprintf(stderr, "GPU-driven drawing unavailable\n");
+	}
+
 	renderer_init(&client.renderer);
 	camera_init(&client.camera);
 	scene_init(&client.scene);
@@ -30,10 +47,16 @@ bool setup(void) {
 void cleanup(void) {
 	environment_fini(client.scene.environment);
 
+	modelmanager_fini();
+	materialmanager_fini();
 	ui_fini(&client.ui);
 	scene_fini(&client.scene);
-	window_fini(&client.window);
 	renderer_fini(&client.renderer);
+	indirect_fini();
+	geometry_fini();
+	staging_fini();
+	window_fini(&client.window);
+	jobs_fini();
 }
 
 void main_loop(void) {
@@ -63,8 +86,18 @@ void main_loop(void) {
 			camera_center_move_relative(&client.camera, 0, elapsed * movement_speed);
 		}
 
+		// Models loading in the background get uploaded a little bit every frame.
+		modelmanager_update(MODELMANAGER_UPLOAD_BUDGET);
+
 		renderer_render(&client.renderer, &client.camera, &client.scene);
 		ui_render(&client.ui);
+
+		// Texture levels asked for while rendering get streamed in.
+		texturemanager_update(TEXTUREMANAGER_UPLOAD_BUDGET);
+
+		// All of the frame's uploads have been issued by now.
+		staging_flush();
+
 		window_refresh(&client.window);
 	}
 }
@@ -0,0 +1,235 @@
+#include "client.h"
+#include <limits.h>
+
+static void fetch_block(const unsigned char *pixels, int width, int height, int components, int bx, int by, unsigned char block[16][4]) {
+	for (int y = 0; y < COMPRESS_BLOCK_TEXELS; y++) {
+		int sy = by + y < height ? by + y : height - 1;
+
+		for (int x = 0; x < COMPRESS_BLOCK_TEXELS; x++) {
+			int sx = bx + x < width ? bx + x : width - 1;
+			const unsigned char *texel = pixels + ((size_t) sy * width + sx) * components;
+			unsigned char *destination = block[y * COMPRESS_BLOCK_TEXELS + x];
+
+			destination[0] = texel[0];
+			destination[1] = components > 1 ? texel[1] : texel[0];
+			destination[2] = components > 2 ? texel[2] : texel[0];
+			destination[3] = components > 3 ? texel[3] : 255;
+		}
+	}
+}
+
+static uint16_t to_565(const float color[3]) {
+	int r = (int) (color[0] * 31 / 255 + 0.5f);
+	int g = (int) (color[1] * 63 / 255 + 0.5f);
+	int b = (int) (color[2] * 31 / 255 + 0.5f);
+
+	return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void from_565(uint16_t color, int rgb[3]) {
+	int r = (color >> 11) & 31;
+	int g = (color >> 5) & 63;
+	int b = color & 31;
+
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void put_u16(unsigned char *output, uint16_t value) {
+	output[0] = value & 0xff;
+	output[1] = value >> 8;
+}
+
+static void encode_color_block(unsigned char block[16][4], unsigned char *output) {
+	// Principal axis of the colors, through a few power iterations over their covariance.
+	float mean[3] = {0};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			mean[c] += block[i][c] / 16.0f;
+		}
+	}
+
+	float covariance[6] = {0};
+	for (int i = 0; i < 16; i++) {
+		float r = block[i][0] - mean[0];
+		float g = block[i][1] - mean[1];
+		float b = block[i][2] - mean[2];
+
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+
+	float axis[3] = {1, 1, 1};
+	for (int iteration = 0; iteration < 4; iteration++) {
+		float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+		float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+		float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+
+		float length = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+		if (length < 1e-6f) {
+			break;
+		}
+
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	// Extreme colors along the axis become the endpoints.
+	float min_projection = FLT_MAX;
+	float max_projection = -FLT_MAX;
+	int min_index = 0;
+	int max_index = 0;
+
+	for (int i = 0; i < 16; i++) {
+		float projection = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+
+		if (projection < min_projection) {
+			min_projection = projection;
+			min_index = i;
+		}
+
+		if (projection > max_projection) {
+			max_projection = projection;
+			max_index = i;
+		}
+	}
+
+	float endpoints[2][3];
+	for (int c = 0; c < 3; c++) {
+		// Inset the endpoints slightly, the extremes are rarely worth representing exactly.
+		float inset = (block[max_index][c] - block[min_index][c]) / 16.0f;
+		endpoints[0][c] = block[max_index][c] - inset;
+		endpoints[1][c] = block[min_index][c] + inset;
+	}
+
+	uint16_t color0 = to_565(endpoints[0]);
+	uint16_t color1 = to_565(endpoints[1]);
+
+	// The first color has to be the larger one for the 4 colors mode.
+	if (color0 < color1) {
+		uint16_t swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+
+	put_u16(output, color0);
+	put_u16(output + 2, color1);
+
+	uint32_t indices = 0;
+
+	if (color0 != color1) {
+		// Palette as the GPU decodes it.
+		int palette[4][3];
+		from_565(color0, palette[0]);
+		from_565(color1, palette[1]);
+
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int best_distance = INT_MAX;
+
+			for (int p = 0; p < 4; p++) {
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+
+				if (distance < best_distance) {
+					best_distance = distance;
+					best = p;
+				}
+			}
+
+			indices |= (uint32_t) best << (2 * i);
+		}
+	}
+
+	output[4] = indices & 0xff;
+	output[5] = (indices >> 8) & 0xff;
+	output[6] = (indices >> 16) & 0xff;
+	output[7] = indices >> 24;
+}
+
+// Single channel block (BC4), 8 interpolated values between the extremes.
+static void encode_channel_block(unsigned char block[16][4], int channel, unsigned char *output) {
+	int min = 255;
+	int max = 0;
+
+	for (int i = 0; i < 16; i++) {
+		min = block[i][channel] < min ? block[i][channel] : min;
+		max = block[i][channel] > max ? block[i][channel] : max;
+	}
+
+	output[0] = max;
+	output[1] = min;
+
+	uint64_t indices = 0;
+
+	if (max > min) {
+		int range = max - min;
+
+		for (int i = 0; i < 16; i++) {
+			// 0 is the maximum, 7 the minimum, stored as 0, 2..7, 1 (the GPU order).
+			int step = ((max - block[i][channel]) * 7 + range / 2) / range;
+			int index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+
+			indices |= (uint64_t) index << (3 * i);
+		}
+	}
+
+	for (int i = 0; i < 6; i++) {
+		output[2 + i] = (indices >> (8 * i)) & 0xff;
+	}
+}
+
+size_t compress_blocks_count(int width, int height) {
+	return (size_t) ((width + COMPRESS_BLOCK_TEXELS - 1) / COMPRESS_BLOCK_TEXELS) * ((height + COMPRESS_BLOCK_TEXELS - 1) / COMPRESS_BLOCK_TEXELS);
+}
+
+void compress_bc1(const unsigned char *pixels, int width, int height, int components, unsigned char *output) {
+	unsigned char block[16][4];
+
+	for (int y = 0; y < height; y += COMPRESS_BLOCK_TEXELS) {
+		for (int x = 0; x < width; x += COMPRESS_BLOCK_TEXELS) {
+			fetch_block(pixels, width, height, components, x, y, block);
+			encode_color_block(block, output);
+			output += 8;
+		}
+	}
+}
+
+void compress_bc3(const unsigned char *pixels, int width, int height, int components, unsigned char *output) {
+	unsigned char block[16][4];
+
+	for (int y = 0; y < height; y += COMPRESS_BLOCK_TEXELS) {
+		for (int x = 0; x < width; x += COMPRESS_BLOCK_TEXELS) {
+			fetch_block(pixels, width, height, components, x, y, block);
+			encode_channel_block(block, 3, output);
+			encode_color_block(block, output + 8);
+			output += 16;
+		}
+	}
+}
+
+void compress_bc5(const unsigned char *pixels, int width, int height, int components, unsigned char *output) {
+	unsigned char block[16][4];
+
+	for (int y = 0; y < height; y += COMPRESS_BLOCK_TEXELS) {
+		for (int x = 0; x < width; x += COMPRESS_BLOCK_TEXELS) {
+			fetch_block(pixels, width, height, components, x, y, block);
+			encode_channel_block(block, 0, output);
+			encode_channel_block(block, 1, output + 8);
+			output += 16;
+		}
+	}
+}
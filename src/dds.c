@@ -0,0 +1,176 @@
+#include "client.h"
+#include <limits.h>
+
+// Offsets in the file, past the "DDS " magic the header is a DDS_HEADER, optionally followed by a DDS_HEADER_DXT10.
+#define DDS_HEIGHT 12
+#define DDS_WIDTH 16
+#define DDS_LEVELS 28
+#define DDS_FORMAT_FLAGS 80
+#define DDS_FOURCC 84
+#define DDS_BITS 88
+#define DDS_MASKS 92
+#define DDS_CAPS2 112
+#define DDS_DATA 128
+#define DDS_DXGI_FORMAT 128
+#define DDS_DXGI_MISC 136
+#define DDS_DXGI_ARRAY 140
+#define DDS_DXGI_DATA 148
+
+#define DDS_FLAG_FOURCC 0x4
+#define DDS_FLAG_RGB 0x40
+#define DDS_CAPS2_CUBEMAP_ALL 0xfe00 // The cubemap bit and all 6 faces.
+#define DDS_MISC_CUBEMAP 0x4
+
+static uint32_t read_u32(const unsigned char *data) {
+	uint32_t value;
+	memcpy(&value, data, sizeof value);
+	return value;
+}
+
+static uint32_t fourcc(const char code[4]) {
+	return (uint32_t) code[0] | (uint32_t) code[1] << 8 | (uint32_t) code[2] << 16 | (uint32_t) code[3] << 24;
+}
+
+// DXGI formats we can map to ours, sRGB variants included (shaders do the sRGB conversion themselves).
+static bool translate_dxgi(uint32_t format, struct texture_image *image) {
+	switch (format) {
+	    case 2: image->type = TEXTURE_TYPE_FLOAT; image->components = 4; return true; // R32G32B32A32_FLOAT
+	    case 6: image->type = TEXTURE_TYPE_FLOAT; image->components = 3; return true; // R32G32B32_FLOAT
+	    case 10: image->type = TEXTURE_TYPE_HALF_FLOAT; image->components = 4; return true; // R16G16B16A16_FLOAT
+	    case 28: case 29: image->components = 4; return true; // R8G8B8A8_UNORM
+	    case 71: case 72: image->compression = TEXTURE_COMPRESSION_BC1; image->components = 3; return true;
+	    case 77: case 78: image->compression = TEXTURE_COMPRESSION_BC3; image->components = 4; return true;
+	    case 83: image->compression = TEXTURE_COMPRESSION_BC5; image->components = 2; return true;
+	    case 98: case 99: image->compression = TEXTURE_COMPRESSION_BC7; image->components = 4; return true;
+	    default: return false;
+	}
+}
+
+// Formats of files without the DX10 header, either a FourCC (D3DFMT values for the float ones) or RGBA masks.
+static bool translate_legacy(const unsigned char *data, struct texture_image *image) {
+	uint32_t flags = read_u32(data + DDS_FORMAT_FLAGS);
+	uint32_t code = read_u32(data + DDS_FOURCC);
+
+	if (flags & DDS_FLAG_FOURCC) {
+		if (code == fourcc("DXT1")) {
+			image->compression = TEXTURE_COMPRESSION_BC1;
+			image->components = 3;
+		} else if (code == fourcc("DXT5")) {
+			image->compression = TEXTURE_COMPRESSION_BC3;
+			image->components = 4;
+		} else if (code == fourcc("ATI2") || code == fourcc("BC5U")) {
+			image->compression = TEXTURE_COMPRESSION_BC5;
+			image->components = 2;
+		} else if (code == 113) {
+			image->type = TEXTURE_TYPE_HALF_FLOAT;
+			image->components = 4;
+		} else if (code == 116) {
+			image->type = TEXTURE_TYPE_FLOAT;
+			image->components = 4;
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	uint32_t masks[4];
+	for (int i = 0; i < 4; i++) {
+		masks[i] = read_u32(data + DDS_MASKS + i * 4);
+	}
+
+	bool rgba = (flags & DDS_FLAG_RGB) && read_u32(data + DDS_BITS) == 32
+		&& masks[0] == 0xff && masks[1] == 0xff00 && masks[2] == 0xff0000 && masks[3] == 0xff000000;
+	image->components = 4;
+
+	return rgba;
+}
+
+bool dds_detect(const unsigned char *data, size_t size) {
+	return size >= DDS_DATA && memcmp(data, "DDS ", 4) == 0;
+}
+
+bool dds_decode(struct texture_image *image, const unsigned char *data, size_t size) {
+	if (!dds_detect(data, size)) {
+		return false;
+	}
+
+	uint32_t width = read_u32(data + DDS_WIDTH);
+	uint32_t height = read_u32(data + DDS_HEIGHT);
+	uint32_t levels = read_u32(data + DDS_LEVELS);
+	bool dx10 = (read_u32(data + DDS_FORMAT_FLAGS) & DDS_FLAG_FOURCC) && read_u32(data + DDS_FOURCC) == fourcc("DX10");
+
+	image->type = TEXTURE_TYPE_UNSIGNED_BYTE;
+	image->compression = TEXTURE_COMPRESSION_NONE;
+	image->faces = 1;
+
+	size_t first = DDS_DATA;
+	bool known;
+
+	if (dx10) {
+		if (size < DDS_DXGI_DATA || read_u32(data + DDS_DXGI_ARRAY) > 1) {
+			fprintf(stderr, "DDS texture arrays are not supported\n");
+			return false;
+		}
+
+		known = translate_dxgi(read_u32(data + DDS_DXGI_FORMAT), image);
+		image->faces = read_u32(data + DDS_DXGI_MISC) & DDS_MISC_CUBEMAP ? 6 : 1;
+		first = DDS_DXGI_DATA;
+	} else {
+		known = translate_legacy(data, image);
+
+		// Cubemaps can list only some of their faces, we need them all.
+		uint32_t caps2 = read_u32(data + DDS_CAPS2);
+		if (caps2 & DDS_CAPS2_CUBEMAP_ALL) {
+			if ((caps2 & DDS_CAPS2_CUBEMAP_ALL) != DDS_CAPS2_CUBEMAP_ALL) {
+				fprintf(stderr, "Incomplete DDS cubemaps are not supported\n");
+				return false;
+			}
+
+			image->faces = 6;
+		}
+	}
+
+	if (!known) {
+		fprintf(stderr, "Unsupported DDS format\n");
+		return false;
+	}
+
+	if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || (image->faces == 6 && width != height)) {
+		return false;
+	}
+
+	image->width = width;
+	image->height = height;
+	image->levels = levels ? levels : 1;
+	if (image->levels > texture_levels_count(width, height)) {
+		return false;
+	}
+
+	size_t last_offset;
+	size_t last_size = texture_image_level(image, image->levels - 1, NULL, NULL, &last_offset);
+	image->size = last_offset + last_size * image->faces;
+
+	if (image->size > size - first) {
+		return false;
+	}
+
+	image->pixels = malloc(image->size);
+	if (!image->pixels) {
+		return false;
+	}
+
+	// The file has each face with all its levels, we have each level with all its faces.
+	const unsigned char *source = data + first;
+	for (size_t face = 0; face < image->faces; face++) {
+		for (size_t level = 0; level < image->levels; level++) {
+			size_t offset;
+			size_t length = texture_image_level(image, level, NULL, NULL, &offset);
+
+			memcpy(image->pixels + offset + face * length, source, length);
+			source += length;
+		}
+	}
+
+	return true;
+}
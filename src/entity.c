@@ -9,7 +9,8 @@ bool entity_init(struct entity *entity, const char *model_filepath) {
 	entity->scale = 1;
 	entity->id = next_entity_id++;
 
-	entity->model = modelmanager_load_model(model_filepath);
+	// The model loads in the background, the entity isn't rendered until it's ready.
+	entity->model = modelmanager_load_model_async(model_filepath);
 	if (!entity->model) {
 		return false;
 	}
@@ -5,6 +5,24 @@ INCBIN(shaders_equirect2cube_main_vert, "../shaders/equirect2cube/main.vert");
 INCBIN(shaders_equirect2cube_main_frag, "../shaders/equirect2cube/main.frag");
 INCBIN(shaders_iblsampler_main_vert, "../shaders/iblsampler/main.vert");
 INCBIN(shaders_iblsampler_main_frag, "../shaders/iblsampler/main.frag");
+INCBIN(shaders_iblsampler_main_comp, "../shaders/iblsampler/main.comp");
+INCBIN(shaders_iblsampler_filter_glsl, "../shaders/iblsampler/filter.glsl");
+
+// Core 4.1 headers don't know about compute shaders and image stores, they get loaded by hand.
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+
+#ifndef GL_TEXTURE_UPDATE_BARRIER_BIT
+#define GL_TEXTURE_UPDATE_BARRIER_BIT 0x00000100
+#endif
+
+typedef void (APIENTRYP dispatch_compute_function)(GLuint groups_x, GLuint groups_y, GLuint groups_z);
+typedef void (APIENTRYP bind_image_texture_function)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP memory_barrier_function)(GLbitfield barriers);
+
+// Work group size of main.comp.
+#define ENVIRONMENT_GROUP_SIZE 8
 
 static bool convert_equirectangular_to_cubemap(const struct texture *equirectangular, struct texture *cubemap) {
 	// Load & convert equirectangular environment map to a cubemap texture.
@@ -20,7 +38,7 @@ static bool convert_equirectangular_to_cubemap(const struct texture *equirectang
 
 	glUseProgram(equirect2cube_shader->program_id);
 
-	int width = 2048, height = 2048;
+	int width = ENVIRONMENT_CUBEMAP_SIZE, height = ENVIRONMENT_CUBEMAP_SIZE;
 
 	struct framebuffer fb;
 
@@ -79,6 +97,9 @@ static bool convert_equirectangular_to_cubemap(const struct texture *equirectang
 	cubemap->kind = TEXTURE_KIND_CUBEMAP;
 	cubemap->gl_target = GL_TEXTURE_CUBE_MAP;
 	cubemap->width = width;
+	cubemap->height = height;
+	cubemap->levels = 1;
+	cubemap->base_level = 0;
 
 	// Cleanup.
 	framebuffer_fini(&fb);
@@ -86,120 +107,358 @@ static bool convert_equirectangular_to_cubemap(const struct texture *equirectang
 	return true;
 }
 
-bool environment_init_from_file(struct environment *environment, const char *filepath) {
-	struct texture equirectangular;
-	if (!texture_init_from_file(&equirectangular, TEXTURE_KIND_EQUIRECTANGULAR, filepath)) {
+// The BRDF lookup tables don't depend on the environment, all of them share the same ones.
+static struct {
+	struct texture ggx;
+	struct texture charlie;
+	size_t users;
+} luts;
+
+// Cubemap containers (KTX2 or DDS), anything else is left for the equirectangular path.
+static bool read_cubemap(const char *filepath, struct texture_image *image, uint64_t *hash) {
+	size_t size;
+	unsigned char *data = cache_map(filepath, &size);
+	if (!data) {
 		return false;
 	}
 
-	if (!convert_equirectangular_to_cubemap(&equirectangular, &environment->cubemap)) {
-		texture_fini(&equirectangular);
+	bool ok = false;
+
+	if ((ktx_detect(data, size) || dds_detect(data, size)) && texture_image_decode(image, data, size)) {
+		ok = image->faces == 6;
+		if (!ok) {
+			texture_image_fini(image);
+		}
+	}
+
+	if (ok) {
+		*hash = utils_hash(data, size, UTILS_HASH_SEED);
+	}
+
+	cache_unmap(data, size);
+
+	return ok;
+}
+
+// The file itself when it is a cubemap, or one baked next to it (pisa.ktx2 or pisa.dds for pisa.hdr).
+static bool find_cubemap(const char *filepath, struct texture_image *image, uint64_t *hash) {
+	if (read_cubemap(filepath, image, hash)) {
+		return true;
+	}
+
+	const char *extension = strrchr(filepath, '.');
+	int stem = extension && !strchr(extension, '/') ? (int) (extension - filepath) : (int) strlen(filepath);
+
+	static const char *const extensions[] = {".ktx2", ".dds"};
+	for (size_t i = 0; i < ARRAY_COUNT(extensions); i++) {
+		char path[1024];
+		int length = snprintf(path, sizeof path, "%.*s%s", stem, filepath, extensions[i]);
+
+		if (length > 0 && (size_t) length < sizeof path && read_cubemap(path, image, hash)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Equirectangular environments, flipped like texture_init_from_file() does.
+static bool read_equirectangular(const char *filepath, struct texture_image *image, uint64_t *hash) {
+	size_t size;
+	unsigned char *data = cache_map(filepath, &size);
+	if (!data) {
 		return false;
 	}
 
-	texture_fini(&equirectangular);
+	bool ok;
+
+	// Radiance files decode straight to half floats, anything else goes through stbi as full floats.
+	if (hdr_detect(data, size)) {
+		ok = hdr_decode(image, data, size, true);
+	} else {
+		stbi_set_flip_vertically_on_load_thread(true);
+
+		int width, height, components;
+		float *pixels = stbi_loadf_from_memory(data, size, &width, &height, &components, 3);
+
+		stbi_set_flip_vertically_on_load_thread(false);
+
+		ok = pixels != NULL;
+		if (ok) {
+			*image = (struct texture_image) {
+				.width = width,
+				.height = height,
+				.components = 3,
+				.type = TEXTURE_TYPE_FLOAT,
+				.compression = TEXTURE_COMPRESSION_NONE,
+				.faces = 1,
+				.levels = 1,
+				.size = (size_t) width * height * 3 * sizeof (float),
+				.pixels = (unsigned char *) pixels,
+			};
+		}
+	}
 
-	struct shader *iblsampler_shader = shader_load_from_memory(NULL,
-			shaders_iblsampler_main_vert_data, shaders_iblsampler_main_vert_size,
-			shaders_iblsampler_main_frag_data, shaders_iblsampler_main_frag_size,
-			NULL, 0
-	        );
+	if (ok) {
+		*hash = utils_hash(data, size, UTILS_HASH_SEED);
+	}
 
-	if (!iblsampler_shader) {
+	cache_unmap(data, size);
+
+	return ok;
+}
+
+bool environment_source_read(const char *filepath, struct texture_image *image, uint64_t *hash) {
+	return find_cubemap(filepath, image, hash) || read_equirectangular(filepath, image, hash);
+}
+
+// Everything the sampler output depends on besides the environment itself.
+// Both sampler paths give the same results, they share one key.
+uint64_t environment_cache_key(uint64_t key) {
+	uint64_t parameters[] = {
+		ENVIRONMENT_CACHE_VERSION,
+		ENVIRONMENT_MIP_COUNT,
+		ENVIRONMENT_SAMPLE_COUNT,
+		ENVIRONMENT_SIZE,
+		ENVIRONMENT_CUBEMAP_SIZE,
+		IBL_SAMPLES_MIN,
+	};
+
+	key = utils_hash(parameters, sizeof parameters, key);
+	key = utils_hash(shaders_iblsampler_main_frag_data, shaders_iblsampler_main_frag_size, key);
+	key = utils_hash(shaders_iblsampler_main_comp_data, shaders_iblsampler_main_comp_size, key);
+	return utils_hash(shaders_iblsampler_filter_glsl_data, shaders_iblsampler_filter_glsl_size, key);
+}
+
+// Layout of the prefiltered cubemaps or of the lookup tables.
+struct texture_image environment_cache_layout(bool cubemap) {
+	struct texture_image layout = {
+		.width = ENVIRONMENT_SIZE,
+		.height = ENVIRONMENT_SIZE,
+		.components = 3,
+		.type = TEXTURE_TYPE_HALF_FLOAT,
+		.compression = TEXTURE_COMPRESSION_NONE,
+		.faces = cubemap ? 6 : 1,
+		.levels = cubemap ? ENVIRONMENT_MIP_COUNT : 1,
+	};
+
+	size_t offset;
+	layout.size = texture_image_level(&layout, layout.levels - 1, NULL, NULL, &offset) * layout.faces + offset;
+
+	return layout;
+}
+
+static bool load_cached(const char *category, uint64_t key, struct texture *textures[], const enum texture_kind kinds[], size_t count, bool cubemap) {
+	char path[256];
+	if (!cache_path(path, sizeof path, category, key)) {
 		return false;
 	}
 
-	environment->mip_count = 10;
-	int sample_count = 1024;
-	size_t width = 1024, height = 1024;
+	size_t size;
+	unsigned char *data = cache_map(path, &size);
+	if (!data) {
+		return false;
+	}
 
-	glUseProgram(iblsampler_shader->program_id);
+	struct texture_image layout = environment_cache_layout(cubemap);
+	struct environment_cache_header header = {0};
+	if (size >= sizeof header) {
+		memcpy(&header, data, sizeof header);
+	}
 
-	GLint pfp_roughness_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_roughness");
-	GLint pfp_samplecount_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_sampleCount");
-	GLint pfp_miplevel_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_currentMipLevel");
-	GLint pfp_width_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_width");
-	GLint pfp_lodbias_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_lodBias");
-	GLint pfp_distribution_location = glGetUniformLocation(iblsampler_shader->program_id, "pfp_distribution");
+	bool valid = size >= sizeof header
+		&& header.magic == ENVIRONMENT_CACHE_MAGIC
+		&& header.version == ENVIRONMENT_CACHE_VERSION
+		&& header.key == key
+		&& header.length == size - sizeof header
+		&& header.length == layout.size * count;
 
-	struct framebuffer fb;
-	framebuffer_init(&fb, width, height);
+	size_t loaded = 0;
+	for (; valid && loaded < count; loaded++) {
+		struct texture_image image = layout;
+		image.pixels = data + sizeof header + loaded * layout.size;
 
-	// FIXME: The code below does a lot of OpenGL things without using our nice abstractions.
+		if (!texture_init_streaming(textures[loaded], kinds[loaded], &image, 0)) {
+			break;
+		}
+	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
-	glViewport(0, 0, width, height);
+	cache_unmap(data, size);
 
-	// Lambertian
-	GLuint lambertian_id;
-	glGenTextures(1, &lambertian_id);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, lambertian_id);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, environment->mip_count - 1);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	for (size_t mip = 0; mip < environment->mip_count; mip++) {
-		for (size_t face = 0; face < 6; face++) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA16F, width >> mip, height >> mip, 0, GL_RGBA, GL_FLOAT, NULL);
+	if (loaded < count) {
+		for (size_t i = 0; i < loaded; i++) {
+			texture_fini(textures[i]);
+		}
+
+		if (!valid) {
+			cache_remove(path);
 		}
+
+		return false;
 	}
 
-	// GGX
-	GLuint ggx_id;
-	glGenTextures(1, &ggx_id);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, ggx_id);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, environment->mip_count - 1);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	for (size_t mip = 0; mip < environment->mip_count; mip++) {
-		for (size_t face = 0; face < 6; face++) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA16F, width >> mip, height >> mip, 0, GL_RGBA, GL_FLOAT, NULL);
+	return true;
+}
+
+static void save_cached(const char *category, uint64_t key, struct texture *const textures[], size_t count, bool cubemap) {
+	struct texture_image layout = environment_cache_layout(cubemap);
+	struct environment_cache_header header = {
+		.magic = ENVIRONMENT_CACHE_MAGIC,
+		.version = ENVIRONMENT_CACHE_VERSION,
+		.key = key,
+		.length = layout.size * count,
+	};
+
+	unsigned char *data = malloc(sizeof header + header.length);
+	if (!data) {
+		return;
+	}
+
+	memcpy(data, &header, sizeof header);
+
+	// Reading back waits for the rendering to be done, that only happens the first time.
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for (size_t i = 0; i < count; i++) {
+		texture_switch(textures[i]);
+
+		for (size_t level = 0; level < layout.levels; level++) {
+			size_t offset;
+			size_t size = texture_image_level(&layout, level, NULL, NULL, &offset);
+
+			for (size_t face = 0; face < layout.faces; face++) {
+				GLenum target = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+				unsigned char *pixels = data + sizeof header + i * layout.size + offset + face * size;
+				glGetTexImage(target, level, GL_RGB, GL_HALF_FLOAT, pixels);
+			}
 		}
 	}
 
-	GLuint ggx_lut_id;
-	glGenTextures(1, &ggx_lut_id);
-	glBindTexture(GL_TEXTURE_2D, ggx_lut_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	char path[256];
+	if (cache_path(path, sizeof path, category, key)) {
+		cache_write(path, data, sizeof header + header.length);
+	}
+
+	free(data);
+}
+
+// FIXME: These are bypassing texture_init and I don't like it.
+static void adopt(struct texture *texture, GLuint id, enum texture_kind kind, GLenum target) {
+	texture->gl_id = id;
+	texture->kind = kind;
+	texture->gl_unit = kind;
+	texture->gl_target = target;
+}
+
+// Filtered importance sampling reads the source level matching the solid angle of each sample, so it needs a full chain.
+static void prepare_source(struct texture *cubemap) {
+	texture_switch(cubemap);
+
+	GLint compressed = GL_FALSE;
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, cubemap->base_level, GL_TEXTURE_COMPRESSED, &compressed);
 
-	// Charlie
-	GLuint charlie_id;
-	glGenTextures(1, &charlie_id);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, charlie_id);
+	// Converted and single level cubemaps get theirs made, compressed ones can't (lookups then clamp to the only level).
+	if (cubemap->levels == 1 && !compressed) {
+		cubemap->levels = texture_levels_count(cubemap->width, cubemap->width);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, cubemap->levels - 1);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	}
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, cubemap->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// Both sampler paths write into these, RGBA because image stores can't do RGB.
+static GLuint create_prefiltered(size_t size, size_t levels) {
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, id);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, environment->mip_count - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	for (size_t mip = 0; mip < environment->mip_count; mip++) {
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	for (size_t mip = 0; mip < levels; mip++) {
 		for (size_t face = 0; face < 6; face++) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA16F, width >> mip, height >> mip, 0, GL_RGBA, GL_FLOAT, NULL);
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGBA16F, size >> mip, size >> mip, 0, GL_RGBA, GL_FLOAT, NULL);
 		}
 	}
 
-	GLuint charlie_lut_id;
-	glGenTextures(1, &charlie_lut_id);
-	glBindTexture(GL_TEXTURE_2D, charlie_lut_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+	return id;
+}
+
+static GLuint create_lut(size_t size) {
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	texture_switch(&environment->cubemap);
-	GLint cubemap_location = glGetUniformLocation(iblsampler_shader->program_id, "uCubeMap");
-	glUniform1i(cubemap_location, environment->cubemap.gl_unit);
+	return id;
+}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// The sampler stages only have their main(), filter.glsl gets appended to them.
+static struct shader *load_sampler(bool compute) {
+	struct tk_buffer source;
+	tk_buffer_init(&source);
+
+	const unsigned char *main_data = compute ? shaders_iblsampler_main_comp_data : shaders_iblsampler_main_frag_data;
+	size_t main_size = compute ? shaders_iblsampler_main_comp_size : shaders_iblsampler_main_frag_size;
+
+	struct shader *shader = NULL;
+
+	if (tk_buffer_append(&source, main_data, main_size) && tk_buffer_append(&source, shaders_iblsampler_filter_glsl_data, shaders_iblsampler_filter_glsl_size)) {
+		const unsigned char *data = (const unsigned char *) source.data;
+
+		if (compute) {
+			shader = shader_load_from_memory(NULL, NULL, 0, NULL, 0, data, source.used);
+		} else {
+			shader = shader_load_from_memory(NULL, shaders_iblsampler_main_vert_data, shaders_iblsampler_main_vert_size, data, source.used, NULL, 0);
+		}
+	}
 
-	glUniform1ui(pfp_samplecount_location, sample_count);
-	glUniform1ui(pfp_width_location, width);
-	// glUniform1ui(pfp_width_location, environment->cubemap->width); // FIXME: The cubemap width or current mip?
-	glUniform1f(pfp_lodbias_location, 0);
+	tk_buffer_fini(&source);
+
+	return shader;
+}
+
+// Uniforms of filter.glsl that stay the same for all passes.
+static void bind_filter_source(GLuint program, const struct texture *source) {
+	texture_switch(source);
+	glUniform1i(glGetUniformLocation(program, "uCubeMap"), source->gl_unit);
+	glUniform1ui(glGetUniformLocation(program, "pfp_width"), source->width);
+	glUniform1ui(glGetUniformLocation(program, "pfp_lutSampleCount"), ENVIRONMENT_SAMPLE_COUNT);
+	glUniform1f(glGetUniformLocation(program, "pfp_lodBias"), 0);
+}
+
+// Sharp GGX lobes read from fine source levels and need few samples to converge, see ibl_sample_count().
+static void bind_filter_pass(GLuint program, enum ibl_distribution distribution, float roughness) {
+	glUniform1ui(glGetUniformLocation(program, "pfp_distribution"), distribution);
+	glUniform1f(glGetUniformLocation(program, "pfp_roughness"), roughness);
+	glUniform1ui(glGetUniformLocation(program, "pfp_sampleCount"), ibl_sample_count(distribution, roughness, ENVIRONMENT_SAMPLE_COUNT));
+}
+
+// One draw per mip level and distribution, writing all six faces (and the lookup table on the first level) at once.
+static bool prefilter_fragment(const struct environment *environment, const GLuint outputs[], const GLuint lut_outputs[]) {
+	struct shader *iblsampler_shader = load_sampler(false);
+	if (!iblsampler_shader) {
+		return false;
+	}
+
+	GLuint program = iblsampler_shader->program_id;
+	glUseProgram(program);
+
+	bind_filter_source(program, &environment->cubemap);
+
+	struct framebuffer fb;
+	framebuffer_init(&fb, ENVIRONMENT_SIZE, ENVIRONMENT_SIZE);
+
+	// FIXME: The code below does a lot of OpenGL things without using our nice abstractions.
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
 
 	const GLenum buffers[] = {
 		GL_COLOR_ATTACHMENT0,
@@ -213,101 +472,301 @@ bool environment_init_from_file(struct environment *environment, const char *fil
 
 	glDrawBuffers(7, buffers);
 
-	glBindFragDataLocation(iblsampler_shader->program_id, 0, "outFace0");
-	glBindFragDataLocation(iblsampler_shader->program_id, 1, "outFace1");
-	glBindFragDataLocation(iblsampler_shader->program_id, 2, "outFace2");
-	glBindFragDataLocation(iblsampler_shader->program_id, 3, "outFace3");
-	glBindFragDataLocation(iblsampler_shader->program_id, 4, "outFace4");
-	glBindFragDataLocation(iblsampler_shader->program_id, 5, "outFace5");
-	glBindFragDataLocation(iblsampler_shader->program_id, 6, "outLUT");
+	glBindFragDataLocation(program, 0, "outFace0");
+	glBindFragDataLocation(program, 1, "outFace1");
+	glBindFragDataLocation(program, 2, "outFace2");
+	glBindFragDataLocation(program, 3, "outFace3");
+	glBindFragDataLocation(program, 4, "outFace4");
+	glBindFragDataLocation(program, 5, "outFace5");
+	glBindFragDataLocation(program, 6, "outLUT");
 
 	GLuint VAO;
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
-	// glDisable(GL_CULL_FACE);
 
 	for (int mip = environment->mip_count - 1; mip != -1; mip--) {
-		glUniform1f(pfp_roughness_location, (float) mip / (float) (environment->mip_count - 1));
-		glUniform1ui(pfp_miplevel_location, mip);
+		// Only the texels of the level get shaded.
+		glViewport(0, 0, ENVIRONMENT_SIZE >> mip, ENVIRONMENT_SIZE >> mip);
+		glUniform1ui(glGetUniformLocation(program, "pfp_currentMipLevel"), mip);
 
-		// Lambertian
-		glUniform1ui(pfp_distribution_location, 0);
-		for (size_t face = 0; face < 6; face++) {
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + face, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, lambertian_id, mip);
+		for (enum ibl_distribution distribution = 0; distribution < IBL_DISTRIBUTION_COUNT; distribution++) {
+			if (!outputs[distribution]) {
+				continue;
+			}
+
+			bind_filter_pass(program, distribution, (float) mip / (float) (environment->mip_count - 1));
+
+			for (size_t face = 0; face < 6; face++) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + face, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, outputs[distribution], mip);
+			}
+
+			GLuint lut = mip == 0 ? lut_outputs[distribution] : 0;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, GL_TEXTURE_2D, lut, 0);
+
+			glDrawArrays(GL_TRIANGLES, 0, 3);
 		}
+	}
+
+	glDeleteVertexArrays(1, &VAO);
+
+	// Cleanup.
+	framebuffer_fini(&fb);
+	shader_destroy(iblsampler_shader);
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, GL_TEXTURE_2D, 0, 0); // Detach LUT.
+	return true;
+}
 
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+// One dispatch per mip level and distribution covering all six faces, and one per lookup table.
+// Needs compute shaders and image stores (4.3 or their extensions), returns false without them.
+static bool prefilter_compute(const struct environment *environment, const GLuint outputs[], const GLuint lut_outputs[]) {
+	if (!window_extension_supported("GL_ARB_compute_shader") || !window_extension_supported("GL_ARB_shader_image_load_store")) {
+		return false;
+	}
 
-		// GGX
-		glUniform1ui(pfp_distribution_location, 1);
-		for (size_t face = 0; face < 6; face++) {
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + face, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, ggx_id, mip);
+	dispatch_compute_function dispatch_compute = (dispatch_compute_function) glfwGetProcAddress("glDispatchCompute");
+	bind_image_texture_function bind_image_texture = (bind_image_texture_function) glfwGetProcAddress("glBindImageTexture");
+	memory_barrier_function memory_barrier = (memory_barrier_function) glfwGetProcAddress("glMemoryBarrier");
+	if (!dispatch_compute || !bind_image_texture || !memory_barrier) {
+		return false;
+	}
+
+	struct shader *iblsampler_shader = load_sampler(true);
+	if (!iblsampler_shader) {
+		return false;
+	}
+
+	GLuint program = iblsampler_shader->program_id;
+	glUseProgram(program);
+
+	bind_filter_source(program, &environment->cubemap);
+	glUniform1i(glGetUniformLocation(program, "uOutput"), 0);
+	glUniform1i(glGetUniformLocation(program, "uLUT"), 1);
+
+	GLint size_location = glGetUniformLocation(program, "pfp_size");
+	GLint write_lut_location = glGetUniformLocation(program, "pfp_writeLUT");
+
+	glUniform1i(write_lut_location, GL_FALSE);
+
+	for (size_t mip = 0; mip < environment->mip_count; mip++) {
+		GLuint size = ENVIRONMENT_SIZE >> mip;
+		GLuint groups = (size + ENVIRONMENT_GROUP_SIZE - 1) / ENVIRONMENT_GROUP_SIZE;
+		glUniform1i(size_location, size);
+
+		for (enum ibl_distribution distribution = 0; distribution < IBL_DISTRIBUTION_COUNT; distribution++) {
+			if (!outputs[distribution]) {
+				continue;
+			}
+
+			bind_filter_pass(program, distribution, (float) mip / (float) (environment->mip_count - 1));
+			bind_image_texture(0, outputs[distribution], mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+			dispatch_compute(groups, groups, 6);
 		}
+	}
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, GL_TEXTURE_2D, ggx_lut_id, 0);
+	glUniform1i(write_lut_location, GL_TRUE);
+	glUniform1i(size_location, ENVIRONMENT_SIZE);
 
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+	for (enum ibl_distribution distribution = 0; distribution < IBL_DISTRIBUTION_COUNT; distribution++) {
+		if (!lut_outputs[distribution]) {
+			continue;
+		}
 
-		// Charlie
-		glUniform1ui(pfp_distribution_location, 2);
-		for (size_t face = 0; face < 6; face++) {
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + face, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, charlie_id, mip);
+		GLuint groups = (ENVIRONMENT_SIZE + ENVIRONMENT_GROUP_SIZE - 1) / ENVIRONMENT_GROUP_SIZE;
+		bind_filter_pass(program, distribution, 0);
+		bind_image_texture(1, lut_outputs[distribution], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		dispatch_compute(groups, groups, 1);
+	}
+
+	// Sampling them and reading them back both come after.
+	memory_barrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	shader_destroy(iblsampler_shader);
+
+	return true;
+}
+
+// Makes the prefiltered maps, and the lookup tables when nobody made them yet.
+static bool prefilter(struct environment *environment, bool with_luts) {
+	prepare_source(&environment->cubemap);
+
+	GLuint outputs[IBL_DISTRIBUTION_COUNT] = {0};
+	GLuint lut_outputs[IBL_DISTRIBUTION_COUNT] = {0};
+
+	// Lambertian lighting comes from spherical harmonics instead, the sampler is only ever asked for the specular ones.
+	for (enum ibl_distribution distribution = IBL_DISTRIBUTION_GGX; distribution < IBL_DISTRIBUTION_COUNT; distribution++) {
+		outputs[distribution] = create_prefiltered(ENVIRONMENT_SIZE, environment->mip_count);
+
+		if (with_luts) {
+			lut_outputs[distribution] = create_lut(ENVIRONMENT_SIZE);
 		}
+	}
 
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT6, GL_TEXTURE_2D, charlie_lut_id, 0);
+	if (!prefilter_compute(environment, outputs, lut_outputs) && !prefilter_fragment(environment, outputs, lut_outputs)) {
+		glDeleteTextures(IBL_DISTRIBUTION_COUNT, outputs);
+		glDeleteTextures(IBL_DISTRIBUTION_COUNT, lut_outputs);
+		return false;
+	}
 
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+	adopt(&environment->ggx, outputs[IBL_DISTRIBUTION_GGX], TEXTURE_KIND_ENVIRONMENT_GGX, GL_TEXTURE_CUBE_MAP);
+	adopt(&environment->charlie, outputs[IBL_DISTRIBUTION_CHARLIE], TEXTURE_KIND_ENVIRONMENT_CHARLIE, GL_TEXTURE_CUBE_MAP);
+
+	if (with_luts) {
+		adopt(&luts.ggx, lut_outputs[IBL_DISTRIBUTION_GGX], TEXTURE_KIND_ENVIRONMENT_GGX_LUT, GL_TEXTURE_2D);
+		adopt(&luts.charlie, lut_outputs[IBL_DISTRIBUTION_CHARLIE], TEXTURE_KIND_ENVIRONMENT_CHARLIE_LUT, GL_TEXTURE_2D);
 	}
 
-	// glEnable(GL_CULL_FACE);
+	return true;
+}
 
-	// FIXME: These are bypassing texture_init and I don't like it.
+// Cubemaps are used as they are, equirectangular ones get converted first.
+static bool init_source(struct environment *environment, const struct texture_image *image) {
+	if (image->faces == 6) {
+		return texture_init_streaming(&environment->cubemap, TEXTURE_KIND_CUBEMAP, image, 0);
+	}
 
-	environment->lambertian.gl_id = lambertian_id;
-	environment->lambertian.kind = TEXTURE_KIND_ENVIRONMENT_LAMBERTIAN;
-	environment->lambertian.gl_unit = TEXTURE_KIND_ENVIRONMENT_LAMBERTIAN;
-	environment->lambertian.gl_target = GL_TEXTURE_CUBE_MAP;
+	struct texture equirectangular;
+	if (!texture_init_streaming(&equirectangular, TEXTURE_KIND_EQUIRECTANGULAR, image, 0)) {
+		return false;
+	}
 
-	environment->ggx.gl_id = ggx_id;
-	environment->ggx.kind = TEXTURE_KIND_ENVIRONMENT_GGX;
-	environment->ggx.gl_unit = TEXTURE_KIND_ENVIRONMENT_GGX;
-	environment->ggx.gl_target = GL_TEXTURE_CUBE_MAP;
+	bool ok = convert_equirectangular_to_cubemap(&equirectangular, &environment->cubemap);
 
-	environment->ggx_lut.gl_id = ggx_lut_id;
-	environment->ggx_lut.kind = TEXTURE_KIND_ENVIRONMENT_GGX_LUT;
-	environment->ggx_lut.gl_unit = TEXTURE_KIND_ENVIRONMENT_GGX_LUT;
-	environment->ggx_lut.gl_target = GL_TEXTURE_2D;
+	texture_fini(&equirectangular);
 
-	environment->charlie.gl_id = charlie_id;
-	environment->charlie.kind = TEXTURE_KIND_ENVIRONMENT_CHARLIE;
-	environment->charlie.gl_unit = TEXTURE_KIND_ENVIRONMENT_CHARLIE;
-	environment->charlie.gl_target = GL_TEXTURE_CUBE_MAP;
+	return ok;
+}
 
-	environment->charlie_lut.gl_id = charlie_lut_id;
-	environment->charlie_lut.kind = TEXTURE_KIND_ENVIRONMENT_CHARLIE_LUT;
-	environment->charlie_lut.gl_unit = TEXTURE_KIND_ENVIRONMENT_CHARLIE_LUT;
-	environment->charlie_lut.gl_target = GL_TEXTURE_2D;
+// The driver decodes a level small enough to be projected quickly.
+static bool project_uploaded(const struct texture *cubemap, float sh[IBL_SH_COUNT][3]) {
+	size_t level = cubemap->base_level;
+	while (level + 1 < cubemap->levels && (cubemap->width >> level) > IBL_SH_SIZE) {
+		level++;
+	}
 
-	// Cleanup.
-	framebuffer_fini(&fb);
-	shader_destroy(iblsampler_shader);
+	int size = cubemap->width >> level ? cubemap->width >> level : 1;
+	size_t face_size = (size_t) size * size * 3 * sizeof (float);
+
+	struct texture_image image = {
+		.width = size,
+		.height = size,
+		.components = 3,
+		.type = TEXTURE_TYPE_FLOAT,
+		.compression = TEXTURE_COMPRESSION_NONE,
+		.faces = 6,
+		.levels = 1,
+		.size = face_size * 6,
+		.pixels = malloc(face_size * 6),
+	};
 
-	return environment;
+	if (!image.pixels) {
+		return false;
+	}
+
+	texture_switch(cubemap);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for (size_t face = 0; face < 6; face++) {
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, image.pixels + face * face_size);
+	}
+
+	bool ok = ibl_irradiance_sh(&image, sh);
+
+	texture_image_fini(&image);
+
+	return ok;
+}
+
+static void create_irradiance_buffer(struct environment *environment) {
+	float coefficients[IBL_SH_COUNT][4] = {0};
+	for (size_t i = 0; i < IBL_SH_COUNT; i++) {
+		memcpy(coefficients[i], environment->irradiance[i], sizeof environment->irradiance[i]);
+	}
+
+	glGenBuffers(1, &environment->irradiance_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, environment->irradiance_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof coefficients, coefficients, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+bool environment_init_from_file(struct environment *environment, const char *filepath) {
+	// Prebaked cubemaps skip the conversion render pass entirely.
+	uint64_t source_hash;
+	struct texture_image image;
+	if (!environment_source_read(filepath, &image, &source_hash)) {
+		return false;
+	}
+
+	// Compressed cubemaps can't be projected on the CPU, they get read back once uploaded.
+	bool projected = ibl_irradiance_sh(&image, environment->irradiance);
+	bool ok = init_source(environment, &image);
+
+	texture_image_fini(&image);
+
+	if (!ok) {
+		return false;
+	}
+
+	if (!projected && !project_uploaded(&environment->cubemap, environment->irradiance)) {
+		texture_fini(&environment->cubemap);
+		return false;
+	}
+
+	create_irradiance_buffer(environment);
+
+	environment->mip_count = ENVIRONMENT_MIP_COUNT;
+
+	uint64_t luts_key = environment_cache_key(UTILS_HASH_SEED);
+	uint64_t prefiltered_key = environment_cache_key(source_hash);
+
+	struct texture *lut_textures[] = {&luts.ggx, &luts.charlie};
+	const enum texture_kind lut_kinds[] = {TEXTURE_KIND_ENVIRONMENT_GGX_LUT, TEXTURE_KIND_ENVIRONMENT_CHARLIE_LUT};
+	struct texture *prefiltered_textures[] = {&environment->ggx, &environment->charlie};
+	const enum texture_kind prefiltered_kinds[] = {TEXTURE_KIND_ENVIRONMENT_GGX, TEXTURE_KIND_ENVIRONMENT_CHARLIE};
+
+	bool have_luts = luts.users > 0 || load_cached("brdf-luts", luts_key, lut_textures, lut_kinds, ARRAY_COUNT(lut_textures), false);
+	bool have_prefiltered = have_luts && load_cached(ENVIRONMENT_CACHE_CATEGORY, prefiltered_key, prefiltered_textures, prefiltered_kinds, ARRAY_COUNT(prefiltered_textures), true);
+
+	// The lookup tables come out of the same passes as the maps, missing either means rendering.
+	if (!have_prefiltered) {
+		if (!prefilter(environment, !have_luts)) {
+			if (have_luts && luts.users == 0) {
+				texture_fini(&luts.ggx);
+				texture_fini(&luts.charlie);
+			}
+
+			glDeleteBuffers(1, &environment->irradiance_buffer);
+			texture_fini(&environment->cubemap);
+			return false;
+		}
+
+		if (!have_luts) {
+			save_cached("brdf-luts", luts_key, lut_textures, ARRAY_COUNT(lut_textures), false);
+		}
+
+		save_cached(ENVIRONMENT_CACHE_CATEGORY, prefiltered_key, prefiltered_textures, ARRAY_COUNT(prefiltered_textures), true);
+	}
+
+	luts.users++;
+	environment->ggx_lut = luts.ggx;
+	environment->charlie_lut = luts.charlie;
+
+	return true;
 }
 
 void environment_fini(struct environment *environment) {
 	texture_fini(&environment->cubemap);
-	texture_fini(&environment->lambertian);
+	glDeleteBuffers(1, &environment->irradiance_buffer);
 	texture_fini(&environment->ggx);
-	texture_fini(&environment->ggx_lut);
 	texture_fini(&environment->charlie);
-	texture_fini(&environment->charlie_lut);
+
+	if (luts.users > 0 && --luts.users == 0) {
+		texture_fini(&luts.ggx);
+		texture_fini(&luts.charlie);
+	}
 }
 
 void environment_switch(const struct environment *new) {
-	texture_switch(&new->lambertian);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ENVIRONMENT_IRRADIANCE_BINDING, new->irradiance_buffer);
 	texture_switch(&new->ggx);
 	texture_switch(&new->ggx_lut);
 	texture_switch(&new->charlie);
@@ -0,0 +1,496 @@
+#include "client.h"
+
+// Free ranges of an arena buffer, sorted by offset and never adjacent (they get merged).
+// Units are vertices or indices, depending on the buffer.
+struct range {
+	size_t offset;
+	size_t size;
+};
+
+struct allocator {
+	struct range *free;
+	size_t free_count;
+	size_t capacity;
+};
+
+struct geometry_arena {
+	struct mesh_layout layout;
+
+	GLuint vao;
+	GLuint vbos[MESH_STREAMS_MAX];
+	GLuint ebo;
+
+	struct allocator vertices;
+	struct allocator indices;
+
+	// Everything allocated from this arena, needed to move them around when defragmenting.
+	struct geometry **geometries;
+	size_t geometries_count;
+};
+
+static struct geometrymanager {
+	struct geometry_arena **arenas;
+	size_t arenas_count;
+
+	// The VAO currently bound, to skip redundant switches between meshes.
+	GLuint bound_vao;
+
+	// Source of the instance attribute, 0 without one.
+	GLuint instance_indices;
+} gm;
+
+static bool allocator_insert(struct allocator *allocator, size_t index, size_t offset, size_t size) {
+	struct range *new_free = realloc(allocator->free, (allocator->free_count + 1) * sizeof *allocator->free);
+	if (!new_free) {
+		return false;
+	}
+
+	allocator->free = new_free;
+	memmove(&allocator->free[index + 1], &allocator->free[index], (allocator->free_count - index) * sizeof *allocator->free);
+	allocator->free[index] = (struct range) {offset, size};
+	allocator->free_count++;
+
+	return true;
+}
+
+static void allocator_remove(struct allocator *allocator, size_t index) {
+	memmove(&allocator->free[index], &allocator->free[index + 1], (allocator->free_count - index - 1) * sizeof *allocator->free);
+	allocator->free_count--;
+}
+
+// Returns the range to the allocator, merging it with its neighbors.
+static bool allocator_release(struct allocator *allocator, size_t offset, size_t size) {
+	size_t index = 0;
+	while (index < allocator->free_count && allocator->free[index].offset < offset) {
+		index++;
+	}
+
+	bool merges_previous = index > 0 && allocator->free[index - 1].offset + allocator->free[index - 1].size == offset;
+	bool merges_next = index < allocator->free_count && offset + size == allocator->free[index].offset;
+
+	if (merges_previous && merges_next) {
+		allocator->free[index - 1].size += size + allocator->free[index].size;
+		allocator_remove(allocator, index);
+	} else if (merges_previous) {
+		allocator->free[index - 1].size += size;
+	} else if (merges_next) {
+		allocator->free[index].offset = offset;
+		allocator->free[index].size += size;
+	} else {
+		return allocator_insert(allocator, index, offset, size);
+	}
+
+	return true;
+}
+
+// First fit.
+static bool allocator_allocate(struct allocator *allocator, size_t size, size_t *offset) {
+	for (size_t i = 0; i < allocator->free_count; i++) {
+		struct range *range = &allocator->free[i];
+		if (range->size < size) {
+			continue;
+		}
+
+		*offset = range->offset;
+		range->offset += size;
+		range->size -= size;
+
+		if (range->size == 0) {
+			allocator_remove(allocator, i);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+// Space that is free but not at the end of the buffer, i.e. holes between allocations.
+static size_t allocator_holes(const struct allocator *allocator) {
+	size_t holes = 0;
+
+	for (size_t i = 0; i < allocator->free_count; i++) {
+		const struct range *range = &allocator->free[i];
+		if (range->offset + range->size != allocator->capacity) {
+			holes += range->size;
+		}
+	}
+
+	return holes;
+}
+
+static void allocator_reset(struct allocator *allocator, size_t used) {
+	allocator->free_count = 0;
+
+	if (used < allocator->capacity) {
+		allocator_insert(allocator, 0, used, allocator->capacity - used);
+	}
+}
+
+static size_t index_size(void) {
+	return sizeof (uint32_t);
+}
+
+// The attribute pointers capture the buffers, so this has to be redone every time the buffers change.
+static void setup_vao(struct geometry_arena *arena) {
+	glBindVertexArray(arena->vao);
+	gm.bound_vao = arena->vao;
+
+	for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+		const struct mesh_attribute_format *format = &arena->layout.attributes[i];
+		if (!format->enabled) {
+			continue;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, arena->vbos[format->stream]);
+		glVertexAttribPointer(i, format->components, format->type, format->normalized, arena->layout.strides[format->stream], (const void *) format->offset);
+		glEnableVertexAttribArray(i);
+	}
+
+	// One index per instance, the base instance of the draw says where they start.
+	if (gm.instance_indices) {
+		glBindBuffer(GL_ARRAY_BUFFER, gm.instance_indices);
+		glVertexAttribIPointer(GEOMETRY_INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, NULL);
+		glVertexAttribDivisor(GEOMETRY_INSTANCE_ATTRIBUTE, 1);
+		glEnableVertexAttribArray(GEOMETRY_INSTANCE_ATTRIBUTE);
+	} else {
+		glDisableVertexAttribArray(GEOMETRY_INSTANCE_ATTRIBUTE);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->ebo);
+}
+
+static GLuint create_buffer(size_t size) {
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+	return buffer;
+}
+
+static void copy_buffer(GLuint source, size_t source_offset, GLuint destination, size_t destination_offset, size_t size) {
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source_offset, destination_offset, size);
+}
+
+// Through the staging ring when available, straight from client memory otherwise.
+static void upload(GLuint buffer, size_t offset, const void *data, size_t size) {
+	if (staging_upload_buffer(buffer, offset, data, size)) {
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
+
+// Buffers of an arena are only ever replaced by bigger (or compacted) ones, see resize_arena and defragment_arena.
+static void create_buffers(struct geometry_arena *arena, GLuint vbos[MESH_STREAMS_MAX], GLuint *ebo) {
+	for (size_t i = 0; i < arena->layout.streams_count; i++) {
+		vbos[i] = create_buffer(arena->vertices.capacity * arena->layout.strides[i]);
+	}
+
+	*ebo = create_buffer(arena->indices.capacity * index_size());
+}
+
+static void replace_buffers(struct geometry_arena *arena, GLuint vbos[MESH_STREAMS_MAX], GLuint ebo) {
+	glDeleteBuffers(arena->layout.streams_count, arena->vbos);
+	glDeleteBuffers(1, &arena->ebo);
+
+	for (size_t i = 0; i < arena->layout.streams_count; i++) {
+		arena->vbos[i] = vbos[i];
+	}
+
+	arena->ebo = ebo;
+	setup_vao(arena);
+}
+
+static struct geometry_arena *create_arena(const struct mesh_layout *layout, size_t vertices_count, size_t indices_count) {
+	struct geometry_arena *arena = calloc(1, sizeof *arena);
+	if (!arena) {
+		return NULL;
+	}
+
+	arena->layout = *layout;
+	arena->vertices.capacity = vertices_count > GEOMETRY_ARENA_MIN_VERTICES ? vertices_count : GEOMETRY_ARENA_MIN_VERTICES;
+	arena->indices.capacity = indices_count > GEOMETRY_ARENA_MIN_INDICES ? indices_count : GEOMETRY_ARENA_MIN_INDICES;
+
+	if (!allocator_insert(&arena->vertices, 0, 0, arena->vertices.capacity) || !allocator_insert(&arena->indices, 0, 0, arena->indices.capacity)) {
+		free(arena->vertices.free);
+		free(arena->indices.free);
+		free(arena);
+		return NULL;
+	}
+
+	glGenVertexArrays(1, &arena->vao);
+	create_buffers(arena, arena->vbos, &arena->ebo);
+	setup_vao(arena);
+
+	return arena;
+}
+
+static void destroy_arena(struct geometry_arena *arena) {
+	if (gm.bound_vao == arena->vao) {
+		geometry_unbind();
+	}
+
+	glDeleteBuffers(arena->layout.streams_count, arena->vbos);
+	glDeleteBuffers(1, &arena->ebo);
+	glDeleteVertexArrays(1, &arena->vao);
+
+	free(arena->vertices.free);
+	free(arena->indices.free);
+	free(arena->geometries);
+	free(arena);
+}
+
+// Grows the buffers so that the requested amounts fit at their end.
+// Existing content is copied on the GPU and keeps its offsets.
+static bool resize_arena(struct geometry_arena *arena, size_t vertices_count, size_t indices_count) {
+	size_t old_vertices_capacity = arena->vertices.capacity;
+	size_t old_indices_capacity = arena->indices.capacity;
+
+	size_t new_vertices_capacity = old_vertices_capacity;
+	while (new_vertices_capacity < old_vertices_capacity + vertices_count) {
+		new_vertices_capacity *= 2;
+	}
+
+	size_t new_indices_capacity = old_indices_capacity;
+	while (new_indices_capacity < old_indices_capacity + indices_count) {
+		new_indices_capacity *= 2;
+	}
+
+	// The new space at the end is free, merged with the last free range if it was there.
+	if (new_vertices_capacity > old_vertices_capacity && !allocator_release(&arena->vertices, old_vertices_capacity, new_vertices_capacity - old_vertices_capacity)) {
+		return false;
+	}
+
+	if (new_indices_capacity > old_indices_capacity && !allocator_release(&arena->indices, old_indices_capacity, new_indices_capacity - old_indices_capacity)) {
+		return false;
+	}
+
+	arena->vertices.capacity = new_vertices_capacity;
+	arena->indices.capacity = new_indices_capacity;
+
+	// Only the buffers that grow are replaced, the others would just be copied over as they are.
+	if (new_vertices_capacity > old_vertices_capacity) {
+		for (size_t i = 0; i < arena->layout.streams_count; i++) {
+			size_t stride = arena->layout.strides[i];
+			GLuint vbo = create_buffer(new_vertices_capacity * stride);
+			copy_buffer(arena->vbos[i], 0, vbo, 0, old_vertices_capacity * stride);
+			glDeleteBuffers(1, &arena->vbos[i]);
+			arena->vbos[i] = vbo;
+		}
+	}
+
+	if (new_indices_capacity > old_indices_capacity) {
+		GLuint ebo = create_buffer(new_indices_capacity * index_size());
+		copy_buffer(arena->ebo, 0, ebo, 0, old_indices_capacity * index_size());
+		glDeleteBuffers(1, &arena->ebo);
+		arena->ebo = ebo;
+	}
+
+	setup_vao(arena);
+
+	return true;
+}
+
+// Packs all geometries at the start of new buffers, leaving a single free range at the end.
+static void defragment_arena(struct geometry_arena *arena) {
+	GLuint vbos[MESH_STREAMS_MAX];
+	GLuint ebo;
+	create_buffers(arena, vbos, &ebo);
+
+	size_t vertices_used = 0;
+	size_t indices_used = 0;
+
+	for (size_t i = 0; i < arena->geometries_count; i++) {
+		struct geometry *geometry = arena->geometries[i];
+
+		for (size_t j = 0; j < arena->layout.streams_count; j++) {
+			size_t stride = arena->layout.strides[j];
+			copy_buffer(arena->vbos[j], geometry->first_vertex * stride, vbos[j], vertices_used * stride, geometry->vertices_count * stride);
+		}
+
+		copy_buffer(arena->ebo, geometry->first_index * index_size(), ebo, indices_used * index_size(), geometry->indices_count * index_size());
+
+		geometry->first_vertex = vertices_used;
+		geometry->first_index = indices_used;
+		vertices_used += geometry->vertices_count;
+		indices_used += geometry->indices_count;
+	}
+
+	replace_buffers(arena, vbos, ebo);
+	allocator_reset(&arena->vertices, vertices_used);
+	allocator_reset(&arena->indices, indices_used);
+}
+
+static bool is_fragmented(const struct allocator *allocator) {
+	return allocator_holes(allocator) > allocator->capacity / 4;
+}
+
+static struct geometry_arena *find_arena(const struct mesh_layout *layout, size_t vertices_count, size_t indices_count) {
+	for (size_t i = 0; i < gm.arenas_count; i++) {
+		if (mesh_layout_equal(&gm.arenas[i]->layout, layout)) {
+			return gm.arenas[i];
+		}
+	}
+
+	struct geometry_arena **new_arenas = realloc(gm.arenas, (gm.arenas_count + 1) * sizeof *gm.arenas);
+	if (!new_arenas) {
+		return NULL;
+	}
+
+	gm.arenas = new_arenas;
+
+	struct geometry_arena *arena = create_arena(layout, vertices_count, indices_count);
+	if (!arena) {
+		return NULL;
+	}
+
+	gm.arenas[gm.arenas_count++] = arena;
+
+	return arena;
+}
+
+static void remove_arena(struct geometry_arena *arena) {
+	for (size_t i = 0; i < gm.arenas_count; i++) {
+		if (gm.arenas[i] == arena) {
+			gm.arenas[i] = gm.arenas[--gm.arenas_count];
+			break;
+		}
+	}
+
+	destroy_arena(arena);
+}
+
+static struct geometry *arena_create_geometry(struct geometry_arena *arena, const struct mesh_layout *layout, const void *const *streams, size_t vertices_count, const uint32_t *indices, size_t indices_count) {
+	struct geometry **new_geometries = realloc(arena->geometries, (arena->geometries_count + 1) * sizeof *arena->geometries);
+	if (!new_geometries) {
+		return NULL;
+	}
+
+	arena->geometries = new_geometries;
+
+	struct geometry *geometry = malloc(sizeof *geometry);
+	if (!geometry) {
+		return NULL;
+	}
+
+	geometry->arena = arena;
+	geometry->vertices_count = vertices_count;
+	geometry->indices_count = indices_count;
+
+	// Allocate, growing the arena if there isn't a large enough free range.
+	bool allocated = allocator_allocate(&arena->vertices, vertices_count, &geometry->first_vertex)
+		|| (resize_arena(arena, vertices_count, 0) && allocator_allocate(&arena->vertices, vertices_count, &geometry->first_vertex));
+
+	if (!allocated) {
+		free(geometry);
+		return NULL;
+	}
+
+	allocated = allocator_allocate(&arena->indices, indices_count, &geometry->first_index)
+		|| (resize_arena(arena, 0, indices_count) && allocator_allocate(&arena->indices, indices_count, &geometry->first_index));
+
+	if (!allocated) {
+		allocator_release(&arena->vertices, geometry->first_vertex, vertices_count);
+		free(geometry);
+		return NULL;
+	}
+
+	// Upload.
+	for (size_t i = 0; i < layout->streams_count; i++) {
+		size_t stride = layout->strides[i];
+		upload(arena->vbos[i], geometry->first_vertex * stride, streams[i], vertices_count * stride);
+	}
+
+	upload(arena->ebo, geometry->first_index * index_size(), indices, indices_count * index_size());
+
+	arena->geometries[arena->geometries_count++] = geometry;
+
+	return geometry;
+}
+
+struct geometry *geometry_create(const struct mesh_layout *layout, const void *const *streams, size_t vertices_count, const uint32_t *indices, size_t indices_count) {
+	struct geometry_arena *arena = find_arena(layout, vertices_count, indices_count);
+	if (!arena) {
+		return NULL;
+	}
+
+	struct geometry *geometry = arena_create_geometry(arena, layout, streams, vertices_count, indices, indices_count);
+
+	// An arena created for this geometry would otherwise stay around empty.
+	if (!geometry && arena->geometries_count == 0) {
+		remove_arena(arena);
+	}
+
+	return geometry;
+}
+
+void geometry_destroy(struct geometry *geometry) {
+	struct geometry_arena *arena = geometry->arena;
+
+	for (size_t i = 0; i < arena->geometries_count; i++) {
+		if (arena->geometries[i] == geometry) {
+			arena->geometries[i] = arena->geometries[--arena->geometries_count];
+			break;
+		}
+	}
+
+	// Failing to release only leaks the range until the next defragmentation.
+	allocator_release(&arena->vertices, geometry->first_vertex, geometry->vertices_count);
+	allocator_release(&arena->indices, geometry->first_index, geometry->indices_count);
+	free(geometry);
+
+	// Empty arenas are destroyed, fragmented ones compacted.
+	if (arena->geometries_count == 0) {
+		remove_arena(arena);
+	} else if (is_fragmented(&arena->vertices) || is_fragmented(&arena->indices)) {
+		defragment_arena(arena);
+	}
+}
+
+void geometry_bind(const struct geometry *geometry) {
+	if (gm.bound_vao != geometry->arena->vao) {
+		glBindVertexArray(geometry->arena->vao);
+		gm.bound_vao = geometry->arena->vao;
+	}
+}
+
+GLuint geometry_vertex_array(const struct geometry *geometry) {
+	return geometry->arena->vao;
+}
+
+// Has to be called when something else might have bound a VAO of its own.
+void geometry_unbind(void) {
+	glBindVertexArray(0);
+	gm.bound_vao = 0;
+}
+
+void geometry_draw(const struct geometry *geometry) {
+	glDrawElementsBaseVertex(GL_TRIANGLES, geometry->indices_count, GL_UNSIGNED_INT, (const void *) (geometry->first_index * index_size()), geometry->first_vertex);
+}
+
+void geometry_draw_instanced(const struct geometry *geometry, size_t instances_count) {
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, geometry->indices_count, GL_UNSIGNED_INT, (const void *) (geometry->first_index * index_size()), instances_count, geometry->first_vertex);
+}
+
+// Where the instance attribute of every arena comes from, from now on.
+void geometry_instance_indices(GLuint buffer) {
+	gm.instance_indices = buffer;
+
+	for (size_t i = 0; i < gm.arenas_count; i++) {
+		setup_vao(gm.arenas[i]);
+	}
+}
+
+void geometry_fini(void) {
+	for (size_t i = 0; i < gm.arenas_count; i++) {
+		destroy_arena(gm.arenas[i]);
+	}
+
+	free(gm.arenas);
+	gm.arenas = NULL;
+	gm.arenas_count = 0;
+}
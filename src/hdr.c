@@ -0,0 +1,202 @@
+#include "client.h"
+#include <limits.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Largest finite half float, brighter texels saturate to it rather than becoming infinities.
+#define HDR_HALF_MAX 0x7bff
+
+// Smallest normal half float, dimmer texels become black.
+#define HDR_HALF_MIN 0x0400
+
+bool hdr_detect(const unsigned char *data, size_t size) {
+	return (size >= 10 && memcmp(data, "#?RADIANCE", 10) == 0) || (size >= 6 && memcmp(data, "#?RGBE", 6) == 0);
+}
+
+// The next line of the header, without its newline. Returns false at the end of the data.
+static bool read_line(const unsigned char *data, size_t size, size_t *cursor, char *line, size_t capacity) {
+	size_t length = 0;
+
+	while (*cursor < size && data[*cursor] != '\n') {
+		if (length + 1 < capacity) {
+			line[length++] = data[*cursor];
+		}
+		(*cursor)++;
+	}
+
+	if (*cursor >= size) {
+		return false;
+	}
+
+	(*cursor)++;
+	line[length] = '\0';
+
+	return true;
+}
+
+// Mantissa m with the shared exponent e is m * 2^(e - 136). Having at most 8 significant bits, it is exact in a half float.
+// Converting m to a float normalizes it, moving its exponent by e - 136 and rebiasing from 127 to 15 gives the half float bits.
+static inline int32_t rgbe_to_half(uint32_t mantissa, uint32_t exponent) {
+	if (mantissa == 0) {
+		return 0;
+	}
+
+	float value = (float) mantissa;
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof bits);
+
+	int32_t half = (int32_t) (bits >> 13) + ((int32_t) exponent - 136 - (127 - 15)) * 1024;
+
+	return half < HDR_HALF_MIN ? 0 : half > HDR_HALF_MAX ? HDR_HALF_MAX : half;
+}
+
+// The same for each channel of 4 texels at a time with SSE2.
+static void scanline_to_half(const unsigned char *restrict rgbe, int width, uint16_t *restrict output) {
+	int x = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32(136 + 127 - 15);
+	const __m128i minimum = _mm_set1_epi32(HDR_HALF_MIN);
+	const __m128i maximum = _mm_set1_epi32(HDR_HALF_MAX);
+
+	// Each texel stores 4 halves, the 4th one gets overwritten by the next texel, hence the last one going through the scalar loop.
+	for (; x + 4 < width; x += 4) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *) (rgbe + x * 4));
+		__m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+		__m128i halves[4];
+
+		for (int i = 0; i < 4; i++) {
+			__m128i texel = i % 2 ? _mm_unpackhi_epi16(words[i / 2], zero) : _mm_unpacklo_epi16(words[i / 2], zero);
+			__m128i exponent = _mm_shuffle_epi32(texel, _MM_SHUFFLE(3, 3, 3, 3));
+
+			__m128i bits = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(texel)), 13);
+			__m128i half = _mm_add_epi32(bits, _mm_slli_epi32(_mm_sub_epi32(exponent, bias), 10));
+
+			__m128i above = _mm_cmpgt_epi32(half, maximum);
+			half = _mm_or_si128(_mm_andnot_si128(above, half), _mm_and_si128(above, maximum));
+			half = _mm_andnot_si128(_mm_cmplt_epi32(half, minimum), half);
+			halves[i] = _mm_andnot_si128(_mm_cmpeq_epi32(texel, zero), half);
+		}
+
+		__m128i first = _mm_packs_epi32(halves[0], halves[1]);
+		__m128i second = _mm_packs_epi32(halves[2], halves[3]);
+		_mm_storel_epi64((__m128i *) (output + x * 3), first);
+		_mm_storel_epi64((__m128i *) (output + x * 3 + 3), _mm_srli_si128(first, 8));
+		_mm_storel_epi64((__m128i *) (output + x * 3 + 6), second);
+		_mm_storel_epi64((__m128i *) (output + x * 3 + 9), _mm_srli_si128(second, 8));
+	}
+#endif
+
+	for (; x < width; x++) {
+		for (int c = 0; c < 3; c++) {
+			output[x * 3 + c] = rgbe_to_half(rgbe[x * 4 + c], rgbe[x * 4 + 3]);
+		}
+	}
+}
+
+// Scanlines are either flat RGBE texels, or run length encoded one channel after the other.
+static bool read_scanline(const unsigned char *data, size_t size, size_t *cursor, int width, unsigned char *rgbe) {
+	const unsigned char *at = data + *cursor;
+	size_t left = size - *cursor;
+
+	bool encoded = width >= 8 && width < 32768 && left >= 4 && at[0] == 2 && at[1] == 2 && (at[2] << 8 | at[3]) == width;
+	if (!encoded) {
+		if (left < (size_t) width * 4) {
+			return false;
+		}
+
+		memcpy(rgbe, at, (size_t) width * 4);
+		*cursor += (size_t) width * 4;
+		return true;
+	}
+
+	*cursor += 4;
+
+	for (int c = 0; c < 4; c++) {
+		int x = 0;
+
+		while (x < width) {
+			if (*cursor >= size) {
+				return false;
+			}
+
+			int count = data[(*cursor)++];
+			bool run = count > 128;
+			if (run) {
+				count -= 128;
+			}
+
+			if (count == 0 || count > width - x || *cursor + (run ? 1 : count) > size) {
+				return false;
+			}
+
+			for (int i = 0; i < count; i++) {
+				rgbe[(x + i) * 4 + c] = data[*cursor + (run ? 0 : i)];
+			}
+
+			*cursor += run ? 1 : count;
+			x += count;
+		}
+	}
+
+	return true;
+}
+
+bool hdr_decode(struct texture_image *image, const unsigned char *data, size_t size, bool flip) {
+	if (!hdr_detect(data, size)) {
+		return false;
+	}
+
+	size_t cursor = 0;
+	char line[256];
+	bool rgbe = true;
+
+	// Header lines until an empty one.
+	while (read_line(data, size, &cursor, line, sizeof line) && line[0] != '\0') {
+		if (strncmp(line, "FORMAT=", 7) == 0) {
+			rgbe = strcmp(line + 7, "32-bit_rle_rgbe") == 0;
+		}
+	}
+
+	int width, height;
+	if (!rgbe || !read_line(data, size, &cursor, line, sizeof line) || sscanf(line, "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0 || width > INT_MAX / 4 / height) {
+		fprintf(stderr, "Unsupported Radiance image\n");
+		return false;
+	}
+
+	image->width = width;
+	image->height = height;
+	image->components = 3;
+	image->type = TEXTURE_TYPE_HALF_FLOAT;
+	image->compression = TEXTURE_COMPRESSION_NONE;
+	image->faces = 1;
+	image->levels = 1;
+	image->size = (size_t) width * height * 3 * sizeof (uint16_t);
+	image->pixels = malloc(image->size);
+
+	unsigned char *scanline = malloc((size_t) width * 4);
+	if (!image->pixels || !scanline) {
+		free(scanline);
+		texture_image_fini(image);
+		return false;
+	}
+
+	for (int y = 0; y < height; y++) {
+		if (!read_scanline(data, size, &cursor, width, scanline)) {
+			fprintf(stderr, "Truncated Radiance image\n");
+			free(scanline);
+			texture_image_fini(image);
+			return false;
+		}
+
+		int row = flip ? height - 1 - y : y;
+		scanline_to_half(scanline, width, (uint16_t *) image->pixels + (size_t) row * width * 3);
+	}
+
+	free(scanline);
+
+	return true;
+}
@@ -0,0 +1,663 @@
+#include "client.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Texels get projected in blocks, their directions, solid angles and colors laid out as plain arrays.
+#define IBL_SH_BLOCK 256
+
+struct sh_block {
+	float x[IBL_SH_BLOCK];
+	float y[IBL_SH_BLOCK];
+	float z[IBL_SH_BLOCK];
+	float weight[IBL_SH_BLOCK];
+	float color[3][IBL_SH_BLOCK];
+	size_t count;
+};
+
+uint32_t ibl_sample_count(enum ibl_distribution distribution, float roughness, uint32_t samples) {
+	// The Lambertian and Charlie lobes are wide at any roughness, GGX ones shrink down to a single direction.
+	if (distribution != IBL_DISTRIBUTION_GGX) {
+		return samples;
+	}
+
+	uint32_t scaled = (uint32_t) (samples * roughness);
+	return scaled < IBL_SAMPLES_MIN ? IBL_SAMPLES_MIN : scaled;
+}
+
+static float *level_pixels(const struct ibl_cubemap *cubemap, size_t level, int face) {
+	size_t offset = 0;
+	for (size_t i = 0; i < level; i++) {
+		int size = cubemap->size >> i ? cubemap->size >> i : 1;
+		offset += (size_t) size * size * 3 * 6;
+	}
+
+	int size = cubemap->size >> level ? cubemap->size >> level : 1;
+	return cubemap->pixels + offset + (size_t) size * size * 3 * face;
+}
+
+static bool allocate(struct ibl_cubemap *cubemap, int size, size_t levels) {
+	cubemap->size = size;
+	cubemap->levels = levels;
+
+	size_t floats = 0;
+	for (size_t i = 0; i < levels; i++) {
+		int level_size = size >> i ? size >> i : 1;
+		floats += (size_t) level_size * level_size * 3 * 6;
+	}
+
+	cubemap->pixels = malloc(floats * sizeof *cubemap->pixels);
+	return cubemap->pixels != NULL;
+}
+
+// Box filtered levels below the first, as glGenerateMipmap does.
+static void generate_levels(struct ibl_cubemap *cubemap) {
+	for (size_t level = 1; level < cubemap->levels; level++) {
+		int size = cubemap->size >> (level - 1) ? cubemap->size >> (level - 1) : 1;
+		int half = size > 1 ? size / 2 : 1;
+
+		for (int face = 0; face < 6; face++) {
+			const float *source = level_pixels(cubemap, level - 1, face);
+			float *destination = level_pixels(cubemap, level, face);
+
+			for (int y = 0; y < half; y++) {
+				for (int x = 0; x < half; x++) {
+					int x1 = 2 * x + 1 < size ? 2 * x + 1 : 2 * x;
+					int y1 = 2 * y + 1 < size ? 2 * y + 1 : 2 * y;
+
+					for (int c = 0; c < 3; c++) {
+						float sum = source[((size_t) (2 * y) * size + 2 * x) * 3 + c] + source[((size_t) (2 * y) * size + x1) * 3 + c]
+							+ source[((size_t) y1 * size + 2 * x) * 3 + c] + source[((size_t) y1 * size + x1) * 3 + c];
+						destination[((size_t) y * half + x) * 3 + c] = sum * 0.25f;
+					}
+				}
+			}
+		}
+	}
+}
+
+static float component(const struct texture_image *image, size_t index) {
+	switch (image->type) {
+	    case TEXTURE_TYPE_HALF_FLOAT: return dequantize_half(((const uint16_t *) image->pixels)[index]);
+	    case TEXTURE_TYPE_FLOAT: return ((const float *) image->pixels)[index];
+	    default: return image->pixels[index] / 255.0f;
+	}
+}
+
+bool ibl_cubemap_from_image(struct ibl_cubemap *cubemap, const struct texture_image *image) {
+	if (image->faces != 6 || image->compression != TEXTURE_COMPRESSION_NONE || image->width != image->height || image->components < 3) {
+		return false;
+	}
+
+	// Single level cubemaps get their chain made, like the GPU side does.
+	size_t levels = image->levels > 1 ? image->levels : texture_levels_count(image->width, image->height);
+	if (!allocate(cubemap, image->width, levels)) {
+		return false;
+	}
+
+	size_t component_size = image->type == TEXTURE_TYPE_HALF_FLOAT ? 2 : image->type == TEXTURE_TYPE_FLOAT ? 4 : 1;
+
+	for (size_t level = 0; level < image->levels; level++) {
+		int size;
+		size_t offset;
+		size_t length = texture_image_level(image, level, &size, NULL, &offset);
+
+		for (int face = 0; face < 6; face++) {
+			float *destination = level_pixels(cubemap, level, face);
+			size_t first = (offset + face * length) / component_size;
+
+			for (size_t i = 0; i < (size_t) size * size; i++) {
+				for (int c = 0; c < 3; c++) {
+					destination[i * 3 + c] = component(image, first + i * image->components + c);
+				}
+			}
+		}
+	}
+
+	if (image->levels == 1) {
+		generate_levels(cubemap);
+	}
+
+	return true;
+}
+
+// Same mapping as shaders/equirect2cube, bilinear and repeating like the equirectangular texture.
+bool ibl_cubemap_from_equirectangular(struct ibl_cubemap *cubemap, const struct texture_image *image, int size) {
+	if (image->faces != 1 || image->compression != TEXTURE_COMPRESSION_NONE || image->components < 3) {
+		return false;
+	}
+
+	if (!allocate(cubemap, size, texture_levels_count(size, size))) {
+		return false;
+	}
+
+	for (int face = 0; face < 6; face++) {
+		float *destination = level_pixels(cubemap, 0, face);
+
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				float direction[3];
+				ibl_texel_direction(face, x, y, size, direction);
+
+				float u = atan2f(direction[2], direction[0]) * 0.1591f + 0.5f;
+				float v = asinf(direction[1]) * 0.3183f + 0.5f;
+
+				float fx = u * image->width - 0.5f;
+				float fy = v * image->height - 0.5f;
+				int x0 = (int) floorf(fx);
+				int y0 = (int) floorf(fy);
+				float tx = fx - x0;
+				float ty = fy - y0;
+
+				float *texel = destination + ((size_t) y * size + x) * 3;
+				texel[0] = texel[1] = texel[2] = 0;
+
+				for (int j = 0; j < 4; j++) {
+					int sx = ((x0 + (j & 1)) % image->width + image->width) % image->width;
+					int sy = ((y0 + (j >> 1)) % image->height + image->height) % image->height;
+					float weight = (j & 1 ? tx : 1 - tx) * (j >> 1 ? ty : 1 - ty);
+
+					for (int c = 0; c < 3; c++) {
+						texel[c] += weight * component(image, ((size_t) sy * image->width + sx) * image->components + c);
+					}
+				}
+			}
+		}
+	}
+
+	generate_levels(cubemap);
+
+	return true;
+}
+
+void ibl_cubemap_fini(struct ibl_cubemap *cubemap) {
+	free(cubemap->pixels);
+	cubemap->pixels = NULL;
+}
+
+// Direction through the center of a texel, following the OpenGL cubemap face conventions.
+void ibl_texel_direction(int face, int x, int y, int size, float direction[3]) {
+	float s = 2 * (x + 0.5f) / size - 1;
+	float t = 2 * (y + 0.5f) / size - 1;
+
+	float faces[6][3] = {
+		{1, -t, -s},
+		{-1, -t, s},
+		{s, 1, t},
+		{s, -1, -t},
+		{s, -t, 1},
+		{-s, -t, -1},
+	};
+
+	float length = sqrtf(faces[face][0] * faces[face][0] + faces[face][1] * faces[face][1] + faces[face][2] * faces[face][2]);
+	for (int c = 0; c < 3; c++) {
+		direction[c] = faces[face][c] / length;
+	}
+}
+
+static void sample_level(const struct ibl_cubemap *cubemap, size_t level, const float direction[3], float color[3]) {
+	float x = direction[0], y = direction[1], z = direction[2];
+	float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+	int face;
+	float sc, tc, ma;
+
+	if (ax >= ay && ax >= az) {
+		face = x > 0 ? 0 : 1;
+		sc = x > 0 ? -z : z;
+		tc = -y;
+		ma = ax;
+	} else if (ay >= az) {
+		face = y > 0 ? 2 : 3;
+		sc = x;
+		tc = y > 0 ? z : -z;
+		ma = ay;
+	} else {
+		face = z > 0 ? 4 : 5;
+		sc = z > 0 ? x : -x;
+		tc = -y;
+		ma = az;
+	}
+
+	int size = cubemap->size >> level ? cubemap->size >> level : 1;
+	const float *pixels = level_pixels(cubemap, level, face);
+
+	float fx = ((sc / ma + 1) * 0.5f) * size - 0.5f;
+	float fy = ((tc / ma + 1) * 0.5f) * size - 0.5f;
+	int x0 = (int) floorf(fx);
+	int y0 = (int) floorf(fy);
+	float tx = fx - x0;
+	float ty = fy - y0;
+
+	color[0] = color[1] = color[2] = 0;
+
+	// Clamped to the face, OpenGL blends across the edges with seamless cubemaps which makes edge texels differ slightly.
+	for (int j = 0; j < 4; j++) {
+		int sx = x0 + (j & 1);
+		int sy = y0 + (j >> 1);
+		sx = sx < 0 ? 0 : sx >= size ? size - 1 : sx;
+		sy = sy < 0 ? 0 : sy >= size ? size - 1 : sy;
+		float weight = (j & 1 ? tx : 1 - tx) * (j >> 1 ? ty : 1 - ty);
+
+		for (int c = 0; c < 3; c++) {
+			color[c] += weight * pixels[((size_t) sy * size + sx) * 3 + c];
+		}
+	}
+}
+
+// Trilinear, like textureLod().
+static void sample(const struct ibl_cubemap *cubemap, const float direction[3], float lod, float color[3]) {
+	float max_lod = (float) (cubemap->levels - 1);
+	lod = lod > 0 ? (lod < max_lod ? lod : max_lod) : 0;
+
+	size_t level = (size_t) lod;
+	float blend = lod - level;
+
+	sample_level(cubemap, level, direction, color);
+
+	if (blend > 0 && level + 1 < cubemap->levels) {
+		float next[3];
+		sample_level(cubemap, level + 1, direction, next);
+
+		for (int c = 0; c < 3; c++) {
+			color[c] += (next[c] - color[c]) * blend;
+		}
+	}
+}
+
+static float hammersley(uint32_t i) {
+	i = (i << 16) | (i >> 16);
+	i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+	i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+	i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+	i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+	return i * 2.3283064365386963e-10f;
+}
+
+static float dot(const float a[3], const float b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross(const float a[3], const float b[3], float result[3]) {
+	result[0] = a[1] * b[2] - a[2] * b[1];
+	result[1] = a[2] * b[0] - a[0] * b[2];
+	result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void normalize(float v[3]) {
+	float length = sqrtf(dot(v, v));
+	for (int c = 0; c < 3; c++) {
+		v[c] /= length;
+	}
+}
+
+static float d_ggx(float n_dot_h, float roughness) {
+	float alpha = roughness * roughness;
+	float alpha2 = alpha * alpha;
+	float divisor = n_dot_h * n_dot_h * (alpha2 - 1) + 1;
+	return alpha2 / ((float) M_PI * divisor * divisor);
+}
+
+static float d_charlie(float roughness, float n_dot_h) {
+	roughness = roughness > 0.000001f ? roughness : 0.000001f;
+	float inverse = 1 / (roughness * roughness);
+	float sin2h = 1 - n_dot_h * n_dot_h;
+	return (2 + inverse) * powf(sin2h, inverse * 0.5f) / (2 * (float) M_PI);
+}
+
+// getSampleVector() and getImportanceSampleDirection() of the shaders.
+static void sample_vector(enum ibl_distribution distribution, uint32_t index, uint32_t count, const float normal[3], float roughness, float h[3]) {
+	float x = (float) index / (float) count;
+	float y = hammersley(index);
+	float phi = 2 * (float) M_PI * x;
+	float alpha = roughness * roughness;
+	float cos_theta, sin_theta;
+
+	switch (distribution) {
+	    case IBL_DISTRIBUTION_LAMBERTIAN:
+		    cos_theta = 1 - y;
+		    sin_theta = sqrtf(1 - cos_theta * cos_theta);
+		    break;
+	    case IBL_DISTRIBUTION_GGX:
+		    cos_theta = sqrtf((1 - y) / (1 + (alpha * alpha - 1) * y));
+		    sin_theta = sqrtf(1 - cos_theta * cos_theta);
+		    break;
+	    default:
+		    sin_theta = powf(y, alpha / (2 * alpha + 1));
+		    cos_theta = sqrtf(1 - sin_theta * sin_theta);
+	}
+
+	float local[3] = {sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta};
+	normalize(local);
+
+	// Eliminates singularities.
+	float bitangent[3] = {0, 1, 0};
+	float ax = fabsf(normal[0]), ay = fabsf(normal[1]), az = fabsf(normal[2]);
+	if (ay > ax && ay > az) {
+		bitangent[1] = 0;
+		bitangent[2] = normal[1] > 0 ? 1 : -1;
+	}
+
+	float tangent[3];
+	cross(bitangent, normal, tangent);
+	cross(normal, tangent, bitangent);
+
+	for (int c = 0; c < 3; c++) {
+		h[c] = tangent[c] * local[0] + bitangent[c] * local[1] + normal[c] * local[2];
+	}
+
+	normalize(h);
+}
+
+static float pdf(enum ibl_distribution distribution, const float v[3], const float h[3], const float n[3], const float l[3], float roughness) {
+	float v_dot_h = dot(v, h);
+	float n_dot_h = dot(n, h);
+	float value;
+
+	switch (distribution) {
+	    case IBL_DISTRIBUTION_LAMBERTIAN: value = dot(n, l) / (float) M_PI; break;
+	    case IBL_DISTRIBUTION_GGX: value = d_ggx(n_dot_h, roughness) * n_dot_h / (4 * v_dot_h); break;
+	    default: value = d_charlie(roughness, n_dot_h) * n_dot_h / fabsf(4 * v_dot_h);
+	}
+
+	return value > 0 ? value : 0;
+}
+
+// filterColor() of the shaders, the lod bias is always 0.
+void ibl_prefilter(const struct ibl_cubemap *source, enum ibl_distribution distribution, float roughness, uint32_t samples, const float normal[3], float color[3]) {
+	float sum[4] = {0};
+	float solid_angle_texel = 4 * (float) M_PI / (6 * (float) source->size * source->size);
+
+	for (uint32_t i = 0; i < samples; i++) {
+		float h[3];
+		sample_vector(distribution, i, samples, normal, roughness, h);
+
+		// L is V reflected around H, and V = N.
+		float l[3];
+		float v_dot_h = dot(normal, h);
+		for (int c = 0; c < 3; c++) {
+			l[c] = 2 * v_dot_h * h[c] - normal[c];
+		}
+		normalize(l);
+
+		float n_dot_l = dot(normal, l);
+		if (n_dot_l <= 0) {
+			continue;
+		}
+
+		float lod = 0;
+		if (roughness > 0 || distribution == IBL_DISTRIBUTION_LAMBERTIAN) {
+			float solid_angle_sample = 1 / (samples * pdf(distribution, normal, h, normal, l, roughness));
+			lod = 0.5f * log2f(solid_angle_sample / solid_angle_texel);
+		}
+
+		float texel[3];
+		if (distribution == IBL_DISTRIBUTION_LAMBERTIAN) {
+			sample(source, h, lod, texel);
+			for (int c = 0; c < 3; c++) {
+				sum[c] += texel[c];
+			}
+			sum[3] += 1;
+		} else {
+			sample(source, l, lod, texel);
+			for (int c = 0; c < 3; c++) {
+				sum[c] += texel[c] * n_dot_l;
+			}
+			sum[3] += n_dot_l;
+		}
+	}
+
+	for (int c = 0; c < 3; c++) {
+		color[c] = sum[3] > 0 ? sum[c] / sum[3] : sum[c];
+	}
+}
+
+// Sums of color * solid angle * basis polynomial, 4 texels at a time when SIMD is available.
+// Blocks are summed in floats, the totals in doubles, so large images don't lose the small contributions.
+static void project_block(const struct sh_block *block, double sums[IBL_SH_COUNT][3]) {
+	float partial[IBL_SH_COUNT][3] = {0};
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128 accumulators[IBL_SH_COUNT][3];
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			accumulators[k][c] = _mm_setzero_ps();
+		}
+	}
+
+	const __m128 three = _mm_set1_ps(3);
+
+	for (; i + 4 <= block->count; i += 4) {
+		__m128 x = _mm_loadu_ps(block->x + i);
+		__m128 y = _mm_loadu_ps(block->y + i);
+		__m128 z = _mm_loadu_ps(block->z + i);
+		__m128 w = _mm_loadu_ps(block->weight + i);
+
+		__m128 wx = _mm_mul_ps(w, x);
+		__m128 wy = _mm_mul_ps(w, y);
+		__m128 wz = _mm_mul_ps(w, z);
+
+		__m128 basis[IBL_SH_COUNT] = {
+			w,
+			wy,
+			wz,
+			wx,
+			_mm_mul_ps(wx, y),
+			_mm_mul_ps(wy, z),
+			_mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(wz, z)), w),
+			_mm_mul_ps(wx, z),
+			_mm_sub_ps(_mm_mul_ps(wx, x), _mm_mul_ps(wy, y)),
+		};
+
+		for (int c = 0; c < 3; c++) {
+			__m128 color = _mm_loadu_ps(block->color[c] + i);
+			for (int k = 0; k < IBL_SH_COUNT; k++) {
+				accumulators[k][c] = _mm_add_ps(accumulators[k][c], _mm_mul_ps(basis[k], color));
+			}
+		}
+	}
+
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			float lanes[4];
+			_mm_storeu_ps(lanes, accumulators[k][c]);
+			partial[k][c] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t accumulators[IBL_SH_COUNT][3];
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			accumulators[k][c] = vdupq_n_f32(0);
+		}
+	}
+
+	for (; i + 4 <= block->count; i += 4) {
+		float32x4_t x = vld1q_f32(block->x + i);
+		float32x4_t y = vld1q_f32(block->y + i);
+		float32x4_t z = vld1q_f32(block->z + i);
+		float32x4_t w = vld1q_f32(block->weight + i);
+
+		float32x4_t wx = vmulq_f32(w, x);
+		float32x4_t wy = vmulq_f32(w, y);
+		float32x4_t wz = vmulq_f32(w, z);
+
+		float32x4_t basis[IBL_SH_COUNT] = {
+			w,
+			wy,
+			wz,
+			wx,
+			vmulq_f32(wx, y),
+			vmulq_f32(wy, z),
+			vsubq_f32(vmulq_n_f32(vmulq_f32(wz, z), 3), w),
+			vmulq_f32(wx, z),
+			vsubq_f32(vmulq_f32(wx, x), vmulq_f32(wy, y)),
+		};
+
+		for (int c = 0; c < 3; c++) {
+			float32x4_t color = vld1q_f32(block->color[c] + i);
+			for (int k = 0; k < IBL_SH_COUNT; k++) {
+				accumulators[k][c] = vmlaq_f32(accumulators[k][c], basis[k], color);
+			}
+		}
+	}
+
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			float lanes[4];
+			vst1q_f32(lanes, accumulators[k][c]);
+			partial[k][c] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+	}
+#endif
+
+	for (; i < block->count; i++) {
+		float x = block->x[i], y = block->y[i], z = block->z[i], w = block->weight[i];
+		float basis[IBL_SH_COUNT] = {w, w * y, w * z, w * x, w * x * y, w * y * z, w * (3 * z * z - 1), w * x * z, w * (x * x - y * y)};
+
+		for (int k = 0; k < IBL_SH_COUNT; k++) {
+			for (int c = 0; c < 3; c++) {
+				partial[k][c] += basis[k] * block->color[c][i];
+			}
+		}
+	}
+
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			sums[k][c] += partial[k][c];
+		}
+	}
+}
+
+static void add_texel(struct sh_block *block, const struct texture_image *image, size_t index, const float direction[3], float weight, double sums[IBL_SH_COUNT][3]) {
+	size_t i = block->count++;
+	block->x[i] = direction[0];
+	block->y[i] = direction[1];
+	block->z[i] = direction[2];
+	block->weight[i] = weight;
+
+	for (int c = 0; c < 3; c++) {
+		block->color[c][i] = component(image, index * image->components + c);
+	}
+
+	if (block->count == IBL_SH_BLOCK) {
+		project_block(block, sums);
+		block->count = 0;
+	}
+}
+
+// Radiance projected on the basis, then convolved with the clamped cosine (Ramamoorthi and Hanrahan, 2001).
+// Constants are folded in so that evaluating them gives what the Lambertian prefiltering would, irradiance over pi.
+bool ibl_irradiance_sh(const struct texture_image *image, float sh[IBL_SH_COUNT][3]) {
+	if (image->compression != TEXTURE_COMPRESSION_NONE || image->components < 3 || (image->faces != 1 && image->faces != 6)) {
+		return false;
+	}
+
+	struct sh_block *block = malloc(sizeof *block);
+	if (!block) {
+		return false;
+	}
+
+	block->count = 0;
+	double sums[IBL_SH_COUNT][3] = {0};
+
+	if (image->faces == 6) {
+		size_t level = 0;
+		while (level + 1 < image->levels && (image->width >> level) > IBL_SH_SIZE) {
+			level++;
+		}
+
+		int size;
+		size_t offset;
+		size_t length = texture_image_level(image, level, &size, NULL, &offset);
+		size_t component_size = image->type == TEXTURE_TYPE_HALF_FLOAT ? 2 : image->type == TEXTURE_TYPE_FLOAT ? 4 : 1;
+
+		// Texels span less of the sphere towards the corners of the faces.
+		float area = (2.0f / size) * (2.0f / size);
+
+		for (int face = 0; face < 6; face++) {
+			size_t first = (offset + face * length) / component_size / image->components;
+
+			for (int y = 0; y < size; y++) {
+				for (int x = 0; x < size; x++) {
+					float s = 2 * (x + 0.5f) / size - 1;
+					float t = 2 * (y + 0.5f) / size - 1;
+					float length_squared = 1 + s * s + t * t;
+					float weight = area / (length_squared * sqrtf(length_squared));
+
+					float direction[3];
+					ibl_texel_direction(face, x, y, size, direction);
+					add_texel(block, image, first + (size_t) y * size + x, direction, weight, sums);
+				}
+			}
+		}
+	} else {
+		// Same mapping as ibl_cubemap_from_equirectangular(), rows have a constant latitude.
+		float *longitudes = malloc(2 * image->width * sizeof *longitudes);
+		if (!longitudes) {
+			free(block);
+			return false;
+		}
+
+		for (int x = 0; x < image->width; x++) {
+			float longitude = ((x + 0.5f) / image->width - 0.5f) / 0.1591f;
+			longitudes[2 * x] = cosf(longitude);
+			longitudes[2 * x + 1] = sinf(longitude);
+		}
+
+		float area = (2 * (float) M_PI / image->width) * ((float) M_PI / image->height);
+
+		for (int y = 0; y < image->height; y++) {
+			float latitude = ((y + 0.5f) / image->height - 0.5f) / 0.3183f;
+			float cos_latitude = cosf(latitude);
+			float sin_latitude = sinf(latitude);
+
+			for (int x = 0; x < image->width; x++) {
+				float direction[3] = {cos_latitude * longitudes[2 * x], sin_latitude, cos_latitude * longitudes[2 * x + 1]};
+				add_texel(block, image, (size_t) y * image->width + x, direction, area * cos_latitude, sums);
+			}
+		}
+
+		free(longitudes);
+	}
+
+	project_block(block, sums);
+	free(block);
+
+	// Basis constants squared (once for projecting, once for evaluating) times the cosine lobe of each band over pi.
+	static const double factors[IBL_SH_COUNT] = {
+		0.282095 * 0.282095,
+		0.488603 * 0.488603 * 2 / 3,
+		0.488603 * 0.488603 * 2 / 3,
+		0.488603 * 0.488603 * 2 / 3,
+		1.092548 * 1.092548 / 4,
+		1.092548 * 1.092548 / 4,
+		0.315392 * 0.315392 / 4,
+		1.092548 * 1.092548 / 4,
+		0.546274 * 0.546274 / 4,
+	};
+
+	for (int k = 0; k < IBL_SH_COUNT; k++) {
+		for (int c = 0; c < 3; c++) {
+			sh[k][c] = (float) (sums[k][c] * factors[k]);
+		}
+	}
+
+	return true;
+}
+
+// getIrradiance() of shaders/pbr.
+void ibl_irradiance_evaluate(const float sh[IBL_SH_COUNT][3], const float normal[3], float color[3]) {
+	float x = normal[0], y = normal[1], z = normal[2];
+	float basis[IBL_SH_COUNT] = {1, y, z, x, x * y, y * z, 3 * z * z - 1, x * z, x * x - y * y};
+
+	for (int c = 0; c < 3; c++) {
+		color[c] = 0;
+		for (int k = 0; k < IBL_SH_COUNT; k++) {
+			color[c] += sh[k][c] * basis[k];
+		}
+	}
+}
@@ -0,0 +1,232 @@
+#include "client.h"
+
+INCBIN(shaders_cull_main_comp, "../shaders/cull/main.comp");
+
+// What the core 4.1 headers don't know about.
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+#ifndef GL_SHADER_STORAGE_BLOCK
+#define GL_SHADER_STORAGE_BLOCK 0x92E6
+#endif
+
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+typedef void (APIENTRYP dispatch_compute_function)(GLuint groups_x, GLuint groups_y, GLuint groups_z);
+typedef void (APIENTRYP memory_barrier_function)(GLbitfield barriers);
+typedef void (APIENTRYP multi_draw_elements_indirect_function)(GLenum mode, GLenum type, const void *indirect, GLsizei draw_count, GLsizei stride);
+typedef GLuint (APIENTRYP get_program_resource_index_function)(GLuint program, GLenum interface, const GLchar *name);
+typedef void (APIENTRYP shader_storage_block_binding_function)(GLuint program, GLuint index, GLuint binding);
+
+// Work groups per dimension, the minimum every implementation supports.
+#define INDIRECT_GROUPS_MAX 65535
+
+static struct indirect {
+	bool enabled;
+
+	dispatch_compute_function dispatch_compute;
+	memory_barrier_function memory_barrier;
+	multi_draw_elements_indirect_function multi_draw_elements_indirect;
+	get_program_resource_index_function get_program_resource_index;
+	shader_storage_block_binding_function shader_storage_block_binding;
+
+	struct shader *cull_shader;
+	GLint uniform_frustum_planes;
+	GLint uniform_commands_count;
+
+	// One command and one range of instances per item of the queue, in the order of the queue.
+	struct indirect_command *commands;
+	uint32_t (*ranges)[2];
+	size_t capacity;
+
+	GLuint commands_buffer;
+	GLuint ranges_buffer;
+	GLuint indices_buffer;
+	size_t indices_capacity;
+} ind;
+
+static void bind_storage_block(GLuint program_id, const char *name, GLuint binding) {
+	GLuint block = ind.get_program_resource_index(program_id, GL_SHADER_STORAGE_BLOCK, name);
+	if (block != GL_INVALID_INDEX) {
+		ind.shader_storage_block_binding(program_id, block, binding);
+	}
+}
+
+// Commands start at their own instance indices, the base instance of a command has to be honored for that.
+// It is core since 4.2, before that (or without the extension) the field is reserved and must be zero.
+static bool base_instance_supported(void) {
+	GLint major = 0;
+	GLint minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	return major > 4 || (major == 4 && minor >= 2) || window_extension_supported("GL_ARB_base_instance");
+}
+
+bool indirect_init(void) {
+	// The material table has to be a shader storage buffer too, materials can then come from any command.
+	if (!window_extension_supported("GL_ARB_multi_draw_indirect") || !window_extension_supported("GL_ARB_compute_shader") || !base_instance_supported() || !materialmanager_storage()) {
+		return false;
+	}
+
+	ind.dispatch_compute = (dispatch_compute_function) glfwGetProcAddress("glDispatchCompute");
+	ind.memory_barrier = (memory_barrier_function) glfwGetProcAddress("glMemoryBarrier");
+	ind.multi_draw_elements_indirect = (multi_draw_elements_indirect_function) glfwGetProcAddress("glMultiDrawElementsIndirect");
+	ind.get_program_resource_index = (get_program_resource_index_function) glfwGetProcAddress("glGetProgramResourceIndex");
+	ind.shader_storage_block_binding = (shader_storage_block_binding_function) glfwGetProcAddress("glShaderStorageBlockBinding");
+	if (!ind.dispatch_compute || !ind.memory_barrier || !ind.multi_draw_elements_indirect || !ind.get_program_resource_index || !ind.shader_storage_block_binding) {
+		return false;
+	}
+
+	ind.cull_shader = shader_load_from_memory(NULL, NULL, 0, NULL, 0, shaders_cull_main_comp_data, shaders_cull_main_comp_size);
+	if (!ind.cull_shader) {
+		return false;
+	}
+
+	GLuint program_id = ind.cull_shader->program_id;
+	ind.uniform_frustum_planes = glGetUniformLocation(program_id, "u_FrustumPlanes");
+	ind.uniform_commands_count = glGetUniformLocation(program_id, "u_CommandsCount");
+	bind_storage_block(program_id, "Instances", INDIRECT_INSTANCES_BINDING);
+	bind_storage_block(program_id, "Ranges", INDIRECT_RANGES_BINDING);
+	bind_storage_block(program_id, "Commands", INDIRECT_COMMANDS_BINDING);
+	bind_storage_block(program_id, "InstanceIndices", INDIRECT_INDICES_BINDING);
+
+	glGenBuffers(1, &ind.commands_buffer);
+	glGenBuffers(1, &ind.ranges_buffer);
+	glGenBuffers(1, &ind.indices_buffer);
+
+	// The arenas read the instance indices from now on, the buffer only ever gets new storage.
+	geometry_instance_indices(ind.indices_buffer);
+
+	ind.enabled = true;
+
+	return true;
+}
+
+void indirect_fini(void) {
+	if (!ind.enabled) {
+		return;
+	}
+
+	geometry_instance_indices(0);
+
+	glDeleteBuffers(1, &ind.commands_buffer);
+	glDeleteBuffers(1, &ind.ranges_buffer);
+	glDeleteBuffers(1, &ind.indices_buffer);
+	shader_destroy(ind.cull_shader);
+
+	free(ind.commands);
+	free(ind.ranges);
+
+	ind = (struct indirect) {0};
+}
+
+bool indirect_enabled(void) {
+	return ind.enabled;
+}
+
+// The material table is a storage buffer whenever drawing is indirect, only the textures could still need binding.
+bool indirect_materials(void) {
+	return ind.enabled && texture_bindless();
+}
+
+static bool grow(size_t capacity) {
+	struct indirect_command *new_commands = realloc(ind.commands, capacity * sizeof *new_commands);
+	if (!new_commands) {
+		return false;
+	}
+
+	ind.commands = new_commands;
+
+	uint32_t (*new_ranges)[2] = realloc(ind.ranges, capacity * sizeof *new_ranges);
+	if (!new_ranges) {
+		return false;
+	}
+
+	ind.ranges = new_ranges;
+	ind.capacity = capacity;
+
+	return true;
+}
+
+// Orphans the storage of the buffer, the previous frame might still be drawing from it.
+static void upload(GLuint buffer, const void *data, size_t size) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// Commands start out without instances, culling adds the visible ones. Has to run after the instances got uploaded.
+void indirect_cull(const struct renderqueue *queue, GLuint instances_buffer, mat4 view_projection_matrix) {
+	if (queue->count == 0) {
+		return;
+	}
+
+	if (queue->count > ind.capacity && !grow(queue->capacity)) {
+		return;
+	}
+
+	size_t indices_count = 0;
+	for (size_t i = 0; i < queue->count; i++) {
+		const struct renderqueue_item *item = &queue->items[queue->order[i].item];
+		const struct geometry *geometry = item->mesh->geometry;
+
+		ind.commands[i] = (struct indirect_command) {
+			.count = geometry->indices_count,
+			.instances_count = 0,
+			.first_index = geometry->first_index,
+			.base_vertex = geometry->first_vertex,
+			.base_instance = indices_count,
+		};
+
+		ind.ranges[i][0] = item->first_instance;
+		ind.ranges[i][1] = item->instances_count;
+		indices_count += item->instances_count;
+	}
+
+	upload(ind.commands_buffer, ind.commands, queue->count * sizeof *ind.commands);
+	upload(ind.ranges_buffer, ind.ranges, queue->count * sizeof *ind.ranges);
+
+	// Only written by the culling, the storage is just made large enough.
+	if (indices_count > ind.indices_capacity) {
+		ind.indices_capacity = indices_count > ind.indices_capacity * 2 ? indices_count : ind.indices_capacity * 2;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ind.indices_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, ind.indices_capacity * sizeof (uint32_t), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	vec4 planes[6];
+	glm_frustum_planes(view_projection_matrix, planes);
+
+	glUseProgram(ind.cull_shader->program_id);
+	glUniform4fv(ind.uniform_frustum_planes, 6, planes[0]);
+	glUniform1ui(ind.uniform_commands_count, queue->count);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_INSTANCES_BINDING, instances_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_RANGES_BINDING, ind.ranges_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_COMMANDS_BINDING, ind.commands_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_INDICES_BINDING, ind.indices_buffer);
+
+	// A work group per command, spread over a second dimension past what a single one allows.
+	size_t groups_x = queue->count < INDIRECT_GROUPS_MAX ? queue->count : INDIRECT_GROUPS_MAX;
+	size_t groups_y = (queue->count + groups_x - 1) / groups_x;
+	ind.dispatch_compute(groups_x, groups_y, 1);
+
+	// The commands and the instance indices are read by the draws that follow.
+	ind.memory_barrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+// Commands are in the order of the queue, consecutive items draw at once.
+void indirect_draw(size_t first, size_t count) {
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ind.commands_buffer);
+	ind.multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *) (first * sizeof *ind.commands), count, 0);
+}
@@ -0,0 +1,224 @@
+#include "client.h"
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// A fixed pool of worker threads consuming a single FIFO queue of jobs.
+// Everything is protected by one lock, jobs are expected to be coarse (parsing a file, decoding an image, etc).
+
+#define JOBS_MAX_WORKERS 16
+
+struct job {
+	struct jobs_batch *batch;
+	job_function function;
+	void *data;
+};
+
+static struct jobs {
+	pthread_t workers[JOBS_MAX_WORKERS];
+	size_t workers_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t job_available;
+	pthread_cond_t job_finished;
+	bool stopping;
+
+	// Ring buffer of queued jobs.
+	struct job *queue;
+	size_t queue_head;
+	size_t queue_used;
+	size_t queue_capacity;
+} jobs;
+
+static size_t processor_count(void) {
+	#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	long count = info.dwNumberOfProcessors;
+	#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	#endif
+
+	return count > 0 ? count : 1;
+}
+
+// Must be called with the lock held.
+static bool queue_push(struct job job) {
+	if (jobs.queue_used == jobs.queue_capacity) {
+		size_t new_capacity = jobs.queue_capacity ? jobs.queue_capacity * 2 : 64;
+
+		struct job *new_queue = malloc(new_capacity * sizeof *new_queue);
+		if (!new_queue) {
+			return false;
+		}
+
+		// Unwrap the ring while moving it over.
+		for (size_t i = 0; i < jobs.queue_used; i++) {
+			new_queue[i] = jobs.queue[(jobs.queue_head + i) % jobs.queue_capacity];
+		}
+
+		free(jobs.queue);
+		jobs.queue = new_queue;
+		jobs.queue_head = 0;
+		jobs.queue_capacity = new_capacity;
+	}
+
+	jobs.queue[(jobs.queue_head + jobs.queue_used) % jobs.queue_capacity] = job;
+	jobs.queue_used++;
+
+	return true;
+}
+
+// Must be called with the lock held.
+static bool queue_pop(struct job *job) {
+	if (jobs.queue_used == 0) {
+		return false;
+	}
+
+	*job = jobs.queue[jobs.queue_head];
+	jobs.queue_head = (jobs.queue_head + 1) % jobs.queue_capacity;
+	jobs.queue_used--;
+
+	return true;
+}
+
+// Must be called with the lock held, releases it while the job runs.
+static void run_job(struct job job) {
+	pthread_mutex_unlock(&jobs.lock);
+	job.function(job.data);
+	pthread_mutex_lock(&jobs.lock);
+
+	job.batch->pending--;
+	pthread_cond_broadcast(&jobs.job_finished);
+}
+
+static void *worker_main(void *arg) {
+	UNUSED(arg);
+
+	pthread_mutex_lock(&jobs.lock);
+
+	while (true) {
+		struct job job;
+
+		if (queue_pop(&job)) {
+			run_job(job);
+		} else if (jobs.stopping) {
+			break;
+		} else {
+			pthread_cond_wait(&jobs.job_available, &jobs.lock);
+		}
+	}
+
+	pthread_mutex_unlock(&jobs.lock);
+
+	return NULL;
+}
+
+bool jobs_init(void) {
+	pthread_mutex_init(&jobs.lock, NULL);
+	pthread_cond_init(&jobs.job_available, NULL);
+	pthread_cond_init(&jobs.job_finished, NULL);
+
+	jobs.stopping = false;
+	jobs.queue = NULL;
+	jobs.queue_head = 0;
+	jobs.queue_used = 0;
+	jobs.queue_capacity = 0;
+
+	// Leave one core for the main thread, it helps out whenever it waits on a batch anyway.
+	size_t wanted = processor_count() - 1;
+	if (wanted < 1) {
+		wanted = 1;
+	}
+
+	if (wanted > JOBS_MAX_WORKERS) {
+		wanted = JOBS_MAX_WORKERS;
+	}
+
+	jobs.workers_count = 0;
+	for (size_t i = 0; i < wanted; i++) {
+		if (pthread_create(&jobs.workers[i], NULL, worker_main, NULL) != 0) {
+			break;
+		}
+
+		jobs.workers_count++;
+	}
+
+	return jobs.workers_count > 0;
+}
+
+void jobs_fini(void) {
+	// Workers drain the queue before exiting.
+	pthread_mutex_lock(&jobs.lock);
+	jobs.stopping = true;
+	pthread_cond_broadcast(&jobs.job_available);
+	pthread_mutex_unlock(&jobs.lock);
+
+	for (size_t i = 0; i < jobs.workers_count; i++) {
+		pthread_join(jobs.workers[i], NULL);
+	}
+
+	jobs.workers_count = 0;
+
+	free(jobs.queue);
+	jobs.queue = NULL;
+	jobs.queue_capacity = 0;
+
+	pthread_cond_destroy(&jobs.job_finished);
+	pthread_cond_destroy(&jobs.job_available);
+	pthread_mutex_destroy(&jobs.lock);
+}
+
+size_t jobs_worker_count(void) {
+	return jobs.workers_count;
+}
+
+void jobs_submit(struct jobs_batch *batch, job_function function, void *data) {
+	struct job job = {
+		.batch = batch,
+		.function = function,
+		.data = data,
+	};
+
+	pthread_mutex_lock(&jobs.lock);
+
+	batch->pending++;
+
+	// Without workers (or memory), the job simply runs right away on the calling thread.
+	if (jobs.workers_count == 0 || !queue_push(job)) {
+		run_job(job);
+	} else {
+		pthread_cond_signal(&jobs.job_available);
+	}
+
+	pthread_mutex_unlock(&jobs.lock);
+}
+
+void jobs_wait(struct jobs_batch *batch) {
+	pthread_mutex_lock(&jobs.lock);
+
+	// Rather than sleeping, help with the queue. This also makes it safe to wait from within a job.
+	while (batch->pending > 0) {
+		struct job job;
+
+		if (queue_pop(&job)) {
+			run_job(job);
+		} else {
+			pthread_cond_wait(&jobs.job_finished, &jobs.lock);
+		}
+	}
+
+	pthread_mutex_unlock(&jobs.lock);
+}
+
+bool jobs_done(struct jobs_batch *batch) {
+	pthread_mutex_lock(&jobs.lock);
+	bool done = batch->pending == 0;
+	pthread_mutex_unlock(&jobs.lock);
+
+	return done;
+}
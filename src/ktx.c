@@ -0,0 +1,124 @@
+#include "client.h"
+#include <limits.h>
+
+static const unsigned char identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+struct header {
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t layers;
+	uint32_t faces;
+	uint32_t levels;
+	uint32_t supercompression;
+};
+
+// Followed by the data format descriptor, key/value and supercompression offsets we don't need.
+#define KTX_LEVELS_OFFSET 80
+
+struct level {
+	uint64_t offset;
+	uint64_t length;
+	uint64_t uncompressed_length;
+};
+
+// Vulkan formats we can map to ours, sRGB variants included (shaders do the sRGB conversion themselves).
+static bool translate_format(uint32_t vk_format, struct texture_image *image) {
+	image->type = TEXTURE_TYPE_UNSIGNED_BYTE;
+	image->compression = TEXTURE_COMPRESSION_NONE;
+
+	switch (vk_format) {
+	    case 23: case 29: image->components = 3; return true; // R8G8B8
+	    case 37: case 43: image->components = 4; return true; // R8G8B8A8
+	    case 90: image->type = TEXTURE_TYPE_HALF_FLOAT; image->components = 3; return true; // R16G16B16_SFLOAT
+	    case 97: image->type = TEXTURE_TYPE_HALF_FLOAT; image->components = 4; return true; // R16G16B16A16_SFLOAT
+	    case 106: image->type = TEXTURE_TYPE_FLOAT; image->components = 3; return true; // R32G32B32_SFLOAT
+	    case 109: image->type = TEXTURE_TYPE_FLOAT; image->components = 4; return true; // R32G32B32A32_SFLOAT
+	    case 131: case 132: case 133: case 134: image->compression = TEXTURE_COMPRESSION_BC1; image->components = 3; return true;
+	    case 137: case 138: image->compression = TEXTURE_COMPRESSION_BC3; image->components = 4; return true;
+	    case 141: image->compression = TEXTURE_COMPRESSION_BC5; image->components = 2; return true;
+	    case 145: case 146: image->compression = TEXTURE_COMPRESSION_BC7; image->components = 4; return true;
+	    default: return false;
+	}
+}
+
+static uint32_t read_u32(const unsigned char *data) {
+	uint32_t value;
+	memcpy(&value, data, sizeof value);
+	return value;
+}
+
+bool ktx_detect(const unsigned char *data, size_t size) {
+	return size >= sizeof identifier && memcmp(data, identifier, sizeof identifier) == 0;
+}
+
+bool ktx_decode(struct texture_image *image, const unsigned char *data, size_t size) {
+	if (!ktx_detect(data, size) || size < KTX_LEVELS_OFFSET) {
+		return false;
+	}
+
+	struct header header;
+	uint32_t *fields = (uint32_t *) &header;
+	for (size_t i = 0; i < sizeof header / sizeof *fields; i++) {
+		fields[i] = read_u32(data + sizeof identifier + i * sizeof *fields);
+	}
+
+	if (header.vk_format == 0 || header.supercompression != 0) {
+		fprintf(stderr, "Supercompressed KTX2 textures (Basis Universal) need a transcoder\n");
+		return false;
+	}
+
+	if (!translate_format(header.vk_format, image)) {
+		fprintf(stderr, "Unsupported KTX2 format %u\n", header.vk_format);
+		return false;
+	}
+
+	bool cubemap = header.faces == 6 && header.width == header.height;
+	if (header.width == 0 || header.height == 0 || header.width > INT_MAX || header.height > INT_MAX || header.depth > 1 || header.layers > 1 || (header.faces != 1 && !cubemap)) {
+		fprintf(stderr, "Only 2D and cubemap KTX2 textures are supported\n");
+		return false;
+	}
+
+	// No levels means they should be generated, that is what happens to single level images anyway.
+	size_t levels = header.levels ? header.levels : 1;
+	if (levels > texture_levels_count(header.width, header.height) || KTX_LEVELS_OFFSET + levels * sizeof (struct level) > size) {
+		return false;
+	}
+
+	image->width = header.width;
+	image->height = header.height;
+	image->faces = header.faces;
+	image->levels = levels;
+	image->size = 0;
+
+	// Levels are stored coarsest first in the file, we keep them finest first. Faces are together in each level in both.
+	for (size_t i = 0; i < levels; i++) {
+		struct level level;
+		memcpy(&level, data + KTX_LEVELS_OFFSET + i * sizeof level, sizeof level);
+
+		size_t length = texture_image_level(image, i, NULL, NULL, NULL) * image->faces;
+		if (level.length != length || level.offset > size || level.length > size - level.offset) {
+			return false;
+		}
+
+		image->size += length;
+	}
+
+	image->pixels = malloc(image->size);
+	if (!image->pixels) {
+		return false;
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < levels; i++) {
+		struct level level;
+		memcpy(&level, data + KTX_LEVELS_OFFSET + i * sizeof level, sizeof level);
+
+		memcpy(image->pixels + offset, data + level.offset, level.length);
+		offset += level.length;
+	}
+
+	return true;
+}
@@ -1,11 +1,15 @@
 #include "client.h"
 #include "server.h"
+#include "tools.h"
 
 int main(int argc, char *argv[]) {
 	bool run_as_server = argc > 1 && strcmp(argv[1], "--server") == 0;
+	bool run_as_tool = argc > 1 && tools_exists(argv[1]);
 
 	if (run_as_server) {
 		return server_run();
+	} else if (run_as_tool) {
+		return tools_run(argc - 1, argv + 1);
 	} else {
 		return client_run();
 	}
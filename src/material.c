@@ -2,6 +2,7 @@
 
 void material_init(struct material *material) {
 	material->name = NULL;
+	material->id = 0;
 
 	// Mettalic/roughness.
 	glm_vec4_one(material->base_color_factor);
@@ -25,47 +26,55 @@ void material_fini(struct material *material) {
 	free(material->name);
 
 	if (material->base_color_texture) {
-		texture_fini(material->base_color_texture);
+		texturemanager_unload_texture(material->base_color_texture);
 	}
 
 	if (material->metallic_roughness_texture) {
-		texture_fini(material->metallic_roughness_texture);
+		texturemanager_unload_texture(material->metallic_roughness_texture);
 	}
 
 	if (material->normal_texture) {
-		texture_fini(material->normal_texture);
+		texturemanager_unload_texture(material->normal_texture);
 	}
 
 	if (material->occlusion_texture) {
-		texture_fini(material->occlusion_texture);
+		texturemanager_unload_texture(material->occlusion_texture);
 	}
 
 	if (material->emissive_texture) {
-		texture_fini(material->emissive_texture);
+		texturemanager_unload_texture(material->emissive_texture);
 	}
 }
 
 void material_switch(const struct material *material) {
-	if (material->base_color_texture) {
-		texture_switch(material->base_color_texture);
-	}
-
-	if (material->normal_texture) {
-		texture_switch(material->normal_texture);
-	}
-
-	if (material->metallic_roughness_texture) {
-		texture_switch(material->metallic_roughness_texture);
+	// Bindless textures are in the material table already.
+	if (!texture_bindless()) {
+		if (material->base_color_texture) {
+			texture_switch(material->base_color_texture);
+		}
+
+		if (material->normal_texture) {
+			texture_switch(material->normal_texture);
+		}
+
+		if (material->metallic_roughness_texture) {
+			texture_switch(material->metallic_roughness_texture);
+		}
+
+		if (material->occlusion_texture) {
+			texture_switch(material->occlusion_texture);
+		}
+
+		if (material->emissive_texture) {
+			texture_switch(material->emissive_texture);
+		}
 	}
 
-	if (material->occlusion_texture) {
-		texture_switch(material->occlusion_texture);
-	}
-
-	if (material->emissive_texture) {
-		texture_switch(material->emissive_texture);
-	}
+	material_switch_culling(material);
+}
 
+// Only the faces that get drawn, for passes that read nothing else of the material.
+void material_switch_culling(const struct material *material) {
 	if (material->double_sided) {
 		glDisable(GL_CULL_FACE);
 	} else {
@@ -74,3 +83,71 @@ void material_switch(const struct material *material) {
 		glFrontFace(GL_CCW);
 	}
 }
+
+static uint64_t handle(struct texture *texture) {
+	return texture && texture_bindless() ? texture_handle(texture) : 0;
+}
+
+void material_uniforms_init(struct material_uniforms *uniforms, const struct material *material) {
+	*uniforms = (struct material_uniforms) {0};
+
+	glm_vec4_copy((float *) material->base_color_factor, uniforms->base_color_factor);
+	glm_vec3_copy((float *) material->emissive_factor, uniforms->emissive_factor);
+	uniforms->normal_scale = material->normal_scale;
+	uniforms->metallic_factor = material->metallic_factor;
+	uniforms->roughness_factor = material->roughness_factor;
+	uniforms->occlusion_strength = material->occlusion_strength;
+
+	uniforms->base_color_texture = handle(material->base_color_texture);
+	uniforms->metallic_roughness_texture = handle(material->metallic_roughness_texture);
+	uniforms->normal_texture = handle(material->normal_texture);
+	uniforms->occlusion_texture = handle(material->occlusion_texture);
+	uniforms->emissive_texture = handle(material->emissive_texture);
+}
+
+uint64_t material_hash(const struct material *material) {
+	uint64_t hash = UTILS_HASH_SEED;
+
+	// Field by field, because the padding bytes of the structure are not guaranteed to be zeroed.
+	#define HASH_FIELD(field) hash = utils_hash(&material->field, sizeof material->field, hash)
+
+	if (material->name) {
+		hash = utils_hash(material->name, strlen(material->name), hash);
+	}
+
+	HASH_FIELD(base_color_factor);
+	HASH_FIELD(base_color_texture);
+	HASH_FIELD(metallic_roughness_texture);
+	HASH_FIELD(metallic_factor);
+	HASH_FIELD(roughness_factor);
+	HASH_FIELD(normal_texture);
+	HASH_FIELD(normal_scale);
+	HASH_FIELD(occlusion_texture);
+	HASH_FIELD(occlusion_strength);
+	HASH_FIELD(emissive_texture);
+	HASH_FIELD(emissive_factor);
+	HASH_FIELD(double_sided);
+
+	#undef HASH_FIELD
+
+	return hash;
+}
+
+bool material_equal(const struct material *a, const struct material *b) {
+	// Textures are shared by the texture manager, comparing pointers is comparing images.
+	bool same_name = a->name == b->name || (a->name && b->name && strcmp(a->name, b->name) == 0);
+
+	return same_name
+	       && glm_vec4_eqv(a->base_color_factor, b->base_color_factor)
+	       && a->base_color_texture == b->base_color_texture
+	       && a->metallic_roughness_texture == b->metallic_roughness_texture
+	       && a->metallic_factor == b->metallic_factor
+	       && a->roughness_factor == b->roughness_factor
+	       && a->normal_texture == b->normal_texture
+	       && a->normal_scale == b->normal_scale
+	       && a->occlusion_texture == b->occlusion_texture
+	       && a->occlusion_strength == b->occlusion_strength
+	       && a->emissive_texture == b->emissive_texture
+	       && glm_vec3_eqv(a->emissive_factor, b->emissive_factor)
+	       && a->double_sided == b->double_sided;
+}
@@ -0,0 +1,253 @@
+#include "client.h"
+
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+#ifndef GL_SHADER_STORAGE_BLOCK
+#define GL_SHADER_STORAGE_BLOCK 0x92E6
+#endif
+
+typedef GLuint (APIENTRYP get_program_resource_index_function)(GLuint program, GLenum interface, const GLchar *name);
+typedef void (APIENTRYP shader_storage_block_binding_function)(GLuint program, GLuint index, GLuint binding);
+
+// Materials are shared between every mesh (of any model) describing the same material.
+// Since textures are themselves shared, two materials using the same images end up with the same texture pointers.
+// Each material also gets a small integer ID, stable for as long as the material lives and re-used afterwards.
+// IDs index the material table on the GPU, shaders only need the ID of the material to draw with.
+
+struct entry {
+	uint64_t hash;
+	struct material *material; // Has to stay a pointer for address stability (we hand off these pointers).
+	size_t uses;
+};
+
+static struct materialmanager {
+	struct entry *entries;
+	size_t used;
+	size_t capacity;
+
+	// IDs given back by unloaded materials, handed out again before new ones.
+	uint32_t *free_ids;
+	size_t free_ids_count;
+	uint32_t next_id;
+
+	// Material table, `table` holds what was last uploaded to `table_buffer` (see materialmanager_update()).
+	struct material_uniforms *table;
+	size_t table_capacity;
+	GLuint table_buffer;
+	GLuint table_texture; // Buffer texture of the table, without shader storage buffers.
+
+	bool storage;
+	get_program_resource_index_function get_program_resource_index;
+	shader_storage_block_binding_function shader_storage_block_binding;
+} mtm;
+
+static uint32_t allocate_id(void) {
+	if (mtm.free_ids_count > 0) {
+		return mtm.free_ids[--mtm.free_ids_count];
+	}
+
+	return mtm.next_id++;
+}
+
+static void release_id(uint32_t id) {
+	uint32_t *new_free_ids = realloc(mtm.free_ids, (mtm.free_ids_count + 1) * sizeof *mtm.free_ids);
+	if (!new_free_ids) {
+		return; // That ID is lost, not the end of the world.
+	}
+
+	mtm.free_ids = new_free_ids;
+	mtm.free_ids[mtm.free_ids_count++] = id;
+}
+
+// Takes ownership of the material description (its name and texture references) in every case.
+struct material *materialmanager_load_material(struct material *material) {
+	uint64_t hash = material_hash(material);
+
+	// Ensure the entry doesn't already exist.
+	for (size_t i = 0; i < mtm.used; i++) {
+		struct entry *entry = &mtm.entries[i];
+		if (entry->hash == hash && material_equal(entry->material, material)) {
+			material_fini(material);
+			entry->uses++;
+			return entry->material;
+		}
+	}
+
+	// Prepare storage for the new entry if there isn't enough space.
+	if (mtm.used == mtm.capacity) {
+		size_t new_capacity = mtm.capacity ? mtm.capacity * 2 : 16;
+
+		void *new_entries = realloc(mtm.entries, new_capacity * sizeof *mtm.entries);
+		if (!new_entries) {
+			material_fini(material);
+			return NULL;
+		}
+
+		mtm.capacity = new_capacity;
+		mtm.entries = new_entries;
+	}
+
+	struct material *shared = malloc(sizeof *shared);
+	if (!shared) {
+		material_fini(material);
+		return NULL;
+	}
+
+	*shared = *material;
+	shared->id = allocate_id();
+
+	// Store the material.
+	struct entry *entry = &mtm.entries[mtm.used++];
+
+	entry->hash = hash;
+	entry->material = shared;
+	entry->uses = 1;
+
+	return shared;
+}
+
+void materialmanager_unload_material(const struct material *material) {
+	for (size_t i = 0; i < mtm.used; i++) {
+		struct entry *entry = &mtm.entries[i];
+		if (entry->material == material) {
+			entry->uses--;
+
+			// Check if this was the last usage of this entry. If so, time to cleanup.
+			if (entry->uses == 0) {
+				release_id(entry->material->id);
+				material_fini(entry->material);
+				free(entry->material);
+
+				// Replace the current entry with the last entry, unless we are the last entry.
+				bool is_last_entry = i == mtm.used - 1;
+				if (!is_last_entry) {
+					*entry = mtm.entries[mtm.used - 1];
+				}
+
+				mtm.used--;
+			}
+
+			return;
+		}
+	}
+}
+
+void materialmanager_init(void) {
+	if (window_extension_supported("GL_ARB_shader_storage_buffer_object")) {
+		mtm.get_program_resource_index = (get_program_resource_index_function) glfwGetProcAddress("glGetProgramResourceIndex");
+		mtm.shader_storage_block_binding = (shader_storage_block_binding_function) glfwGetProcAddress("glShaderStorageBlockBinding");
+		mtm.storage = mtm.get_program_resource_index && mtm.shader_storage_block_binding;
+	}
+
+	glGenBuffers(1, &mtm.table_buffer);
+
+	if (!mtm.storage) {
+		glGenTextures(1, &mtm.table_texture);
+	}
+}
+
+void materialmanager_fini(void) {
+	glDeleteBuffers(1, &mtm.table_buffer);
+	glDeleteTextures(1, &mtm.table_texture);
+	free(mtm.table);
+
+	// Materials still in use by now are leaked by their users, they go anyway.
+	for (size_t i = 0; i < mtm.used; i++) {
+		material_fini(mtm.entries[i].material);
+		free(mtm.entries[i].material);
+	}
+
+	free(mtm.entries);
+	free(mtm.free_ids);
+
+	mtm = (struct materialmanager) {0};
+}
+
+bool materialmanager_storage(void) {
+	return mtm.storage;
+}
+
+// Points the material table of the program (in use) where materialmanager_update() binds it.
+void materialmanager_program(GLuint program_id) {
+	if (mtm.storage) {
+		GLuint block = mtm.get_program_resource_index(program_id, GL_SHADER_STORAGE_BLOCK, "Materials");
+		if (block != GL_INVALID_INDEX) {
+			mtm.shader_storage_block_binding(program_id, block, MATERIALMANAGER_TABLE_BINDING);
+		}
+	} else {
+		glUniform1i(glGetUniformLocation(program_id, "u_Materials"), MATERIALMANAGER_TABLE_UNIT);
+	}
+}
+
+// Makes room in the table for every ID handed out, the new buffer starts with what the old one had.
+static bool grow_table(void) {
+	size_t new_capacity = mtm.table_capacity ? mtm.table_capacity : 64;
+	while (new_capacity < mtm.next_id) {
+		new_capacity *= 2;
+	}
+
+	struct material_uniforms *new_table = realloc(mtm.table, new_capacity * sizeof *new_table);
+	if (!new_table) {
+		return false;
+	}
+
+	memset(new_table + mtm.table_capacity, 0, (new_capacity - mtm.table_capacity) * sizeof *new_table);
+	mtm.table = new_table;
+	mtm.table_capacity = new_capacity;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mtm.table_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_capacity * sizeof *new_table, new_table, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// The buffer texture has to be told about the new storage.
+	if (!mtm.storage) {
+		glBindTexture(GL_TEXTURE_BUFFER, mtm.table_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, mtm.table_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	return true;
+}
+
+// Uploads the materials that changed and binds the table, once per frame before drawing.
+// Materials are checked every frame since streaming replaces texture objects, and with them their bindless handles.
+void materialmanager_update(void) {
+	if (mtm.next_id > mtm.table_capacity && !grow_table()) {
+		return;
+	}
+
+	if (!mtm.table_capacity) {
+		return;
+	}
+
+	size_t first = mtm.table_capacity;
+	size_t last = 0;
+
+	for (size_t i = 0; i < mtm.used; i++) {
+		const struct material *material = mtm.entries[i].material;
+
+		struct material_uniforms uniforms;
+		material_uniforms_init(&uniforms, material);
+
+		if (memcmp(&mtm.table[material->id], &uniforms, sizeof uniforms) != 0) {
+			mtm.table[material->id] = uniforms;
+			first = material->id < first ? material->id : first;
+			last = material->id + 1 > last ? material->id + 1 : last;
+		}
+	}
+
+	if (first < last) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mtm.table_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof *mtm.table, (last - first) * sizeof *mtm.table, &mtm.table[first]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	if (mtm.storage) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALMANAGER_TABLE_BINDING, mtm.table_buffer);
+	} else {
+		glActiveTexture(GL_TEXTURE0 + MATERIALMANAGER_TABLE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, mtm.table_texture);
+	}
+}
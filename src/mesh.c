@@ -1,163 +1,130 @@
 #include "client.h"
 
-bool mesh_init(struct mesh *mesh) {
-	mesh->vao = 0;
-	mesh->vbo_positions = 0;
-	mesh->vbo_normals = 0;
-	mesh->vbo_uvs = 0;
-	mesh->ebo_indices = 0;
-	mesh->vbo_tangents = 0;
-	mesh->vbo_weights = 0;
-	mesh->vbo_joints = 0;
-	mesh->vbo_colors = 0;
-
-	mesh->indices_type = 0;
+static size_t type_size(GLenum type) {
+	switch (type) {
+	    case GL_BYTE: return 1;
+	    case GL_UNSIGNED_BYTE: return 1;
+	    case GL_SHORT: return sizeof (short);
+	    case GL_UNSIGNED_SHORT: return sizeof (unsigned short);
+	    case GL_HALF_FLOAT: return 2;
+	    case GL_UNSIGNED_INT: return sizeof (unsigned int);
+	    case GL_FLOAT: return sizeof (float);
+	    default: return 0;
+	}
+}
 
-	mesh->shader = NULL;
+void mesh_layout_init(struct mesh_layout *layout) {
+	for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+		layout->attributes[i].enabled = false;
+	}
 
-	glm_mat4_identity(mesh->initial_transform);
+	for (size_t i = 0; i < MESH_STREAMS_MAX; i++) {
+		layout->strides[i] = 0;
+	}
 
-	// FIXME: Currently, each mesh has its own material, but I believe glTF is able to share common materials.
-	// If so, there should probably be a material manager of some sort.
-	material_init(&mesh->material);
+	layout->streams_count = 0;
+}
 
-	// Vertex Array Object (VAO).
-	// This contains multiple buffers and is the preferred way to change from one group of buffers to another when rendering models.
-	glGenVertexArrays(1, &mesh->vao);
+void mesh_layout_add(struct mesh_layout *layout, enum mesh_attribute attribute, size_t stream, GLint components, GLenum type, bool normalized) {
+	struct mesh_attribute_format *format = &layout->attributes[attribute];
 
-	return true;
+	format->enabled = true;
+	format->components = components;
+	format->type = type;
+	format->normalized = normalized;
+	format->stream = stream < MESH_STREAMS_MAX ? stream : MESH_STREAMS_MAX - 1;
+	format->offset = 0;
+	format->size = components * type_size(type);
 }
 
-void mesh_provide_vertices(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
+// Computes offsets and strides once all attributes have been added.
+void mesh_layout_finish(struct mesh_layout *layout) {
+	for (size_t i = 0; i < MESH_STREAMS_MAX; i++) {
+		layout->strides[i] = 0;
+	}
 
-	glGenBuffers(1, &mesh->vbo_positions);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_positions);
-	glBufferData(GL_ARRAY_BUFFER, count * 3 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_POSITION, 3, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_POSITION);
-}
+	layout->streams_count = 0;
+
+	for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+		struct mesh_attribute_format *format = &layout->attributes[i];
+		if (!format->enabled) {
+			continue;
+		}
 
-void mesh_provide_normals(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
+		// Attributes start on 4 bytes boundaries, some drivers are much slower otherwise.
+		size_t *stride = &layout->strides[format->stream];
+		format->offset = *stride;
+		*stride += (format->size + 3) & ~(size_t) 3;
 
-	glGenBuffers(1, &mesh->vbo_normals);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_normals);
-	glBufferData(GL_ARRAY_BUFFER, count * 3 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_NORMAL, 3, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_NORMAL);
+		if (format->stream + 1 > layout->streams_count) {
+			layout->streams_count = format->stream + 1;
+		}
+	}
 }
 
-void mesh_provide_uvs(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
+bool mesh_layout_equal(const struct mesh_layout *a, const struct mesh_layout *b) {
+	if (a->streams_count != b->streams_count) {
+		return false;
+	}
 
-	glGenBuffers(1, &mesh->vbo_uvs);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_uvs);
-	glBufferData(GL_ARRAY_BUFFER, count * 2 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_UV, 2, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_UV);
-}
+	for (size_t i = 0; i < a->streams_count; i++) {
+		if (a->strides[i] != b->strides[i]) {
+			return false;
+		}
+	}
 
-void mesh_provide_indices(struct mesh *mesh, const void *data, size_t count, GLenum type) {
-	mesh_switch(mesh);
+	for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+		const struct mesh_attribute_format *fa = &a->attributes[i];
+		const struct mesh_attribute_format *fb = &b->attributes[i];
 
-	// Most buffers get assigned to a shader attribute (aka shader input variables) using glVertexAttribPointer.
-	// The one exception is this indice buffer. Instead, we pass the count explicitly during the render call (glDrawElements).
+		if (fa->enabled != fb->enabled) {
+			return false;
+		}
 
-	size_t size;
-	switch (type) {
-	    case GL_BYTE: size = 1; break;
-	    case GL_UNSIGNED_BYTE: size = 1; break;
-	    case GL_SHORT: size = sizeof (short); break;
-	    case GL_UNSIGNED_SHORT: size = sizeof (unsigned short); break;
-	    case GL_UNSIGNED_INT: size = sizeof (unsigned int); break;
-	    default:
-		    fprintf(stderr, "Unsupported type for indices\n");
-		    return;
+		bool same = !fa->enabled || (fa->components == fb->components && fa->type == fb->type && fa->normalized == fb->normalized && fa->stream == fb->stream && fa->offset == fb->offset);
+		if (!same) {
+			return false;
+		}
 	}
 
-	glGenBuffers(1, &mesh->ebo_indices);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo_indices);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * size, data, GL_STATIC_DRAW);
-	mesh->indices_count = count;
+	return true;
 }
 
-void mesh_provide_tangents(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
-
-	glGenBuffers(1, &mesh->vbo_tangents);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_tangents);
-	glBufferData(GL_ARRAY_BUFFER, count * 4 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_TANGENT, 4, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_TANGENT);
-}
+bool mesh_init(struct mesh *mesh) {
+	mesh->geometry = NULL;
+	mesh_layout_init(&mesh->layout);
 
-void mesh_provide_weights(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
+	mesh->shader = NULL;
 
-	glGenBuffers(1, &mesh->vbo_weights);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_weights);
-	glBufferData(GL_ARRAY_BUFFER, count * 4 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_WEIGHTS, 4, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_WEIGHTS);
-}
+	glm_mat4_identity(mesh->initial_transform);
+	glm_vec4_copy((vec4) {0, 0, 0, -1}, mesh->bounds);
 
-void mesh_provide_joints(struct mesh *mesh, const float *data, size_t count, size_t stride) {
-	mesh_switch(mesh);
+	// Provided later on, materials are shared between meshes.
+	mesh->material = NULL;
 
-	glGenBuffers(1, &mesh->vbo_joints);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_joints);
-	glBufferData(GL_ARRAY_BUFFER, count * 4 * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_JOINTS, 4, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_JOINTS);
+	return true;
 }
 
-void mesh_provide_colors(struct mesh *mesh, const float *data, size_t count, size_t stride, int components) {
-	mesh_switch(mesh);
+// Each stream holds vertices_count vertices, interleaved according to the layout (see mesh_layout_finish).
+// A single buffer for all attributes gives much better vertex fetch locality than one buffer per attribute.
+// Indices are relative to the first vertex of the mesh.
+bool mesh_provide_geometry(struct mesh *mesh, const struct mesh_layout *layout, const void *const *streams, size_t vertices_count, const uint32_t *indices, size_t indices_count) {
+	mesh->layout = *layout;
+	mesh->geometry = geometry_create(layout, streams, vertices_count, indices, indices_count);
 
-	glGenBuffers(1, &mesh->vbo_colors);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo_colors);
-	glBufferData(GL_ARRAY_BUFFER, count * components * sizeof (float), data, GL_STATIC_DRAW);
-	glVertexAttribPointer(MESH_ATTRIBUTE_COLORS, components, GL_FLOAT, false, stride, 0);
-	glEnableVertexAttribArray(MESH_ATTRIBUTE_COLORS);
-}
-
-void mesh_switch(const struct mesh *mesh) {
-	glBindVertexArray(mesh->vao);
-	material_switch(&mesh->material);
+	return mesh->geometry != NULL;
 }
 
 void mesh_fini(struct mesh *mesh) {
-	material_fini(&mesh->material);
-
-	shader_destroy(mesh->shader);
-
-	glDeleteBuffers(1, &mesh->vbo_positions);
-	glDeleteBuffers(1, &mesh->ebo_indices);
-
-	if (mesh->vbo_normals) {
-		glDeleteBuffers(1, &mesh->vbo_normals);
+	if (mesh->material) {
+		materialmanager_unload_material(mesh->material);
 	}
 
-	if (mesh->vbo_normals) {
-		glDeleteBuffers(1, &mesh->vbo_uvs);
+	if (mesh->shader) {
+		shadermanager_unload_shader(mesh->shader);
 	}
 
-	if (mesh->vbo_tangents) {
-		glDeleteBuffers(1, &mesh->vbo_tangents);
+	if (mesh->geometry) {
+		geometry_destroy(mesh->geometry);
 	}
-
-	if (mesh->vbo_weights) {
-		glDeleteBuffers(1, &mesh->vbo_weights);
-	}
-
-	if (mesh->vbo_joints) {
-		glDeleteBuffers(1, &mesh->vbo_joints);
-	}
-
-	if (mesh->vbo_colors) {
-		glDeleteBuffers(1, &mesh->vbo_colors);
-	}
-
-	glDeleteVertexArrays(1, &mesh->vao);
 }
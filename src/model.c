@@ -3,104 +3,126 @@
 INCBIN(shaders_pbr_main_vert, "../shaders/pbr/main.vert");
 INCBIN(shaders_pbr_main_frag, "../shaders/pbr/main.frag");
 
-static void apply_material_to_mesh(const cgltf_data *gltf, const cgltf_material *material, struct mesh *mesh, struct shader_options *options) {
-	mesh->material.name = strdup(material->name);
+// Loading happens in two stages.
+// The import stage parses the glTF file, decodes its images and prepares GPU-ready geometry. It never touches OpenGL and can run on worker threads.
+// The result is baked next to the glTF file (see bake.h), later imports simply map it.
+// The upload stage then creates the meshes, textures and shaders on the main thread, a few primitives at a time.
+
+static const unsigned char *image_data(const cgltf_data *gltf, const cgltf_image *image, size_t *size) {
+	const cgltf_buffer_view *view = image->buffer_view;
+	if (!view) {
+		return NULL;
+	}
+
+	const unsigned char *base = view->buffer->data ? view->buffer->data : gltf->bin;
+	if (!base) {
+		return NULL;
+	}
 
+	*size = view->size;
+	return base + view->offset;
+}
+
+static void collect_material_options(const cgltf_material *material, struct shader_options *options) {
 	// Metallic/roughness workflow (optional).
 	if (material->has_pbr_metallic_roughness) {
 		const cgltf_pbr_metallic_roughness *mr = &material->pbr_metallic_roughness;
 
 		options->material_metallicroughness = true;
+		options->has_base_color_map = mr->base_color_texture.texture != NULL;
+		options->has_metallic_roughness_map = mr->metallic_roughness_texture.texture != NULL;
+	}
 
-		// Base color factor.
-		glm_vec3_copy(mr->base_color_factor, mesh->material.base_color_factor);
-
-		// Base color texture (optional).
-		if (mr->base_color_texture.texture) {
-			options->has_base_color_map = true;
-
-			struct texture *texture = malloc(sizeof *texture);
-			texture_init_from_memory(texture, TEXTURE_KIND_ALBEDO,
-				gltf->bin + mr->base_color_texture.texture->image->buffer_view->offset,
-				mr->base_color_texture.texture->image->buffer_view->size
-			);
-
-			mesh->material.base_color_texture = texture;
-		}
-
-		// Metallic/roughness texture (optional).
-		if (mr->metallic_roughness_texture.texture) {
-			options->has_metallic_roughness_map = true;
+	options->has_normal_map = material->normal_texture.texture != NULL;
+	options->has_occlusion_map = material->occlusion_texture.texture != NULL;
+	options->has_emissive_map = material->emissive_texture.texture != NULL;
 
-			struct texture *texture = malloc(sizeof *texture);
-			texture_init_from_memory(texture, TEXTURE_KIND_METALLIC_ROUGHNESS,
-				gltf->bin + mr->metallic_roughness_texture.texture->image->buffer_view->offset,
-				mr->metallic_roughness_texture.texture->image->buffer_view->size
-			);
+	// Extensions.
+	for (size_t i = 0; i < material->extensions_count; i++) {
+		cgltf_extension *extension = &material->extensions[i];
 
-			mesh->material.metallic_roughness_texture = texture;
+		// Unlit extension.
+		if (strcmp(extension->name, "KHR_materials_unlit") == 0) {
+			options->material_unlit = true;
 		}
-
-		// Metallic factor.
-		mesh->material.metallic_factor = mr->metallic_factor;
-
-		// Roughness factor.
-		mesh->material.roughness_factor = mr->roughness_factor;
 	}
+}
 
-	// Normal texture (optional).
-	if (material->normal_texture.texture) {
-		options->has_normal_map = true;
-
-		struct texture *texture = malloc(sizeof *texture);
-		texture_init_from_memory(texture, TEXTURE_KIND_NORMAL,
-			gltf->bin + material->normal_texture.texture->image->buffer_view->offset,
-			material->normal_texture.texture->image->buffer_view->size
-		);
+// Textures using KHR_texture_basisu usually have a fallback image, we prefer it since we can't transcode Basis Universal.
+static int32_t image_index(const cgltf_data *gltf, const cgltf_texture_view *view) {
+	if (!view->texture) {
+		return -1;
+	}
 
-		mesh->material.normal_texture = texture;
+	if (view->texture->image) {
+		return view->texture->image - gltf->images;
 	}
 
-	// Occlusion texture (optional).
-	if (material->occlusion_texture.texture) {
-		options->has_occlusion_map = true;
+	return view->texture->has_basisu && view->texture->basisu_image ? view->texture->basisu_image - gltf->images : -1;
+}
 
-		struct texture *texture = malloc(sizeof *texture);
-		texture_init_from_memory(texture, TEXTURE_KIND_OCCLUSION,
-			gltf->bin + material->occlusion_texture.texture->image->buffer_view->offset,
-			material->occlusion_texture.texture->image->buffer_view->size
-		);
+static bool resolve_material(const cgltf_data *gltf, const cgltf_material *material, struct model_import_material *resolved) {
+	resolved->name = NULL;
+	glm_vec4_one(resolved->base_color_factor);
+	resolved->metallic_factor = 1;
+	resolved->roughness_factor = 1;
+	glm_vec3_zero(resolved->emissive_factor);
 
-		mesh->material.occlusion_texture = texture;
+	for (size_t i = 0; i < MODEL_MATERIAL_TEXTURES; i++) {
+		resolved->images[i] = -1;
 	}
 
-	// Emissive factor.
-	glm_vec3_copy(material->emissive_factor, mesh->material.emissive_factor);
-
-	// Emissive texture (optional).
-	if (material->emissive_texture.texture) {
-		options->has_emissive_map = true;
+	// Owned by the import, the glTF data doesn't outlive it.
+	if (material->name && !(resolved->name = strdup(material->name))) {
+		return false;
+	}
 
-		struct texture *texture = malloc(sizeof *texture);
-		texture_init_from_memory(texture, TEXTURE_KIND_EMISSION,
-			gltf->bin + material->emissive_texture.texture->image->buffer_view->offset,
-			material->emissive_texture.texture->image->buffer_view->size
-		);
+	// Metallic/roughness workflow (optional).
+	if (material->has_pbr_metallic_roughness) {
+		const cgltf_pbr_metallic_roughness *mr = &material->pbr_metallic_roughness;
 
-		mesh->material.emissive_texture = texture;
+		glm_vec3_copy((float *) mr->base_color_factor, resolved->base_color_factor);
+		resolved->images[TEXTURE_KIND_ALBEDO] = image_index(gltf, &mr->base_color_texture);
+		resolved->images[TEXTURE_KIND_METALLIC_ROUGHNESS] = image_index(gltf, &mr->metallic_roughness_texture);
+		resolved->metallic_factor = mr->metallic_factor;
+		resolved->roughness_factor = mr->roughness_factor;
 	}
 
-	// Double-sided.
-	mesh->material.double_sided = material->double_sided;
+	resolved->images[TEXTURE_KIND_NORMAL] = image_index(gltf, &material->normal_texture);
+	resolved->images[TEXTURE_KIND_OCCLUSION] = image_index(gltf, &material->occlusion_texture);
+	resolved->images[TEXTURE_KIND_EMISSION] = image_index(gltf, &material->emissive_texture);
+	glm_vec3_copy((float *) material->emissive_factor, resolved->emissive_factor);
+	resolved->double_sided = material->double_sided;
 
-	// Extensions.
-	for (size_t i = 0; i < material->extensions_count; i++) {
-		cgltf_extension *extension = &material->extensions[i];
+	return true;
+}
 
-		// Unlit extension.
-		if (strcmp(extension->name, "KHR_materials_unlit") == 0) {
-			options->material_unlit = true;
+static void describe_material(const struct model_import *import, const struct model_import_material *material, struct material *description) {
+	description->name = material->name ? strdup(material->name) : NULL;
+	glm_vec4_copy((float *) material->base_color_factor, description->base_color_factor);
+	description->metallic_factor = material->metallic_factor;
+	description->roughness_factor = material->roughness_factor;
+	glm_vec3_copy((float *) material->emissive_factor, description->emissive_factor);
+	description->double_sided = material->double_sided;
+
+	struct texture **textures[MODEL_MATERIAL_TEXTURES] = {
+		[TEXTURE_KIND_ALBEDO] = &description->base_color_texture,
+		[TEXTURE_KIND_NORMAL] = &description->normal_texture,
+		[TEXTURE_KIND_METALLIC_ROUGHNESS] = &description->metallic_roughness_texture,
+		[TEXTURE_KIND_OCCLUSION] = &description->occlusion_texture,
+		[TEXTURE_KIND_EMISSION] = &description->emissive_texture,
+	};
+
+	for (int kind = 0; kind < MODEL_MATERIAL_TEXTURES; kind++) {
+		int32_t index = material->images[kind];
+
+		// Images that failed to decode are simply left out.
+		if (index < 0 || (size_t) index >= import->images_count || !import->images[index].pixels) {
+			continue;
 		}
+
+		// Primitives and materials referencing the same image share the same texture.
+		*textures[kind] = texturemanager_load_texture(import->images_hashes[index], kind, &import->images[index]);
 	}
 }
 
@@ -124,94 +146,351 @@ static void accessor_extract_data_count_stride(const cgltf_data *gltf, const cgl
 	*stride = accessor->stride;
 }
 
-static void apply_attributes_to_mesh(const cgltf_data *gltf, const cgltf_primitive *primitive, struct mesh *mesh, struct shader_options *options) {
-	const void *data = NULL;
-	size_t count = 0;
-	size_t stride = 0;
+// Stream (vertex buffer) of each attribute, see struct mesh_layout.
+// Everything is interleaved into a single buffer. Giving the position a stream of its own (and everything else the other one)
+// would leave depth-only or picking passes with a tightly packed stream to fetch from.
+static const size_t attribute_streams[MESH_ATTRIBUTES_COUNT] = {
+	[MESH_ATTRIBUTE_POSITION] = 0,
+	[MESH_ATTRIBUTE_UV] = 0,
+	[MESH_ATTRIBUTE_NORMAL] = 0,
+	[MESH_ATTRIBUTE_TANGENT] = 0,
+	[MESH_ATTRIBUTE_WEIGHTS] = 0,
+	[MESH_ATTRIBUTE_JOINTS] = 0,
+	[MESH_ATTRIBUTE_COLORS] = 0,
+};
+
+static bool attribute_target(const cgltf_attribute *attribute, enum mesh_attribute *target) {
+	// Only the first set is used by the shaders.
+	if (attribute->index != 0) {
+		return false;
+	}
+
+	switch (attribute->type) {
+	    case cgltf_attribute_type_position: *target = MESH_ATTRIBUTE_POSITION; return true;
+	    case cgltf_attribute_type_normal: *target = MESH_ATTRIBUTE_NORMAL; return true;
+	    case cgltf_attribute_type_tangent: *target = MESH_ATTRIBUTE_TANGENT; return true;
+	    case cgltf_attribute_type_texcoord: *target = MESH_ATTRIBUTE_UV; return true;
+	    case cgltf_attribute_type_weights: *target = MESH_ATTRIBUTE_WEIGHTS; return true;
+	    case cgltf_attribute_type_joints: *target = MESH_ATTRIBUTE_JOINTS; return true;
+	    case cgltf_attribute_type_color: *target = MESH_ATTRIBUTE_COLORS; return true;
+	    default: return false;
+	}
+}
+
+static bool component_type_to_gl(cgltf_component_type component_type, GLenum *type) {
+	switch (component_type) {
+	    case cgltf_component_type_r_8: *type = GL_BYTE; return true;
+	    case cgltf_component_type_r_8u: *type = GL_UNSIGNED_BYTE; return true;
+	    case cgltf_component_type_r_16: *type = GL_SHORT; return true;
+	    case cgltf_component_type_r_16u: *type = GL_UNSIGNED_SHORT; return true;
+	    case cgltf_component_type_r_32u: *type = GL_UNSIGNED_INT; return true;
+	    case cgltf_component_type_r_32f: *type = GL_FLOAT; return true;
+	    default: return false;
+	}
+}
+
+// Float attributes with a compact format, see MODEL_COMPACT_VERTICES.
+static bool is_compactable(enum mesh_attribute target, const cgltf_accessor *accessor) {
+	if (!MODEL_COMPACT_VERTICES || accessor->component_type != cgltf_component_type_r_32f || accessor->normalized) {
+		return false;
+	}
+
+	switch (target) {
+	    case MESH_ATTRIBUTE_NORMAL: return accessor->type == cgltf_type_vec3;
+	    case MESH_ATTRIBUTE_TANGENT: return accessor->type == cgltf_type_vec4;
+	    case MESH_ATTRIBUTE_UV: return accessor->type == cgltf_type_vec2;
+	    case MESH_ATTRIBUTE_COLORS: return accessor->type == cgltf_type_vec3 || accessor->type == cgltf_type_vec4;
+	    default: return false;
+	}
+}
+
+// Converts an attribute to its compact format, returns the new (tightly packed) data or NULL.
+//  - Normals: octahedral encoded, 2 x snorm16 (decoded in the vertex shader).
+//  - Tangents: 4 x snorm16.
+//  - UVs: 2 x half float.
+//  - Colors: 3 or 4 x unorm8.
+static void *compact_attribute(enum mesh_attribute target, const cgltf_accessor *accessor, const void *data, size_t stride, GLint *components, GLenum *type, bool *normalized) {
+	size_t count = accessor->count;
+	int source_components = cgltf_num_components(accessor->type);
+	void *compact = NULL;
+
+	switch (target) {
+	    case MESH_ATTRIBUTE_NORMAL:
+		    if ((compact = malloc(count * 2 * sizeof (int16_t)))) {
+			    quantize_octahedral(data, stride, count, compact);
+			    *components = 2;
+			    *type = GL_SHORT;
+			    *normalized = true;
+		    }
+		    break;
+
+	    case MESH_ATTRIBUTE_TANGENT:
+		    if ((compact = malloc(count * 4 * sizeof (int16_t)))) {
+			    quantize_snorm16(data, stride, count, 4, compact);
+			    *components = 4;
+			    *type = GL_SHORT;
+			    *normalized = true;
+		    }
+		    break;
 
+	    case MESH_ATTRIBUTE_UV:
+		    if ((compact = malloc(count * 2 * sizeof (uint16_t)))) {
+			    quantize_half(data, stride, count, 2, compact);
+			    *components = 2;
+			    *type = GL_HALF_FLOAT;
+			    *normalized = false;
+		    }
+		    break;
+
+	    case MESH_ATTRIBUTE_COLORS:
+		    if ((compact = malloc(count * source_components))) {
+			    quantize_unorm8(data, stride, count, source_components, compact);
+			    *components = source_components;
+			    *type = GL_UNSIGNED_BYTE;
+			    *normalized = true;
+		    }
+		    break;
+
+	    default:
+		    break;
+	}
+
+	return compact;
+}
+
+static void collect_attribute_options(const cgltf_primitive *primitive, struct shader_options *options) {
 	for (size_t attribute_i = 0; attribute_i < primitive->attributes_count; attribute_i++) {
 		const cgltf_attribute *attribute = primitive->attributes + attribute_i;
 
 		switch (attribute->type) {
-		    case cgltf_attribute_type_position:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_vertices(mesh, data, count, stride);
-			    break;
-
 		    case cgltf_attribute_type_normal:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_normals(mesh, data, count, stride);
 			    options->has_normals = true;
 			    break;
 
-		    case cgltf_attribute_type_tangent:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_tangents(mesh, data, count, stride);
-			    options->has_tangents = true;
-			    break;
-
-		    case cgltf_attribute_type_texcoord:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_uvs(mesh, data, count, stride);
-			    options->has_uv_set1 = true;
-			    break;
-
-		    case cgltf_attribute_type_weights:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_weights(mesh, data, count, stride);
-			    options->has_weight_set1 = true;
-			    break;
+		    case cgltf_attribute_type_tangent: options->has_tangents = true; break;
+		    case cgltf_attribute_type_texcoord: options->has_uv_set1 = true; break;
+		    case cgltf_attribute_type_weights: options->has_weight_set1 = true; break;
 
 		    case cgltf_attribute_type_joints:
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_joints(mesh, data, count, stride);
 			    options->has_joint_set1 = true;
-			    options->joint_count = count;
+			    options->joint_count = attribute->data->count;
 			    break;
 
-		    case cgltf_attribute_type_color: {
-			    int components = 0;
-
+		    case cgltf_attribute_type_color:
 			    if (attribute->data->type == cgltf_type_vec3) {
 				    options->has_color_vec3 = true;
-				    components = 3;
 			    } else if (attribute->data->type == cgltf_type_vec4) {
 				    options->has_color_vec4 = true;
-				    components = 4;
-			    } else {
-				    break;
 			    }
-
-			    accessor_extract_data_count_stride(gltf, attribute->data, &data, &count, &stride);
-			    mesh_provide_colors(mesh, data, count, stride, components);
-		    }
-		    break;
+			    break;
 
 		    default:
 			    break;
 		}
 	}
+}
+
+// Reorders indices and vertices, see optimizer.h. The vertex count shrinks if some vertices were never used.
+static void optimize_geometry(const struct mesh_layout *layout, void **streams, size_t *vertices_count, uint32_t *indices, size_t indices_count) {
+	optimizer_reorder_for_cache(indices, indices_count, *vertices_count);
+
+	const struct mesh_attribute_format *position = &layout->attributes[MESH_ATTRIBUTE_POSITION];
+	if (MODEL_OPTIMIZE_OVERDRAW && position->enabled && position->type == GL_FLOAT && position->components == 3) {
+		const float *positions = (const float *) ((const char *) streams[position->stream] + position->offset);
+		optimizer_reorder_for_overdraw(indices, indices_count, positions, layout->strides[position->stream], *vertices_count, OPTIMIZER_OVERDRAW_THRESHOLD);
+	}
+
+	uint32_t *remap = malloc(*vertices_count * sizeof *remap);
+	void *remapped[MESH_STREAMS_MAX] = {0};
+	bool ok = remap != NULL;
+
+	for (size_t i = 0; i < layout->streams_count; i++) {
+		remapped[i] = calloc(*vertices_count, layout->strides[i]);
+		ok = ok && (remapped[i] || *vertices_count * layout->strides[i] == 0);
+	}
+
+	if (ok) {
+		size_t used = optimizer_reorder_for_fetch(indices, indices_count, *vertices_count, remap);
+
+		for (size_t i = 0; i < layout->streams_count; i++) {
+			optimizer_remap_vertices(remapped[i], streams[i], *vertices_count, layout->strides[i], remap);
+
+			void *previous = streams[i];
+			streams[i] = remapped[i];
+			remapped[i] = previous;
+		}
+
+		*vertices_count = used;
+	}
+
+	for (size_t i = 0; i < layout->streams_count; i++) {
+		free(remapped[i]);
+	}
+
+	free(remap);
+}
+
+// Builds the GPU-ready vertices and indices of the primitive, owned by the import.
+static bool import_geometry(const cgltf_data *gltf, const cgltf_primitive *primitive, struct model_import_primitive *ip) {
+	const void *data = NULL;
+	size_t count = 0;
+	size_t stride = 0;
+
+	// Layout.
+	// Attributes keep their glTF component types, unless they have a compact format.
+	const void *sources[MESH_ATTRIBUTES_COUNT] = {0};
+	size_t sources_strides[MESH_ATTRIBUTES_COUNT] = {0};
+	void *compacts[MESH_ATTRIBUTES_COUNT] = {0};
+	size_t vertices_count = 0;
+
+	struct mesh_layout layout;
+	mesh_layout_init(&layout);
+
+	for (size_t attribute_i = 0; attribute_i < primitive->attributes_count; attribute_i++) {
+		const cgltf_attribute *attribute = primitive->attributes + attribute_i;
+		const cgltf_accessor *accessor = attribute->data;
+
+		enum mesh_attribute target;
+		GLenum type;
+		if (!attribute_target(attribute, &target) || !accessor->buffer_view || !component_type_to_gl(accessor->component_type, &type)) {
+			continue;
+		}
+
+		GLint components = cgltf_num_components(accessor->type);
+		if (components > 4 || (target == MESH_ATTRIBUTE_COLORS && components < 3)) {
+			continue;
+		}
+
+		bool normalized = accessor->normalized;
+		accessor_extract_data_count_stride(gltf, accessor, &data, &count, &stride);
+
+		if (is_compactable(target, accessor)) {
+			compacts[target] = compact_attribute(target, accessor, data, stride, &components, &type, &normalized);
+		}
+
+		if (compacts[target]) {
+			sources[target] = compacts[target];
+			sources_strides[target] = 0; // Tightly packed, see below.
+		} else {
+			sources[target] = data;
+			sources_strides[target] = stride;
+		}
+
+		mesh_layout_add(&layout, target, attribute_streams[target], components, type, normalized);
+
+		// All attributes of a primitive have the same count.
+		vertices_count = accessor->count;
+	}
+
+	mesh_layout_finish(&layout);
 
 	// Indices.
-	switch (primitive->indices->component_type) {
-	    case cgltf_component_type_r_8: mesh->indices_type = GL_BYTE; break;
-	    case cgltf_component_type_r_8u: mesh->indices_type = GL_UNSIGNED_BYTE; break;
-	    case cgltf_component_type_r_16: mesh->indices_type = GL_SHORT; break;
-	    case cgltf_component_type_r_16u: mesh->indices_type = GL_UNSIGNED_SHORT; break;
-	    case cgltf_component_type_r_32u: mesh->indices_type = GL_UNSIGNED_INT; break;
-	    default:
-		    fprintf(stderr, "Unsupported mesh indices type\n");
-		    return;
+	// Arenas only hold 32-bit indices, and primitives without indices get sequential ones.
+	size_t indices_count = primitive->indices ? primitive->indices->count : vertices_count;
+	uint32_t *indices = malloc(indices_count * sizeof *indices);
+
+	if (indices && primitive->indices) {
+		accessor_extract_data_count_stride(gltf, primitive->indices, &data, &count, &stride);
+
+		for (size_t i = 0; i < count; i++) {
+			const char *index = (const char *) data + i * stride;
+
+			switch (primitive->indices->component_type) {
+			    case cgltf_component_type_r_8u: indices[i] = *(const uint8_t *) index; break;
+			    case cgltf_component_type_r_16u: indices[i] = *(const uint16_t *) index; break;
+			    case cgltf_component_type_r_32u: indices[i] = *(const uint32_t *) index; break;
+			    default: indices[i] = 0; break;
+			}
+
+			// Out of range indices would be just as wrong on the GPU, but the optimizer can't have them.
+			if (indices[i] >= vertices_count) {
+				indices[i] = 0;
+			}
+		}
+	} else if (indices) {
+		for (size_t i = 0; i < indices_count; i++) {
+			indices[i] = i;
+		}
 	}
 
-	accessor_extract_data_count_stride(gltf, primitive->indices, &data, &count, &stride);
+	// Interleaving.
+	void *streams[MESH_STREAMS_MAX] = {0};
+	bool ok = indices != NULL;
+
+	for (size_t i = 0; i < layout.streams_count; i++) {
+		// Zeroed, so that padding bytes are deterministic.
+		streams[i] = calloc(vertices_count, layout.strides[i]);
+		ok = ok && (streams[i] || vertices_count * layout.strides[i] == 0);
+	}
+
+	if (ok) {
+		for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+			const struct mesh_attribute_format *format = &layout.attributes[i];
+			if (!format->enabled) {
+				continue;
+			}
+
+			const char *source = sources[i];
+			size_t source_stride = sources_strides[i] ? sources_strides[i] : format->size;
+			char *destination = (char *) streams[format->stream] + format->offset;
+			size_t destination_stride = layout.strides[format->stream];
+
+			for (size_t vertex = 0; vertex < vertices_count; vertex++) {
+				memcpy(destination + vertex * destination_stride, source + vertex * source_stride, format->size);
+			}
+		}
+
+		if (MODEL_OPTIMIZE_GEOMETRY) {
+			optimize_geometry(&layout, streams, &vertices_count, indices, indices_count);
+		}
+
+		// Compaction can fail, normals then stay as they were.
+		ip->options.has_octahedral_normals = compacts[MESH_ATTRIBUTE_NORMAL] != NULL;
+
+		ip->layout = layout;
+		ip->vertices_count = vertices_count;
+		ip->indices = indices;
+		ip->indices_count = indices_count;
+
+		for (size_t i = 0; i < layout.streams_count; i++) {
+			ip->streams[i] = streams[i];
+		}
+	} else {
+		fprintf(stderr, "Failed to allocate the vertices of a mesh\n");
+
+		for (size_t i = 0; i < layout.streams_count; i++) {
+			free(streams[i]);
+		}
+
+		free(indices);
+	}
 
-	if (count) {
-		mesh_provide_indices(mesh, data, count, mesh->indices_type);
+	for (size_t i = 0; i < MESH_ATTRIBUTES_COUNT; i++) {
+		free(compacts[i]);
+	}
+
+	return ok;
+}
+
+// Bounding sphere around the bounding box of the positions, glTF requires their accessor to have one.
+static void find_bounds(const cgltf_primitive *primitive, vec4 bounds) {
+	glm_vec4_copy((vec4) {0, 0, 0, -1}, bounds);
+
+	for (size_t i = 0; i < primitive->attributes_count; i++) {
+		const cgltf_accessor *accessor = primitive->attributes[i].data;
+		if (primitive->attributes[i].type != cgltf_attribute_type_position || !accessor->has_min || !accessor->has_max) {
+			continue;
+		}
+
+		vec3 min = {accessor->min[0], accessor->min[1], accessor->min[2]};
+		vec3 max = {accessor->max[0], accessor->max[1], accessor->max[2]};
+
+		glm_vec3_center(min, max, bounds);
+		bounds[3] = glm_vec3_distance(min, max) / 2;
 	}
 }
 
-static void apply_transforms_to_mesh(const cgltf_data *gltf, const cgltf_node *node, struct mesh *mesh, int mesh_index, mat4 previous_transform) {
+static void find_initial_transform(const cgltf_data *gltf, const cgltf_node *node, int mesh_index, mat4 previous_transform, mat4 transform) {
 	mat4 current_transform;
 	glm_mat4_copy(previous_transform, current_transform);
 
@@ -235,52 +514,51 @@ static void apply_transforms_to_mesh(const cgltf_data *gltf, const cgltf_node *n
 
 	// Find a node corresponding to our mesh.
 	if (node->mesh == gltf->meshes + mesh_index) {
-		glm_mat4_copy(current_transform, mesh->initial_transform);
+		glm_mat4_copy(current_transform, transform);
 		return;
 	}
 
 	for (size_t i = 0; i < node->children_count; i++) {
 		cgltf_node *child = node->children[i];
-		apply_transforms_to_mesh(gltf, child, mesh, mesh_index, current_transform);
+		find_initial_transform(gltf, child, mesh_index, current_transform, transform);
 	}
 }
 
-bool load_meshes(struct model *model, const cgltf_data *gltf) {
-	size_t mesh_count = 0;
+static bool import_primitives(const cgltf_data *gltf, struct model_import *import) {
+	size_t count = 0;
 
 	// Find out how many meshes there are.
 	for (size_t i = 0; i < gltf->meshes_count; i++) {
 		for (size_t j = 0; j < gltf->meshes[i].primitives_count; j++) {
 			// But only consider meshes with triangle primitives.
 			if (gltf->meshes[i].primitives[j].type == cgltf_primitive_type_triangles) {
-				mesh_count++;
+				count++;
+			} else {
+				fprintf(stderr, "Unsupported primitives\n");
 			}
 		}
 	}
 
-	model->meshes = malloc(mesh_count * sizeof *model->meshes);
-	if (!model->meshes) {
+	import->primitives = calloc(count, sizeof *import->primitives);
+	if (count && !import->primitives) {
 		return false;
 	}
 
-	model->meshes_count = mesh_count;
-	for (size_t i = 0; i < mesh_count; i++) {
-		mesh_init(&model->meshes[i]);
-	}
+	import->primitives_count = count;
 
-	// Loading the glTF meshes into our meshes.
-	size_t final_mesh_i = 0;
+	size_t final_i = 0;
 	for (size_t mesh_i = 0; mesh_i < gltf->meshes_count; mesh_i++) {
 		for (size_t primitive_i = 0; primitive_i < gltf->meshes[mesh_i].primitives_count; primitive_i++) {
 			const cgltf_primitive *primitive = gltf->meshes[mesh_i].primitives + primitive_i;
 
 			// Only support triangle primitives.
 			if (primitive->type != cgltf_primitive_type_triangles) {
-				fprintf(stderr, "Unsupported primitives\n");
-				return false;
+				continue;
 			}
 
-			struct shader_options options = {
+			struct model_import_primitive *ip = &import->primitives[final_i++];
+
+			ip->options = (struct shader_options) {
 				.tonemap_uncharted = true,
 				.use_hdr = true,
 				.use_ibl = true,
@@ -288,71 +566,359 @@ bool load_meshes(struct model *model, const cgltf_data *gltf) {
 				// .light_count = MAX_LIGHTS,
 			};
 
-			struct mesh *mesh = &model->meshes[final_mesh_i++];
-
 			// Attributes.
-			apply_attributes_to_mesh(gltf, primitive, mesh, &options);
+			collect_attribute_options(primitive, &ip->options);
 
 			// Material (optional).
 			if (primitive->material) {
-				apply_material_to_mesh(gltf, primitive->material, mesh, &options);
+				collect_material_options(primitive->material, &ip->options);
+
+				if (!resolve_material(gltf, primitive->material, &ip->material)) {
+					return false;
+				}
+
+				ip->has_material = true;
+			}
+
+			// Vertices and indices.
+			if (!import_geometry(gltf, primitive, ip)) {
+				return false;
 			}
 
+			find_bounds(primitive, ip->bounds);
+
 			// Initial transform.
-			for (size_t i = 0; i < gltf->scene->nodes_count; i++) {
-				apply_transforms_to_mesh(gltf, gltf->scene->nodes[i], mesh, mesh_i, mesh->initial_transform);
+			glm_mat4_identity(ip->transform);
+			if (gltf->scene) {
+				for (size_t i = 0; i < gltf->scene->nodes_count; i++) {
+					find_initial_transform(gltf, gltf->scene->nodes[i], mesh_i, ip->transform, ip->transform);
+				}
 			}
 
 			// Skinning.
-			if (options.has_weight_set1 && options.has_joint_set1) {
+			if (ip->options.has_weight_set1 && ip->options.has_joint_set1) {
 				// FIXME: Enable skinning once it's supported.
-				// options.use_skinning = true;
+				// ip->options.use_skinning = true;
 			}
+		}
+	}
 
-			// Shader.
-			// TODO: Shader caching based on the #defines that it needs. Each mesh having their own shader is a bit wasteful otherwise.
-			mesh->shader = shader_load_from_memory(&options, shaders_pbr_main_vert_data, shaders_pbr_main_vert_size, shaders_pbr_main_frag_data, shaders_pbr_main_frag_size, NULL, 0);
-			if (!mesh->shader) {
-				return false;
+	return true;
+}
+
+static bool import_images(const cgltf_data *gltf, struct model_import *import) {
+	import->images = calloc(gltf->images_count, sizeof *import->images);
+	import->images_hashes = calloc(gltf->images_count, sizeof *import->images_hashes);
+	if (gltf->images_count && (!import->images || !import->images_hashes)) {
+		return false;
+	}
+
+	import->images_count = gltf->images_count;
+
+	// Kinds of textures each image is used for, as a mask.
+	unsigned *referenced = calloc(gltf->images_count, sizeof *referenced);
+	if (gltf->images_count && !referenced) {
+		return false;
+	}
+
+	// Only the images used by the primitives we kept are worth decoding.
+	for (size_t i = 0; i < import->primitives_count; i++) {
+		const struct model_import_primitive *ip = &import->primitives[i];
+
+		for (size_t j = 0; ip->has_material && j < MODEL_MATERIAL_TEXTURES; j++) {
+			if (ip->material.images[j] >= 0) {
+				referenced[ip->material.images[j]] |= 1u << j;
 			}
 		}
 	}
 
+	struct texture_decode *decodes = malloc(gltf->images_count * sizeof *decodes);
+	if (gltf->images_count && !decodes) {
+		free(referenced);
+		return false;
+	}
+
+	size_t decodes_count = 0;
+
+	for (size_t i = 0; i < gltf->images_count; i++) {
+		if (!referenced[i]) {
+			continue;
+		}
+
+		size_t size = 0;
+		const unsigned char *data = image_data(gltf, &gltf->images[i], &size);
+		if (!data) {
+			fprintf(stderr, "Unable to find image %zu\n", i);
+			continue;
+		}
+
+		import->images_hashes[i] = utils_hash(data, size, UTILS_HASH_SEED);
+
+		// Images only used as normal maps keep two channels, the shader reconstructs Z.
+		enum texture_compression compression = TEXTURE_COMPRESSION_NONE;
+		if (MODEL_COMPRESS_TEXTURES) {
+			compression = referenced[i] == 1u << TEXTURE_KIND_NORMAL ? TEXTURE_COMPRESSION_BC5 : TEXTURE_COMPRESSION_BC1;
+		}
+
+		// Mips of color images are averaged in linear space, those of normal maps get renormalized.
+		enum texture_content content = TEXTURE_CONTENT_LINEAR;
+		if (referenced[i] & (1u << TEXTURE_KIND_ALBEDO | 1u << TEXTURE_KIND_EMISSION)) {
+			content = TEXTURE_CONTENT_SRGB;
+		} else if (referenced[i] == 1u << TEXTURE_KIND_NORMAL) {
+			content = TEXTURE_CONTENT_NORMAL;
+		}
+
+		decodes[decodes_count++] = (struct texture_decode) {
+			.data = data,
+			.size = size,
+			.image = &import->images[i],
+			.mipmaps = true,
+			.content = content,
+			.filter = MODEL_MIPMAPS_FILTER,
+			.compression = compression,
+		};
+	}
+
+	// All of them at once, in parallel.
+	texture_images_decode(decodes, decodes_count);
+
+	// A broken image isn't fatal, the materials using it go without.
+	// So do HDR images and cubemaps, materials (and baked files) only have room for 8 bit 2D ones.
+	for (size_t i = 0; i < decodes_count; i++) {
+		if (decodes[i].ok && !texture_image_is_8bit_2d(decodes[i].image)) {
+			fprintf(stderr, "Image %zu is not an 8 bit 2D image\n", (size_t) (decodes[i].image - import->images));
+			texture_image_fini(decodes[i].image);
+			decodes[i].ok = false;
+		} else if (!decodes[i].ok) {
+			fprintf(stderr, "Unable to decode image %zu\n", (size_t) (decodes[i].image - import->images));
+		}
+	}
+
+	free(decodes);
+	free(referenced);
+
 	return true;
 }
 
-struct model *model_load(const char *filepath) {
-	struct model *model = malloc(sizeof *model);
-	if (!model) {
+// Buffers embedded in the file (GLB or base64) aren't dependencies.
+static bool import_dependencies(const cgltf_data *gltf, struct model_import *import) {
+	import->dependencies = calloc(gltf->buffers_count, sizeof *import->dependencies);
+	if (gltf->buffers_count && !import->dependencies) {
+		return false;
+	}
+
+	for (size_t i = 0; i < gltf->buffers_count; i++) {
+		const char *uri = gltf->buffers[i].uri;
+		if (!uri || strncmp(uri, "data:", 5) == 0) {
+			continue;
+		}
+
+		char *path = strdup(uri);
+		if (!path) {
+			return false;
+		}
+
+		cgltf_decode_uri(path);
+		import->dependencies[import->dependencies_count++] = path;
+	}
+
+	return true;
+}
+
+static bool upload_primitive(const struct model_import *import, const struct model_import_primitive *ip, struct mesh *mesh) {
+	if (!mesh_init(mesh)) {
+		return false;
+	}
+
+	// Vertices and indices, straight from the import (or the baked file mapping).
+	if (!mesh_provide_geometry(mesh, &ip->layout, ip->streams, ip->vertices_count, ip->indices, ip->indices_count)) {
+		return false;
+	}
+
+	// Material.
+	// Meshes using the same glTF material (or none at all) share the same material, even across models.
+	struct material description;
+	material_init(&description);
+
+	if (ip->has_material) {
+		describe_material(import, &ip->material, &description);
+	}
+
+	mesh->material = materialmanager_load_material(&description);
+	if (!mesh->material) {
+		return false;
+	}
+
+	// Initial transform.
+	glm_mat4_copy((vec4 *) ip->transform, mesh->initial_transform);
+	glm_vec4_copy((float *) ip->bounds, mesh->bounds);
+
+	// Shader.
+	// Meshes needing the same #defines share the same shader.
+	mesh->shader = shadermanager_load_shader(&ip->options, shaders_pbr_main_vert_data, shaders_pbr_main_vert_size, shaders_pbr_main_frag_data, shaders_pbr_main_frag_size, NULL, 0);
+
+	return mesh->shader != NULL;
+}
+
+static struct model_import *import_gltf(const char *filepath) {
+	struct model_import *import = calloc(1, sizeof *import);
+	if (!import) {
 		return NULL;
 	}
 
+	// Map the file instead of reading it so GLB chunks and buffers are views into the page cache.
+	cgltf_options options = {
+		.file = {
+			.read = cgltf_mapped_file_read,
+			.release = cgltf_mapped_file_release,
+		},
+	};
 	cgltf_data *gltf = NULL;
-	cgltf_options options = {0};
 
 	if (cgltf_parse_file(&options, filepath, &gltf) != cgltf_result_success) {
+		free(import);
+		return NULL;
+	}
+
+	// Load file/base64 buffers.
+	bool ok = cgltf_load_buffers(&options, gltf, filepath) == cgltf_result_success;
+
+	ok = ok && import_primitives(gltf, import) && import_images(gltf, import) && import_dependencies(gltf, import);
+
+	// Everything needed has been extracted from it.
+	cgltf_free(gltf);
+
+	if (!ok) {
+		model_import_free(import);
+		return NULL;
+	}
+
+	return import;
+}
+
+struct model_import *model_import(const char *filepath) {
+	struct model_import *import = bake_read(filepath);
+	if (import) {
+		return import;
+	}
+
+	import = import_gltf(filepath);
+
+	// Not fatal, the next import will simply have to go through the glTF file again.
+	if (import && !bake_write(filepath, import)) {
+		fprintf(stderr, "Unable to bake %s\n", filepath);
+	}
+
+	return import;
+}
+
+void model_import_free(struct model_import *import) {
+	// Everything points into the mapping, only the tables are owned.
+	if (import->mapping) {
+		cache_unmap(import->mapping, import->mapping_size);
+	} else {
+		for (size_t i = 0; i < import->images_count; i++) {
+			texture_image_fini(&import->images[i]);
+		}
+
+		for (size_t i = 0; i < import->primitives_count; i++) {
+			struct model_import_primitive *ip = &import->primitives[i];
+
+			for (size_t j = 0; j < MESH_STREAMS_MAX; j++) {
+				free((void *) ip->streams[j]);
+			}
+
+			free((void *) ip->indices);
+			free((void *) ip->material.name);
+		}
+
+		for (size_t i = 0; i < import->dependencies_count; i++) {
+			free((void *) import->dependencies[i]);
+		}
+	}
+
+	free(import->images);
+	free(import->images_hashes);
+	free(import->primitives);
+	free(import->dependencies);
+	free(import);
+}
+
+struct model *model_create(const char *filepath) {
+	struct model *model = malloc(sizeof *model);
+	if (!model) {
+		return NULL;
+	}
+
+	// Model name is the filepath for now.
+	model->filepath = strdup(filepath);
+	if (!model->filepath) {
 		free(model);
 		return NULL;
 	}
 
 	model->meshes = NULL;
 	model->meshes_count = 0;
+	model->state = MODEL_STATE_LOADING;
 
-	// Model name is the filepath for now.
-	model->filepath = strdup(filepath);
+	return model;
+}
 
-	// Load file/base64 buffers.
-	if (cgltf_load_buffers(&options, gltf, filepath) != cgltf_result_success) {
-		cgltf_free(gltf);
-		free(model);
+bool model_upload(struct model *model, const struct model_import *import, double deadline) {
+	if (model->state != MODEL_STATE_LOADING) {
+		return true;
+	}
+
+	if (!model->meshes && import->primitives_count > 0) {
+		model->meshes = malloc(import->primitives_count * sizeof *model->meshes);
+		if (!model->meshes) {
+			model->state = MODEL_STATE_FAILED;
+			return true;
+		}
+	}
+
+	// Always make some progress, even when the deadline has already passed.
+	size_t uploaded = 0;
+
+	while (model->meshes_count < import->primitives_count) {
+		if (uploaded > 0 && glfwGetTime() >= deadline) {
+			return false;
+		}
+
+		struct mesh *mesh = &model->meshes[model->meshes_count];
+		bool ok = upload_primitive(import, &import->primitives[model->meshes_count], mesh);
+
+		// Counted even when it failed, the mesh still has to be cleaned up.
+		model->meshes_count++;
+		uploaded++;
+
+		if (!ok) {
+			model->state = MODEL_STATE_FAILED;
+			return true;
+		}
+	}
+
+	model->state = MODEL_STATE_READY;
+
+	return true;
+}
+
+struct model *model_load(const char *filepath) {
+	struct model_import *import = model_import(filepath);
+	if (!import) {
 		return NULL;
 	}
 
-	bool loaded = load_meshes(model, gltf);
+	struct model *model = model_create(filepath);
+	if (!model) {
+		model_import_free(import);
+		return NULL;
+	}
 
-	cgltf_free(gltf);
+	model_upload(model, import, DBL_MAX);
+	model_import_free(import);
 
-	if (!loaded) {
+	if (model->state != MODEL_STATE_READY) {
 		model_destroy(model);
 		return NULL;
 	}
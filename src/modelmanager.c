@@ -6,28 +6,90 @@ struct entry {
 	size_t uses;
 };
 
+// A model getting imported on a worker thread, then uploaded over the next frames by modelmanager_update().
+struct pending {
+	struct model *model;
+	struct model_import *import; // Written by the worker, only read once the batch is done.
+	struct jobs_batch batch;
+	bool abandoned; // Nobody uses the model anymore, it gets destroyed as soon as the worker is done with it.
+};
+
 struct modelmanager {
 	struct entry *entries;
 	size_t used;
 	size_t capacity;
+
+	struct pending **pendings; // Pointers, the workers hold on to them.
+	size_t pendings_count;
 } mm;
 
-struct model *modelmanager_load_model(const char *filepath) {
-	// Ensure the entry doesn't already exist.
+static void import_job(void *data) {
+	struct pending *pending = data;
+	pending->import = model_import(pending->model->filepath);
+}
+
+static struct entry *find_entry(const char *filepath) {
 	for (size_t i = 0; i < mm.used; i++) {
 		struct entry *entry = &mm.entries[i];
 		if (strcmp(entry->filepath, filepath) == 0) {
-			entry->uses++;
-			return entry->model;
+			return entry;
 		}
 	}
 
-	// Load the model.
-	struct model *model = model_load(filepath);
-	if (!model) {
+	return NULL;
+}
+
+static struct pending *find_pending(const struct model *model) {
+	for (size_t i = 0; i < mm.pendings_count; i++) {
+		if (mm.pendings[i]->model == model) {
+			return mm.pendings[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void remove_pending(struct pending *pending) {
+	for (size_t i = 0; i < mm.pendings_count; i++) {
+		if (mm.pendings[i] == pending) {
+			mm.pendings[i] = mm.pendings[mm.pendings_count - 1];
+			mm.pendings_count--;
+			break;
+		}
+	}
+
+	if (pending->import) {
+		model_import_free(pending->import);
+	}
+
+	free(pending);
+}
+
+// Returns whether the pending model is done with (successfully or not). Must only be called once its batch is done.
+static bool progress_pending(struct pending *pending, double deadline) {
+	if (pending->abandoned) {
+		model_destroy(pending->model);
+		return true;
+	}
+
+	if (!pending->import) {
+		fprintf(stderr, "Unable to load model %s\n", pending->model->filepath);
+		pending->model->state = MODEL_STATE_FAILED;
+		return true;
+	}
+
+	if (!model_upload(pending->model, pending->import, deadline)) {
 		return false;
 	}
 
+	if (pending->model->state == MODEL_STATE_FAILED) {
+		fprintf(stderr, "Unable to upload model %s\n", pending->model->filepath);
+	}
+
+	return true;
+}
+
+static struct entry *add_entry(const char *filepath, struct model *model) {
 	// Prepare storage for the new entry if there isn't enough space.
 	if (mm.used == mm.capacity) {
 		size_t new_capacity = mm.capacity + 1;
@@ -41,16 +103,120 @@ struct model *modelmanager_load_model(const char *filepath) {
 		mm.entries = new_entries;
 	}
 
+	char *filepath_copy = strdup(filepath);
+	if (!filepath_copy) {
+		return NULL;
+	}
+
 	// Store the model.
 	struct entry *entry = &mm.entries[mm.used++];
 
 	entry->uses = 1;
 	entry->model = model;
-	entry->filepath = strdup(filepath);
+	entry->filepath = filepath_copy;
+
+	return entry;
+}
+
+struct model *modelmanager_load_model(const char *filepath) {
+	// Ensure the entry doesn't already exist.
+	struct entry *entry = find_entry(filepath);
+	if (entry) {
+		// Someone asked for it asynchronously before, but this caller can't wait, finish it right away.
+		struct pending *pending = find_pending(entry->model);
+		if (pending) {
+			jobs_wait(&pending->batch);
+			progress_pending(pending, DBL_MAX);
+			remove_pending(pending);
+		}
+
+		entry->uses++;
+		return entry->model;
+	}
+
+	// Load the model.
+	struct model *model = model_load(filepath);
+	if (!model) {
+		return NULL;
+	}
+
+	if (!add_entry(filepath, model)) {
+		model_destroy(model);
+		return NULL;
+	}
 
 	return model;
 }
 
+struct model *modelmanager_load_model_async(const char *filepath) {
+	// Ensure the entry doesn't already exist.
+	struct entry *entry = find_entry(filepath);
+	if (entry) {
+		entry->uses++;
+		return entry->model;
+	}
+
+	// An empty model is handed out right away, it becomes ready once modelmanager_update() is done uploading it.
+	struct model *model = model_create(filepath);
+	if (!model) {
+		return NULL;
+	}
+
+	struct pending *pending = malloc(sizeof *pending);
+	if (!pending) {
+		model_destroy(model);
+		return NULL;
+	}
+
+	struct pending **new_pendings = realloc(mm.pendings, (mm.pendings_count + 1) * sizeof *mm.pendings);
+	if (!new_pendings) {
+		free(pending);
+		model_destroy(model);
+		return NULL;
+	}
+
+	mm.pendings = new_pendings;
+
+	if (!add_entry(filepath, model)) {
+		free(pending);
+		model_destroy(model);
+		return NULL;
+	}
+
+	pending->model = model;
+	pending->import = NULL;
+	pending->batch = (struct jobs_batch) {0};
+	pending->abandoned = false;
+
+	mm.pendings[mm.pendings_count++] = pending;
+
+	// Parsing, buffer loading and image decoding all happen on a worker.
+	jobs_submit(&pending->batch, import_job, pending);
+
+	return model;
+}
+
+void modelmanager_update(double budget) {
+	double deadline = glfwGetTime() + budget;
+
+	for (size_t i = 0; i < mm.pendings_count; i++) {
+		struct pending *pending = mm.pendings[i];
+
+		if (!jobs_done(&pending->batch)) {
+			continue;
+		}
+
+		if (progress_pending(pending, deadline)) {
+			remove_pending(pending);
+			i--; // The last pending took its place.
+		}
+
+		if (glfwGetTime() >= deadline) {
+			break;
+		}
+	}
+}
+
 void modelmanager_unload_model(const struct model *model) {
 	for (size_t i = 0; i < mm.used; i++) {
 		struct entry *entry = &mm.entries[i];
@@ -59,6 +225,16 @@ void modelmanager_unload_model(const struct model *model) {
 
 			// Check if this was the last usage of this entry. If so, time to cleanup.
 			if (entry->uses == 0) {
+				// Models still loading are owned by the worker until it's done.
+				struct pending *pending = find_pending(entry->model);
+				if (pending) {
+					pending->abandoned = true;
+				} else {
+					model_destroy(entry->model);
+				}
+
+				free(entry->filepath);
+
 				// Replace the current entry with the last entry, unless we are the last entry.
 				bool is_last_entry = i == mm.used - 1;
 				if (!is_last_entry) {
@@ -67,6 +243,36 @@ void modelmanager_unload_model(const struct model *model) {
 
 				mm.used--;
 			}
+
+			return;
 		}
 	}
 }
+
+void modelmanager_fini(void) {
+	// Workers could still be using the pending models.
+	while (mm.pendings_count > 0) {
+		struct pending *pending = mm.pendings[0];
+		jobs_wait(&pending->batch);
+
+		// The others are still referenced by an entry and get destroyed below.
+		if (pending->abandoned) {
+			model_destroy(pending->model);
+		}
+
+		remove_pending(pending);
+	}
+
+	for (size_t i = 0; i < mm.used; i++) {
+		model_destroy(mm.entries[i].model);
+		free(mm.entries[i].filepath);
+	}
+
+	free(mm.entries);
+	free(mm.pendings);
+
+	mm.entries = NULL;
+	mm.used = 0;
+	mm.capacity = 0;
+	mm.pendings = NULL;
+}
@@ -0,0 +1,381 @@
+#include "client.h"
+
+// Forsyth's "Linear-Speed Vertex Cache Optimisation", with his original constants.
+// Vertices are scored by their position in a simulated LRU cache and their count of remaining triangles,
+// and the triangle emitted next is always the best scoring one around the vertices in cache.
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+#define NO_TRIANGLE SIZE_MAX
+
+static float vertex_score(int cache_position, uint32_t remaining) {
+	// Nothing left to draw with this vertex.
+	if (remaining == 0) {
+		return -1.0f;
+	}
+
+	float score = 0;
+
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			// Used by the last triangle, a fixed score so that strips aren't favored over fans.
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		} else {
+			float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cache_position - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	// Vertices with few triangles left get a boost, to get rid of lone triangles early.
+	score += FORSYTH_VALENCE_BOOST_SCALE * powf((float) remaining, -FORSYTH_VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+void optimizer_reorder_for_cache(uint32_t *indices, size_t indices_count, size_t vertices_count) {
+	size_t triangles_count = indices_count / 3;
+
+	uint32_t *remaining = calloc(vertices_count, sizeof *remaining);
+	uint32_t *offsets = malloc((vertices_count + 1) * sizeof *offsets);
+	uint32_t *adjacency = malloc(indices_count * sizeof *adjacency);
+	int *cache_positions = malloc(vertices_count * sizeof *cache_positions);
+	float *vertex_scores = malloc(vertices_count * sizeof *vertex_scores);
+	float *triangle_scores = malloc(triangles_count * sizeof *triangle_scores);
+	bool *emitted = calloc(triangles_count, sizeof *emitted);
+	uint32_t *output = malloc(indices_count * sizeof *output);
+
+	// Not worth failing the import over, the indices simply keep their order.
+	if (!remaining || !offsets || !adjacency || !cache_positions || !vertex_scores || !triangle_scores || !emitted || !output) {
+		goto cleanup;
+	}
+
+	// Triangles of each vertex.
+	for (size_t i = 0; i < triangles_count * 3; i++) {
+		remaining[indices[i]]++;
+	}
+
+	offsets[0] = 0;
+	for (size_t i = 0; i < vertices_count; i++) {
+		offsets[i + 1] = offsets[i] + remaining[i];
+		remaining[i] = 0;
+	}
+
+	for (size_t i = 0; i < triangles_count * 3; i++) {
+		uint32_t vertex = indices[i];
+		adjacency[offsets[vertex] + remaining[vertex]++] = i / 3;
+	}
+
+	for (size_t i = 0; i < vertices_count; i++) {
+		cache_positions[i] = -1;
+		vertex_scores[i] = vertex_score(-1, remaining[i]);
+	}
+
+	size_t best_triangle = NO_TRIANGLE;
+	float best_score = -FLT_MAX;
+
+	for (size_t i = 0; i < triangles_count; i++) {
+		const uint32_t *triangle = &indices[i * 3];
+		triangle_scores[i] = vertex_scores[triangle[0]] + vertex_scores[triangle[1]] + vertex_scores[triangle[2]];
+
+		if (triangle_scores[i] > best_score) {
+			best_score = triangle_scores[i];
+			best_triangle = i;
+		}
+	}
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	size_t cache_count = 0;
+	size_t cursor = 0;
+
+	for (size_t emitted_count = 0; emitted_count < triangles_count; emitted_count++) {
+		// Nothing left around the cache, continue with the next triangle not yet emitted.
+		if (best_triangle == NO_TRIANGLE) {
+			while (emitted[cursor]) {
+				cursor++;
+			}
+
+			best_triangle = cursor;
+		}
+
+		const uint32_t *triangle = &indices[best_triangle * 3];
+		memcpy(&output[emitted_count * 3], triangle, 3 * sizeof *triangle);
+		emitted[best_triangle] = true;
+
+		// Remove the triangle from the remaining ones of its vertices.
+		for (int i = 0; i < 3; i++) {
+			uint32_t vertex = triangle[i];
+			uint32_t *triangles = &adjacency[offsets[vertex]];
+
+			for (uint32_t j = 0; j < remaining[vertex]; j++) {
+				if (triangles[j] == best_triangle) {
+					triangles[j] = triangles[--remaining[vertex]];
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache, the others shift back.
+		uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+		size_t new_cache_count = 0;
+
+		for (int i = 0; i < 3; i++) {
+			new_cache[new_cache_count++] = triangle[i];
+		}
+
+		for (size_t i = 0; i < cache_count; i++) {
+			uint32_t vertex = cache[i];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+				new_cache[new_cache_count++] = vertex;
+			}
+		}
+
+		// Update scores, the vertices pushed out of the cache included.
+		for (size_t i = 0; i < new_cache_count; i++) {
+			uint32_t vertex = new_cache[i];
+			cache_positions[vertex] = i < FORSYTH_CACHE_SIZE ? (int) i : -1;
+			vertex_scores[vertex] = vertex_score(cache_positions[vertex], remaining[vertex]);
+		}
+
+		// The best triangle next is one of the ones touching the cache.
+		best_triangle = NO_TRIANGLE;
+		best_score = -FLT_MAX;
+
+		for (size_t i = 0; i < new_cache_count; i++) {
+			uint32_t vertex = new_cache[i];
+			const uint32_t *triangles = &adjacency[offsets[vertex]];
+
+			for (uint32_t j = 0; j < remaining[vertex]; j++) {
+				size_t t = triangles[j];
+				const uint32_t *other = &indices[t * 3];
+				triangle_scores[t] = vertex_scores[other[0]] + vertex_scores[other[1]] + vertex_scores[other[2]];
+
+				if (triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best_triangle = t;
+				}
+			}
+		}
+
+		cache_count = new_cache_count < FORSYTH_CACHE_SIZE ? new_cache_count : FORSYTH_CACHE_SIZE;
+		memcpy(cache, new_cache, cache_count * sizeof *cache);
+	}
+
+	memcpy(indices, output, triangles_count * 3 * sizeof *indices);
+
+cleanup:
+	free(remaining);
+	free(offsets);
+	free(adjacency);
+	free(cache_positions);
+	free(vertex_scores);
+	free(triangle_scores);
+	free(emitted);
+	free(output);
+}
+
+// Simulates a FIFO cache, returns how many of the triangle's vertices had to be transformed.
+// A vertex is still in cache if it was transformed less than cache_size transformations ago.
+static int simulate_triangle(const uint32_t *triangle, size_t cache_size, uint32_t *timestamps, uint32_t *time) {
+	int misses = 0;
+
+	for (int i = 0; i < 3; i++) {
+		uint32_t vertex = triangle[i];
+
+		if (timestamps[vertex] == 0 || *time - timestamps[vertex] >= cache_size) {
+			timestamps[vertex] = ++*time;
+			misses++;
+		}
+	}
+
+	return misses;
+}
+
+struct cluster {
+	size_t first_triangle;
+	size_t triangles_count;
+	float sort_key;
+};
+
+static int compare_clusters(const void *a, const void *b) {
+	const struct cluster *ca = a;
+	const struct cluster *cb = b;
+
+	// Descending.
+	return (ca->sort_key < cb->sort_key) - (ca->sort_key > cb->sort_key);
+}
+
+// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+// The cache optimized order is cut into clusters, at cache flushes or wherever the cluster is still about as cache friendly as the whole mesh.
+// Clusters facing away from the center of the mesh are then drawn first, as they tend to hide the others.
+void optimizer_reorder_for_overdraw(uint32_t *indices, size_t indices_count, const float *positions, size_t positions_stride, size_t vertices_count, float threshold) {
+	size_t triangles_count = indices_count / 3;
+
+	uint32_t *timestamps = calloc(vertices_count, sizeof *timestamps);
+	int *misses = malloc(triangles_count * sizeof *misses);
+	struct cluster *clusters = malloc(triangles_count * sizeof *clusters);
+	vec3 *centroids = malloc(triangles_count * sizeof *centroids);
+	vec3 *normals = malloc(triangles_count * sizeof *normals);
+	uint32_t *output = malloc(indices_count * sizeof *output);
+
+	if (!timestamps || !misses || !clusters || !centroids || !normals || !output || triangles_count == 0) {
+		goto cleanup;
+	}
+
+	uint32_t time = 0;
+	size_t total_misses = 0;
+
+	for (size_t i = 0; i < triangles_count; i++) {
+		misses[i] = simulate_triangle(&indices[i * 3], OPTIMIZER_STATS_CACHE_SIZE, timestamps, &time);
+		total_misses += misses[i];
+	}
+
+	float acmr = (float) total_misses / triangles_count;
+
+	// Clusters.
+	size_t clusters_count = 0;
+	size_t cluster_misses = 0;
+
+	for (size_t i = 0; i < triangles_count; i++) {
+		struct cluster *current = clusters_count > 0 ? &clusters[clusters_count - 1] : NULL;
+
+		bool hard_boundary = misses[i] == 3;
+		bool soft_boundary = current && misses[i] >= 2 && (float) cluster_misses / current->triangles_count <= threshold * acmr;
+
+		if (!current || hard_boundary || soft_boundary) {
+			clusters[clusters_count++] = (struct cluster) {.first_triangle = i};
+			current = &clusters[clusters_count - 1];
+			cluster_misses = 0;
+		}
+
+		current->triangles_count++;
+		cluster_misses += misses[i];
+	}
+
+	// Sort keys, from area weighted centroids and normals.
+	vec3 mesh_centroid = GLM_VEC3_ZERO_INIT;
+	float mesh_area = 0;
+
+	for (size_t i = 0; i < clusters_count; i++) {
+		const struct cluster *cluster = &clusters[i];
+		float *centroid = centroids[i];
+		float *normal = normals[i];
+		float area = 0;
+
+		glm_vec3_zero(centroid);
+		glm_vec3_zero(normal);
+
+		for (size_t t = cluster->first_triangle; t < cluster->first_triangle + cluster->triangles_count; t++) {
+			const uint32_t *triangle = &indices[t * 3];
+			const float *a = (const float *) ((const char *) positions + triangle[0] * positions_stride);
+			const float *b = (const float *) ((const char *) positions + triangle[1] * positions_stride);
+			const float *c = (const float *) ((const char *) positions + triangle[2] * positions_stride);
+
+			vec3 ab, ac, cross;
+			glm_vec3_sub((float *) b, (float *) a, ab);
+			glm_vec3_sub((float *) c, (float *) a, ac);
+			glm_vec3_cross(ab, ac, cross);
+
+			float triangle_area = glm_vec3_norm(cross) * 0.5f;
+			vec3 center = {(a[0] + b[0] + c[0]) / 3, (a[1] + b[1] + c[1]) / 3, (a[2] + b[2] + c[2]) / 3};
+
+			glm_vec3_muladds(center, triangle_area, centroid);
+			glm_vec3_add(normal, cross, normal);
+			area += triangle_area;
+		}
+
+		glm_vec3_add(mesh_centroid, centroid, mesh_centroid);
+		mesh_area += area;
+
+		glm_vec3_scale(centroid, area > 0 ? 1.0f / area : 0, centroid);
+		glm_vec3_normalize(normal);
+	}
+
+	glm_vec3_scale(mesh_centroid, mesh_area > 0 ? 1.0f / mesh_area : 0, mesh_centroid);
+
+	for (size_t i = 0; i < clusters_count; i++) {
+		vec3 direction;
+		glm_vec3_sub(centroids[i], mesh_centroid, direction);
+		clusters[i].sort_key = glm_vec3_dot(direction, normals[i]);
+	}
+
+	qsort(clusters, clusters_count, sizeof *clusters, compare_clusters);
+
+	size_t written = 0;
+	for (size_t i = 0; i < clusters_count; i++) {
+		size_t size = clusters[i].triangles_count * 3;
+		memcpy(&output[written], &indices[clusters[i].first_triangle * 3], size * sizeof *output);
+		written += size;
+	}
+
+	memcpy(indices, output, written * sizeof *indices);
+
+cleanup:
+	free(timestamps);
+	free(misses);
+	free(clusters);
+	free(centroids);
+	free(normals);
+	free(output);
+}
+
+// Vertices get numbered in the order they are first used, so that vertex fetches walk the buffers forward.
+// Unused vertices are dropped (remapped to UINT32_MAX), the new vertex count is returned.
+size_t optimizer_reorder_for_fetch(uint32_t *indices, size_t indices_count, size_t vertices_count, uint32_t *remap) {
+	for (size_t i = 0; i < vertices_count; i++) {
+		remap[i] = UINT32_MAX;
+	}
+
+	uint32_t next = 0;
+
+	for (size_t i = 0; i < indices_count; i++) {
+		uint32_t vertex = indices[i];
+
+		if (remap[vertex] == UINT32_MAX) {
+			remap[vertex] = next++;
+		}
+
+		indices[i] = remap[vertex];
+	}
+
+	return next;
+}
+
+void optimizer_remap_vertices(void *destination, const void *source, size_t vertices_count, size_t stride, const uint32_t *remap) {
+	for (size_t i = 0; i < vertices_count; i++) {
+		if (remap[i] != UINT32_MAX) {
+			memcpy((char *) destination + remap[i] * stride, (const char *) source + i * stride, stride);
+		}
+	}
+}
+
+struct optimizer_stats optimizer_analyze(const uint32_t *indices, size_t indices_count, size_t vertices_count, size_t cache_size) {
+	struct optimizer_stats stats = {0};
+	size_t triangles_count = indices_count / 3;
+
+	uint32_t *timestamps = calloc(vertices_count, sizeof *timestamps);
+
+	if (timestamps && triangles_count > 0) {
+		uint32_t time = 0;
+		size_t misses = 0;
+
+		for (size_t i = 0; i < triangles_count; i++) {
+			misses += simulate_triangle(&indices[i * 3], cache_size, timestamps, &time);
+		}
+
+		// Only the vertices actually used count for the ATVR.
+		size_t used = 0;
+		for (size_t i = 0; i < vertices_count; i++) {
+			used += timestamps[i] != 0;
+		}
+
+		stats.acmr = (float) misses / triangles_count;
+		stats.atvr = used ? (float) misses / used : 0;
+	}
+
+	free(timestamps);
+
+	return stats;
+}
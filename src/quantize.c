@@ -0,0 +1,235 @@
+#include "client.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Inputs are strided, so they are first gathered into small contiguous blocks.
+// Conversions then run over plain arrays of floats, 4 at a time when SSE2 is available.
+#define QUANTIZE_BLOCK 256
+
+static size_t gather(const void *input, size_t stride, size_t first, size_t count, int components, float *block) {
+	size_t n = count - first < QUANTIZE_BLOCK ? count - first : QUANTIZE_BLOCK;
+
+	for (size_t i = 0; i < n; i++) {
+		memcpy(block + i * components, (const char *) input + (first + i) * stride, components * sizeof (float));
+	}
+
+	return n * components;
+}
+
+static inline float clamp(float value, float min, float max) {
+	return value < min ? min : value > max ? max : value;
+}
+
+static inline int round_to_int(float value) {
+	return (int) (value + (value >= 0 ? 0.5f : -0.5f));
+}
+
+static void floats_to_snorm16(const float *restrict input, size_t count, int16_t *restrict output) {
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 min = _mm_set1_ps(-1.0f);
+	const __m128 max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(32767.0f);
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), min), max), scale);
+		__m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), min), max), scale);
+		__m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storeu_si128((__m128i *) (output + i), packed);
+	}
+#endif
+
+	for (; i < count; i++) {
+		output[i] = (int16_t) round_to_int(clamp(input[i], -1.0f, 1.0f) * 32767.0f);
+	}
+}
+
+static void floats_to_unorm8(const float *restrict input, size_t count, uint8_t *restrict output) {
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 min = _mm_setzero_ps();
+	const __m128 max = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), min), max), scale);
+		__m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), min), max), scale);
+		__m128i words = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storel_epi64((__m128i *) (output + i), _mm_packus_epi16(words, words));
+	}
+#endif
+
+	for (; i < count; i++) {
+		output[i] = (uint8_t) round_to_int(clamp(input[i], 0.0f, 1.0f) * 255.0f);
+	}
+}
+
+static inline uint16_t float_to_half(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof bits);
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// NaN and infinities.
+	if (((bits >> 23) & 0xff) == 0xff) {
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+
+	// Too large, saturate to infinity.
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+
+	// Too small, either denormalized or zero.
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return sign;
+		}
+
+		mantissa |= 0x800000;
+		uint32_t shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		half += rest > halfway || (rest == halfway && (half & 1));
+		return sign | half;
+	}
+
+	// Round to nearest even, a carry into the exponent is fine.
+	uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	half += rest > 0x1000 || (rest == 0x1000 && (half & 1));
+	return half;
+}
+
+static void floats_to_half(const float *restrict input, size_t count, uint16_t *restrict output) {
+	size_t i = 0;
+
+#if defined(__F16C__)
+	for (; i + 4 <= count; i += 4) {
+		_mm_storel_epi64((__m128i *) (output + i), _mm_cvtps_ph(_mm_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT));
+	}
+#endif
+
+	for (; i < count; i++) {
+		output[i] = float_to_half(input[i]);
+	}
+}
+
+// Octahedral encoding: the unit sphere is projected onto an octahedron, which is then unfolded into a square.
+// Two components instead of three, and a much more even precision than storing x/y/z directly.
+static void octahedral_encode(const float *restrict input, size_t count, float *restrict output) {
+	for (size_t i = 0; i < count; i++) {
+		float x = input[i * 3 + 0];
+		float y = input[i * 3 + 1];
+		float z = input[i * 3 + 2];
+
+		float length = fabsf(x) + fabsf(y) + fabsf(z);
+		float inverse = length > 0 ? 1.0f / length : 0;
+		x *= inverse;
+		y *= inverse;
+
+		// Lower hemisphere, fold the triangles over the diagonals.
+		if (z < 0) {
+			float folded_x = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+			float folded_y = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+			x = folded_x;
+			y = folded_y;
+		}
+
+		output[i * 2 + 0] = x;
+		output[i * 2 + 1] = y;
+	}
+}
+
+void quantize_octahedral(const void *input, size_t stride, size_t count, int16_t *output) {
+	float block[QUANTIZE_BLOCK * 3];
+	float encoded[QUANTIZE_BLOCK * 2];
+
+	for (size_t first = 0; first < count; first += QUANTIZE_BLOCK) {
+		size_t n = gather(input, stride, first, count, 3, block) / 3;
+		octahedral_encode(block, n, encoded);
+		floats_to_snorm16(encoded, n * 2, output + first * 2);
+	}
+}
+
+void quantize_snorm16(const void *input, size_t stride, size_t count, int components, int16_t *output) {
+	float block[QUANTIZE_BLOCK * 4];
+
+	for (size_t first = 0; first < count; first += QUANTIZE_BLOCK) {
+		size_t n = gather(input, stride, first, count, components, block);
+		floats_to_snorm16(block, n, output + first * components);
+	}
+}
+
+void quantize_half(const void *input, size_t stride, size_t count, int components, uint16_t *output) {
+	float block[QUANTIZE_BLOCK * 4];
+
+	for (size_t first = 0; first < count; first += QUANTIZE_BLOCK) {
+		size_t n = gather(input, stride, first, count, components, block);
+		floats_to_half(block, n, output + first * components);
+	}
+}
+
+void quantize_unorm8(const void *input, size_t stride, size_t count, int components, uint8_t *output) {
+	float block[QUANTIZE_BLOCK * 4];
+
+	for (size_t first = 0; first < count; first += QUANTIZE_BLOCK) {
+		size_t n = gather(input, stride, first, count, components, block);
+		floats_to_unorm8(block, n, output + first * components);
+	}
+}
+
+void dequantize_octahedral(const int16_t encoded[2], float decoded[3]) {
+	float x = dequantize_snorm16(encoded[0]);
+	float y = dequantize_snorm16(encoded[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	// Same as the decoding in the vertex shader.
+	float t = z < 0 ? -z : 0;
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+
+	float length = sqrtf(x * x + y * y + z * z);
+	decoded[0] = x / length;
+	decoded[1] = y / length;
+	decoded[2] = z / length;
+}
+
+float dequantize_snorm16(int16_t value) {
+	return clamp(value / 32767.0f, -1.0f, 1.0f);
+}
+
+float dequantize_half(uint16_t value) {
+	uint32_t sign = (uint32_t) (value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+
+	if (exponent == 0) {
+		// Zero or denormalized.
+		float magnitude = mantissa / 16777216.0f; // 2^-24.
+		return sign ? -magnitude : magnitude;
+	}
+
+	uint32_t bits = exponent == 31
+		? sign | 0x7f800000 | (mantissa << 13)
+		: sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	float result;
+	memcpy(&result, &bits, sizeof result);
+	return result;
+}
+
+float dequantize_unorm8(uint8_t value) {
+	return value / 255.0f;
+}
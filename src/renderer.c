@@ -17,6 +17,9 @@ INCBIN(shaders_skybox_main_frag, "../shaders/skybox/main.frag");
 INCBIN(shaders_plain_main_vert, "../shaders/plain/main.vert");
 INCBIN(shaders_plain_main_frag, "../shaders/plain/main.frag");
 
+INCBIN(shaders_picking_main_vert, "../shaders/picking/main.vert");
+INCBIN(shaders_picking_main_frag, "../shaders/picking/main.frag");
+
 void renderer_update_projection_matrix(struct renderer *renderer) {
 	glm_mat4_identity(renderer->projection_matrix);
 	// glm_perspective_default(renderer->viewport_width / renderer->viewport_height, projection);
@@ -39,16 +42,44 @@ void renderer_init(struct renderer *renderer) {
 	renderer->exposure = 1;
 	renderer->wireframe = false;
 
+	renderqueue_init(&renderer->queue);
+
+	// Filled in at the start of every frame, see update_frame().
+	glGenBuffers(1, &renderer->frame_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, renderer->frame_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(struct shader_frame), NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &renderer->lights_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, renderer->lights_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(struct shader_lights), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Sized on first use, see upload_instances().
+	glGenBuffers(1, &renderer->instances_buffer);
+	glGenTextures(1, &renderer->instances_texture);
+	renderer->instances_capacity = 0;
+
 	renderer->plain_shader = shader_load_from_memory(NULL, shaders_plain_main_vert_data, shaders_plain_main_vert_size, shaders_plain_main_frag_data, shaders_plain_main_frag_size, NULL, 0);
 	if (!renderer->plain_shader) {
 		return;
 	}
 
+	renderer->picking_shader = shader_load_from_memory(NULL, shaders_picking_main_vert_data, shaders_picking_main_vert_size, shaders_picking_main_frag_data, shaders_picking_main_frag_size, NULL, 0);
+	if (!renderer->picking_shader) {
+		return;
+	}
+
 	renderer->mousepicking_entity_id = 0;
 }
 
 void renderer_fini(struct renderer *renderer) {
+	renderqueue_fini(&renderer->queue);
+	glDeleteBuffers(1, &renderer->frame_buffer);
+	glDeleteBuffers(1, &renderer->lights_buffer);
+	glDeleteBuffers(1, &renderer->instances_buffer);
+	glDeleteTextures(1, &renderer->instances_texture);
 	shader_destroy(renderer->plain_shader);
+	shader_destroy(renderer->picking_shader);
 }
 
 void renderer_switch(const struct renderer *new) {
@@ -82,29 +113,161 @@ void renderer_switch(const struct renderer *new) {
 	// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
-static void render_mesh(struct renderer *renderer, const struct camera *camera, const struct scene *scene, const struct entity *entity, const struct shader *shader, const struct mesh *mesh) {
-	mesh_switch(mesh);
-
-	mat4 view_projection_matrix;
-	glm_mat4_mul(renderer->projection_matrix, (vec4 *) camera->view_matrix, view_projection_matrix);
-
-	mat4 model_matrix = GLM_MAT4_IDENTITY_INIT;
+static void compute_model_matrix(const struct entity *entity, const struct mesh *mesh, mat4 model_matrix) {
+	glm_mat4_identity(model_matrix);
 
 	// Translation, rotation, scale.
 	glm_translate(model_matrix, (float *) entity->translation);
 	glm_quat_rotate(model_matrix, (float *) entity->rotation, model_matrix);
 	glm_scale(model_matrix, (vec3) { entity->scale, entity->scale, entity->scale});
 	glm_mat4_mul(model_matrix, (vec4 *) mesh->initial_transform, model_matrix);
+}
+
+// The bounding sphere of the mesh once transformed, with a negative radius when the mesh has none.
+static void compute_world_bounds(const struct mesh *mesh, mat4 model_matrix, vec4 bounds) {
+	if (mesh->bounds[3] < 0) {
+		glm_vec4(model_matrix[3], -1, bounds);
+		return;
+	}
 
-	// Uniforms.
-	shader_bind_uniform_environment(shader, scene->environment);
-	shader_bind_uniform_material(shader, &mesh->material);
-	shader_bind_uniform_camera(shader, camera);
-	shader_bind_uniform_lights(shader, scene->lights, scene->lights_count);
-	shader_bind_uniform_mvp(shader, view_projection_matrix, model_matrix, renderer->exposure);
+	glm_mat4_mulv3(model_matrix, (float *) mesh->bounds, 1, bounds);
 
-	// Render.
-	glDrawElements(GL_TRIANGLES, mesh->indices_count, mesh->indices_type, NULL);
+	vec3 scale;
+	glm_decompose_scalev(model_matrix, scale);
+	bounds[3] = mesh->bounds[3] * glm_vec3_max(scale);
+}
+
+// Asks the texture manager for the mip levels of the material's textures that match the on-screen size of the mesh.
+// That assumes the textures are mapped once over the mesh, which is close enough for streaming.
+static void request_texture_levels(const struct renderer *renderer, const struct camera *camera, const struct mesh *mesh, vec4 bounds) {
+	float diameter = renderer->viewport_height;
+
+	if (bounds[3] >= 0) {
+		// In pixels, once projected.
+		float distance = glm_vec3_distance(bounds, (float *) camera->eye);
+		if (distance > bounds[3]) {
+			diameter = bounds[3] / (distance * tanf(glm_rad(renderer->fov) / 2)) * renderer->viewport_height;
+		}
+	}
+
+	struct texture *textures[] = {
+		mesh->material->base_color_texture,
+		mesh->material->metallic_roughness_texture,
+		mesh->material->normal_texture,
+		mesh->material->occlusion_texture,
+		mesh->material->emissive_texture,
+	};
+
+	for (size_t i = 0; i < sizeof textures / sizeof *textures; i++) {
+		struct texture *texture = textures[i];
+		if (!texture) {
+			continue;
+		}
+
+		float size = texture->width > texture->height ? texture->width : texture->height;
+		float level = diameter > 1 ? log2f(size / diameter) : texture->levels;
+
+		texturemanager_request(texture, level > 0 ? (size_t) level : 0);
+	}
+}
+
+// What is bound while going through the queue, binds identical to it get skipped.
+struct render_state {
+	const struct shader *shader;
+	const struct material *material;
+	GLuint vertex_array;
+};
+
+static const struct renderqueue_item *queue_item(const struct renderqueue *queue, size_t index) {
+	return &queue->items[queue->order[index].item];
+}
+
+// Whether the items can be drawn without changing anything in between.
+static bool same_state(const struct renderqueue *queue, size_t a, size_t b) {
+	const struct renderqueue_item *first = queue_item(queue, a);
+	const struct renderqueue_item *second = queue_item(queue, b);
+
+	enum renderqueue_pass pass = renderqueue_key_pass(queue->order[a].key);
+	if (pass != renderqueue_key_pass(queue->order[b].key)
+	    || first->shader != second->shader
+	    || geometry_vertex_array(first->mesh->geometry) != geometry_vertex_array(second->mesh->geometry)) {
+		return false;
+	}
+
+	// Picking only needs the same faces culled, as do draws whose instances bring their material.
+	if (pass == RENDERQUEUE_PASS_PICKING || indirect_materials()) {
+		return first->mesh->material->double_sided == second->mesh->material->double_sided;
+	}
+
+	return first->mesh->material == second->mesh->material;
+}
+
+// Everything in the queue for the pass, starting at `first`. Returns where the next pass starts.
+static size_t render_pass(struct renderer *renderer, enum renderqueue_pass pass, size_t first) {
+	// Vertex arrays were unbound at the start of the frame, anything else might have changed since the last one.
+	struct render_state state = {0};
+
+	size_t i = first;
+	while (i < renderer->queue.count && renderqueue_key_pass(renderer->queue.order[i].key) == pass) {
+		const struct renderqueue_item *item = queue_item(&renderer->queue, i);
+		const struct mesh *mesh = item->mesh;
+		const struct shader *shader = item->shader;
+
+		// What the frame shares is in uniform buffers (see update_frame()), only material uniforms need binding again.
+		bool program_changed = shader != state.shader;
+		if (program_changed) {
+			glUseProgram(shader->program_id);
+			state.shader = shader;
+			renderer->stats.programs++;
+		}
+
+		if (pass == RENDERQUEUE_PASS_PICKING) {
+			// The picking shader reads no material, only the culled faces change.
+			if (!state.material || mesh->material->double_sided != state.material->double_sided) {
+				material_switch_culling(mesh->material);
+				state.material = mesh->material;
+			}
+		} else {
+			bool material_changed = mesh->material != state.material;
+			if (material_changed) {
+				material_switch(mesh->material);
+				state.material = mesh->material;
+				renderer->stats.materials++;
+			}
+
+			if (material_changed || program_changed) {
+				shader_bind_uniform_material(shader, mesh->material);
+			}
+		}
+
+		GLuint vertex_array = geometry_vertex_array(mesh->geometry);
+		if (vertex_array != state.vertex_array) {
+			geometry_bind(mesh->geometry);
+			state.vertex_array = vertex_array;
+			renderer->stats.vertex_arrays++;
+		}
+
+		// Culling wrote a command per item (see indirect.h), all of those sharing the state above are one draw.
+		if (indirect_enabled()) {
+			size_t end = i;
+			for (; end < renderer->queue.count && same_state(&renderer->queue, i, end); end++) {
+				renderer->stats.instances += queue_item(&renderer->queue, end)->instances_count;
+			}
+
+			indirect_draw(i, end - i);
+			renderer->stats.draws++;
+			i = end;
+			continue;
+		}
+
+		shader_bind_uniform_instances(shader, item->first_instance);
+		geometry_draw_instanced(mesh->geometry, item->instances_count);
+		renderer->stats.draws++;
+		renderer->stats.instances += item->instances_count;
+		i++;
+	}
+
+	return i;
 }
 
 static void render_skybox(const struct renderer *renderer, const struct camera *camera, const struct scene *scene) {
@@ -145,10 +308,156 @@ static void render_skybox(const struct renderer *renderer, const struct camera *
 	// glEnable(GL_CULL_FACE);
 }
 
+// Every mesh of every ready entity is an instance of the batch of that mesh.
+static void collect_instances(struct renderer *renderer, const struct camera *camera, const struct scene *scene) {
+	for (size_t i = 0; i < scene->entity_count; i++) {
+		const struct entity *entity = scene->entities[i];
+
+		// Models still loading (or that failed to) have nothing to render.
+		if (entity->model->state != MODEL_STATE_READY) {
+			continue;
+		}
+
+		vec4 picking_color;
+		entity_id_as_color(entity->id, picking_color);
+
+		for (size_t j = 0; j < entity->model->meshes_count; j++) {
+			const struct mesh *mesh = &entity->model->meshes[j];
+
+			mat4 model_matrix;
+			compute_model_matrix(entity, mesh, model_matrix);
+
+			vec4 bounds;
+			compute_world_bounds(mesh, model_matrix, bounds);
+
+			request_texture_levels(renderer, camera, mesh, bounds);
+
+			float depth = glm_vec3_distance(model_matrix[3], (float *) camera->eye);
+
+			struct renderqueue_instance *instance = renderqueue_instance(&renderer->queue, mesh, depth);
+			if (!instance) {
+				continue;
+			}
+
+			// Inverse transpose, for normals to stay perpendicular to non-uniformly scaled surfaces.
+			mat3 normal_matrix;
+			glm_mat4_pick3(model_matrix, normal_matrix);
+			glm_mat3_inv(normal_matrix, normal_matrix);
+			glm_mat3_transpose(normal_matrix);
+
+			glm_mat4_copy(model_matrix, instance->model_matrix);
+			for (size_t k = 0; k < 3; k++) {
+				glm_vec4(normal_matrix[k], 0, instance->normal_matrix[k]);
+			}
+			glm_vec4_copy(picking_color, instance->picking_color);
+			glm_vec4_copy(bounds, instance->bounds);
+			instance->material_index = mesh->material->id;
+		}
+	}
+}
+
+// Each batch goes in the queue twice, once for picking and once for real.
+static void collect(struct renderer *renderer, const struct camera *camera, const struct scene *scene) {
+	renderqueue_clear(&renderer->queue);
+	collect_instances(renderer, camera, scene);
+	renderqueue_group(&renderer->queue);
+
+	for (size_t i = 0; i < renderer->queue.batches_count; i++) {
+		const struct renderqueue_batch *batch = &renderer->queue.batches[i];
+		const struct mesh *mesh = batch->mesh;
+		GLuint vertex_array = geometry_vertex_array(mesh->geometry);
+
+		// Picking reads no material, only the culled faces tell its items apart. So do indirect draws mixing materials.
+		uint32_t material = indirect_materials() ? mesh->material->double_sided : mesh->material->id;
+
+		uint64_t keys[] = {
+			renderqueue_key(RENDERQUEUE_PASS_PICKING, renderer->picking_shader->program_id, mesh->material->double_sided, vertex_array, batch->depth),
+			renderqueue_key(RENDERQUEUE_PASS_OPAQUE, mesh->shader->program_id, material, vertex_array, batch->depth),
+		};
+
+		const struct shader *shaders[] = {renderer->picking_shader, mesh->shader};
+
+		for (size_t k = 0; k < ARRAY_COUNT(keys); k++) {
+			struct renderqueue_item *item = renderqueue_push(&renderer->queue, keys[k]);
+			if (!item) {
+				continue;
+			}
+
+			item->mesh = mesh;
+			item->shader = shaders[k];
+			item->first_instance = batch->first;
+			item->instances_count = batch->count;
+		}
+	}
+
+	renderqueue_sort(&renderer->queue);
+}
+
+// The buffer only grows, it is orphaned every frame so that drawing the last one doesn't hold the upload back.
+static void upload_instances(struct renderer *renderer) {
+	const struct renderqueue *queue = &renderer->queue;
+	size_t size = queue->instances_count * sizeof *queue->instances;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, renderer->instances_buffer);
+
+	bool grown = queue->instances_count > renderer->instances_capacity;
+	if (grown) {
+		renderer->instances_capacity = queue->instances_capacity;
+	}
+
+	glBufferData(GL_TEXTURE_BUFFER, renderer->instances_capacity * sizeof *queue->instances, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, queue->instances);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glActiveTexture(GL_TEXTURE0 + SHADER_INSTANCES_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, renderer->instances_texture);
+
+	// The buffer texture has to be told about the new storage.
+	if (grown) {
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, renderer->instances_buffer);
+	}
+}
+
+// Everything the programs share for the frame goes in the uniform buffers once, instead of into each program.
+static void update_frame(const struct renderer *renderer, const struct camera *camera, const struct scene *scene, mat4 view_projection_matrix) {
+	struct shader_frame frame;
+	shader_frame_init(&frame, view_projection_matrix, camera, scene->environment, renderer->exposure);
+
+	struct shader_lights lights;
+	shader_lights_init(&lights, scene->lights, scene->lights_count);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, renderer->frame_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof frame, &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, renderer->lights_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof lights, &lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_FRAME_BINDING, renderer->frame_buffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_LIGHTS_BINDING, renderer->lights_buffer);
+}
+
 void renderer_render(struct renderer *renderer, const struct camera *camera, const struct scene *scene) {
 	renderer_switch(renderer);
 	environment_switch(scene->environment);
 
+	// The skybox and the UI bind vertex arrays of their own.
+	geometry_unbind();
+
+	renderer->stats = (struct renderer_stats) {0};
+	collect(renderer, camera, scene);
+
+	mat4 view_projection_matrix;
+	glm_mat4_mul(renderer->projection_matrix, (vec4 *) camera->view_matrix, view_projection_matrix);
+
+	update_frame(renderer, camera, scene, view_projection_matrix);
+	upload_instances(renderer);
+	materialmanager_update();
+
+	// Decides what the indirect draws of the passes draw.
+	if (indirect_enabled()) {
+		indirect_cull(&renderer->queue, renderer->instances_buffer, view_projection_matrix);
+	}
+
 	// Clear the screen.
 	glClearColor(0, 0, 0, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -157,28 +466,7 @@ void renderer_render(struct renderer *renderer, const struct camera *camera, con
 	glDisable(GL_MULTISAMPLE);
 
 	// Render all entities, for mouse picking.
-	for (size_t i = 0; i < scene->entity_count; i++) {
-		const struct entity *entity = scene->entities[i];
-
-		// Render all meshes.
-		for (size_t i = 0; i < entity->model->meshes_count; i++) {
-			struct mesh *mesh = &entity->model->meshes[i];
-
-			// Render mesh.
-			glUseProgram(renderer->plain_shader->program_id);
-			static GLint picking_color_location = -1;
-			if (picking_color_location == -1) {
-				picking_color_location = glGetUniformLocation(renderer->plain_shader->program_id, "u_Color");
-			}
-
-			// Convert entity ID to color.
-			vec4 color;
-			entity_id_as_color(entity->id, color);
-			glUniform4fv(picking_color_location, 1, color);
-
-			render_mesh(renderer, camera, scene, entity, renderer->plain_shader, mesh);
-		}
-	}
+	size_t next = render_pass(renderer, RENDERQUEUE_PASS_PICKING, 0);
 
 	// Mouse picking; super-duper slow, the framebuffer is on the GPU.
 	double mouseX = client.window.cursor_pos_x;
@@ -200,18 +488,7 @@ void renderer_render(struct renderer *renderer, const struct camera *camera, con
 	glEnable(GL_MULTISAMPLE);
 
 	// Render all entities.
-	for (size_t i = 0; i < scene->entity_count; i++) {
-		const struct entity *entity = scene->entities[i];
-
-		// Render all meshes.
-		for (size_t i = 0; i < entity->model->meshes_count; i++) {
-			struct mesh *mesh = &entity->model->meshes[i];
-
-			// Render mesh.
-			glUseProgram(mesh->shader->program_id);
-			render_mesh(renderer, camera, scene, entity, mesh->shader, mesh);
-		}
-	}
+	render_pass(renderer, RENDERQUEUE_PASS_OPAQUE, next);
 
 	// Render the skybox.
 	// This is done last so that only the fragments that aren't hiding it gets computed.
@@ -0,0 +1,250 @@
+#include "client.h"
+
+void renderqueue_init(struct renderqueue *queue) {
+	*queue = (struct renderqueue) {0};
+}
+
+void renderqueue_fini(struct renderqueue *queue) {
+	free(queue->items);
+	free(queue->order);
+	free(queue->scratch);
+	free(queue->instances);
+	free(queue->grouped);
+	free(queue->instance_batches);
+	free(queue->batches);
+	free(queue->lookup);
+	renderqueue_init(queue);
+}
+
+// Storage is kept from one frame to the next, it only ever grows.
+void renderqueue_clear(struct renderqueue *queue) {
+	queue->count = 0;
+	queue->instances_count = 0;
+	queue->batches_count = 0;
+
+	if (queue->lookup) {
+		memset(queue->lookup, 0, queue->lookup_capacity * sizeof *queue->lookup);
+	}
+}
+
+static bool grow(struct renderqueue *queue) {
+	size_t new_capacity = queue->capacity ? queue->capacity * 2 : 256;
+
+	struct renderqueue_item *new_items = realloc(queue->items, new_capacity * sizeof *new_items);
+	if (!new_items) {
+		return false;
+	}
+
+	queue->items = new_items;
+
+	struct renderqueue_entry *new_order = realloc(queue->order, new_capacity * sizeof *new_order);
+	if (!new_order) {
+		return false;
+	}
+
+	queue->order = new_order;
+
+	struct renderqueue_entry *new_scratch = realloc(queue->scratch, new_capacity * sizeof *new_scratch);
+	if (!new_scratch) {
+		return false;
+	}
+
+	queue->scratch = new_scratch;
+	queue->capacity = new_capacity;
+
+	return true;
+}
+
+struct renderqueue_item *renderqueue_push(struct renderqueue *queue, uint64_t key) {
+	if (queue->count == queue->capacity && !grow(queue)) {
+		return NULL;
+	}
+
+	size_t index = queue->count++;
+	queue->order[index].key = key;
+	queue->order[index].item = index;
+
+	return &queue->items[index];
+}
+
+// Least significant digit radix sort, a byte at a time. Stable, so equal keys keep their submission order.
+// Bytes that are the same in all keys (unused shader or material bits, most of the time) are skipped.
+void renderqueue_sort(struct renderqueue *queue) {
+	struct renderqueue_entry *source = queue->order;
+	struct renderqueue_entry *destination = queue->scratch;
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t counts[256] = {0};
+		for (size_t i = 0; i < queue->count; i++) {
+			counts[(source[i].key >> shift) & 0xff]++;
+		}
+
+		if (queue->count == 0 || counts[(source[0].key >> shift) & 0xff] == queue->count) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t i = 0; i < 256; i++) {
+			size_t count = counts[i];
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < queue->count; i++) {
+			destination[counts[(source[i].key >> shift) & 0xff]++] = source[i];
+		}
+
+		struct renderqueue_entry *swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	// The sorted entries have to end up in `order`.
+	if (source != queue->order) {
+		queue->scratch = queue->order;
+		queue->order = source;
+	}
+}
+
+static uint64_t bits(uint64_t value, int count) {
+	return value & ((UINT64_C(1) << count) - 1);
+}
+
+uint64_t renderqueue_key(enum renderqueue_pass pass, uint32_t shader, uint32_t material, uint32_t vertex_array, float depth) {
+	// Positive floats sort like their bit patterns, the top ones are plenty to order draws.
+	uint32_t depth_bits = 0;
+	if (depth > 0) {
+		memcpy(&depth_bits, &depth, sizeof depth_bits);
+	}
+
+	uint64_t key = bits(pass, RENDERQUEUE_PASS_BITS);
+	key = key << RENDERQUEUE_SHADER_BITS | bits(shader, RENDERQUEUE_SHADER_BITS);
+	key = key << RENDERQUEUE_MATERIAL_BITS | bits(material, RENDERQUEUE_MATERIAL_BITS);
+	key = key << RENDERQUEUE_VERTEX_ARRAY_BITS | bits(vertex_array, RENDERQUEUE_VERTEX_ARRAY_BITS);
+	key = key << RENDERQUEUE_DEPTH_BITS | depth_bits >> (32 - RENDERQUEUE_DEPTH_BITS);
+
+	return key;
+}
+
+enum renderqueue_pass renderqueue_key_pass(uint64_t key) {
+	return key >> (64 - RENDERQUEUE_PASS_BITS);
+}
+
+static bool grow_instances(struct renderqueue *queue) {
+	size_t new_capacity = queue->instances_capacity ? queue->instances_capacity * 2 : 256;
+
+	struct renderqueue_instance *new_instances = realloc(queue->instances, new_capacity * sizeof *new_instances);
+	if (!new_instances) {
+		return false;
+	}
+
+	queue->instances = new_instances;
+
+	struct renderqueue_instance *new_grouped = realloc(queue->grouped, new_capacity * sizeof *new_grouped);
+	if (!new_grouped) {
+		return false;
+	}
+
+	queue->grouped = new_grouped;
+
+	size_t *new_instance_batches = realloc(queue->instance_batches, new_capacity * sizeof *new_instance_batches);
+	if (!new_instance_batches) {
+		return false;
+	}
+
+	queue->instance_batches = new_instance_batches;
+	queue->instances_capacity = new_capacity;
+
+	return true;
+}
+
+// Slot of the mesh in the lookup table, either its batch or where it would go. The table is never more than half full.
+static size_t *lookup_slot(const struct renderqueue *queue, const struct mesh *mesh) {
+	size_t mask = queue->lookup_capacity - 1;
+	size_t slot = utils_hash(&mesh, sizeof mesh, UTILS_HASH_SEED) & mask;
+
+	while (queue->lookup[slot] && queue->batches[queue->lookup[slot] - 1].mesh != mesh) {
+		slot = (slot + 1) & mask;
+	}
+
+	return &queue->lookup[slot];
+}
+
+static bool grow_batches(struct renderqueue *queue) {
+	size_t new_capacity = queue->batches_capacity ? queue->batches_capacity * 2 : 64;
+
+	struct renderqueue_batch *new_batches = realloc(queue->batches, new_capacity * sizeof *new_batches);
+	if (!new_batches) {
+		return false;
+	}
+
+	queue->batches = new_batches;
+
+	size_t *new_lookup = calloc(new_capacity * 2, sizeof *new_lookup);
+	if (!new_lookup) {
+		return false;
+	}
+
+	free(queue->lookup);
+	queue->lookup = new_lookup;
+	queue->lookup_capacity = new_capacity * 2;
+	queue->batches_capacity = new_capacity;
+
+	for (size_t i = 0; i < queue->batches_count; i++) {
+		*lookup_slot(queue, queue->batches[i].mesh) = i + 1;
+	}
+
+	return true;
+}
+
+// Adds an instance of the mesh to its batch, the caller fills it in.
+struct renderqueue_instance *renderqueue_instance(struct renderqueue *queue, const struct mesh *mesh, float depth) {
+	if (queue->instances_count == queue->instances_capacity && !grow_instances(queue)) {
+		return NULL;
+	}
+
+	if (queue->batches_count == queue->batches_capacity && !grow_batches(queue)) {
+		return NULL;
+	}
+
+	size_t *slot = lookup_slot(queue, mesh);
+	if (!*slot) {
+		queue->batches[queue->batches_count] = (struct renderqueue_batch) {
+			.mesh = mesh,
+			.depth = depth,
+		};
+
+		*slot = ++queue->batches_count;
+	}
+
+	struct renderqueue_batch *batch = &queue->batches[*slot - 1];
+	batch->count++;
+	if (depth < batch->depth) {
+		batch->depth = depth;
+	}
+
+	size_t index = queue->instances_count++;
+	queue->instance_batches[index] = *slot - 1;
+
+	return &queue->instances[index];
+}
+
+// Counting sort of the instances by batch, each batch then has its instances one after the other from `first`.
+void renderqueue_group(struct renderqueue *queue) {
+	size_t first = 0;
+	for (size_t i = 0; i < queue->batches_count; i++) {
+		struct renderqueue_batch *batch = &queue->batches[i];
+		batch->first = first;
+		first += batch->count;
+		batch->count = 0; // Counted again while placing them.
+	}
+
+	for (size_t i = 0; i < queue->instances_count; i++) {
+		struct renderqueue_batch *batch = &queue->batches[queue->instance_batches[i]];
+		queue->grouped[batch->first + batch->count++] = queue->instances[i];
+	}
+
+	struct renderqueue_instance *swap = queue->instances;
+	queue->instances = queue->grouped;
+	queue->grouped = swap;
+}
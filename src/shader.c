@@ -19,6 +19,12 @@ static GLuint compile_shader(GLenum type, const struct shader_options *options,
 	// Version.
 	tk_buffer_append_format(&buffer, "#version 410 core\n");
 
+	// Capabilities, the same for every program.
+	SHADER_OPTION(materialmanager_storage(), "#extension GL_ARB_shader_storage_buffer_object : require\n#define USE_MATERIAL_STORAGE\n");
+	SHADER_OPTION(texture_bindless(), "#extension GL_ARB_bindless_texture : require\n#define USE_BINDLESS_TEXTURES\n");
+	SHADER_OPTION(indirect_enabled(), "#define USE_INDIRECT\n");
+	SHADER_OPTION(indirect_materials(), "#define USE_INSTANCE_MATERIALS\n");
+
 	// If there are options, process them.
 	if (options) {
 		// Attributes.
@@ -29,6 +35,7 @@ static GLuint compile_shader(GLenum type, const struct shader_options *options,
 		SHADER_OPTION(options->has_joint_set1, "#define HAS_JOINT_SET1\n");
 		SHADER_OPTION(options->has_color_vec3, "#define HAS_VERTEX_COLOR_VEC3\n");
 		SHADER_OPTION(options->has_color_vec4, "#define HAS_VERTEX_COLOR_VEC4\n");
+		SHADER_OPTION(options->has_octahedral_normals, "#define HAS_OCTAHEDRAL_NORMALS\n");
 
 		// Textures.
 		SHADER_OPTION(options->has_base_color_map, "#define HAS_BASE_COLOR_MAP\n");
@@ -86,51 +93,39 @@ static GLuint compile_shader(GLenum type, const struct shader_options *options,
 	return shader_id;
 }
 
+// Blocks can't pick their binding in GLSL 4.1, whoever owns the buffer binds it there.
+static void bind_uniform_block(const struct shader *shader, const char *name, GLuint binding) {
+	GLuint block = glGetUniformBlockIndex(shader->program_id, name);
+	if (block != GL_INVALID_INDEX) {
+		glUniformBlockBinding(shader->program_id, block, binding);
+	}
+}
+
 static void find_uniforms(struct shader *shader) {
 	glUseProgram(shader->program_id);
 
-	shader->uniform_base_color_factor = glGetUniformLocation(shader->program_id, "u_BaseColorFactor");
-	shader->uniform_base_color_sampler = glGetUniformLocation(shader->program_id, "u_BaseColorSampler");
-	shader->uniform_normal_sampler = glGetUniformLocation(shader->program_id, "u_NormalSampler");
-	shader->uniform_normal_scale = glGetUniformLocation(shader->program_id, "u_NormalScale");
-	shader->uniform_metallic_roughness_sampler = glGetUniformLocation(shader->program_id, "u_MetallicRoughnessSampler");
-	shader->uniform_metallic_factor = glGetUniformLocation(shader->program_id, "u_MetallicFactor");
-	shader->uniform_roughness_factor = glGetUniformLocation(shader->program_id, "u_RoughnessFactor");
-	shader->uniform_occlusion_sampler = glGetUniformLocation(shader->program_id, "u_OcclusionSampler");
-	shader->uniform_occlusion_strength = glGetUniformLocation(shader->program_id, "u_OcclusionStrength");
-	shader->uniform_emissive_sampler = glGetUniformLocation(shader->program_id, "u_EmissiveSampler");
-	shader->uniform_emissive_factor = glGetUniformLocation(shader->program_id, "u_EmissiveFactor");
-	shader->uniform_camera = glGetUniformLocation(shader->program_id, "u_Camera");
-
-	shader->uniform_environment_mip_count = glGetUniformLocation(shader->program_id, "u_MipCount");
-	shader->uniform_environment_lambertian = glGetUniformLocation(shader->program_id, "u_LambertianEnvSampler");
-	shader->uniform_environment_ggx = glGetUniformLocation(shader->program_id, "u_GGXEnvSampler");
-	shader->uniform_environment_ggx_lut = glGetUniformLocation(shader->program_id, "u_GGXLUT");
-	shader->uniform_environment_charlie = glGetUniformLocation(shader->program_id, "u_CharlieEnvSampler");
-	shader->uniform_environment_charlie_lut = glGetUniformLocation(shader->program_id, "u_CharlieLUT");
-
-	char name[64];
-	for (size_t i = 0; i < MAX_LIGHTS; i++) {
-		sprintf(name, "u_Lights[%zu].type", i);
-		shader->uniform_lights_type[i] = glGetUniformLocation(shader->program_id, name);
-
-		sprintf(name, "u_Lights[%zu].position", i);
-		shader->uniform_lights_position[i] = glGetUniformLocation(shader->program_id, name);
-
-		sprintf(name, "u_Lights[%zu].direction", i);
-		shader->uniform_lights_direction[i] = glGetUniformLocation(shader->program_id, name);
-
-		sprintf(name, "u_Lights[%zu].color", i);
-		shader->uniform_lights_color[i] = glGetUniformLocation(shader->program_id, name);
-
-		sprintf(name, "u_Lights[%zu].intensity", i);
-		shader->uniform_lights_intensity[i] = glGetUniformLocation(shader->program_id, name);
-	}
-
-	shader->uniform_view_projection_matrix = glGetUniformLocation(shader->program_id, "u_ViewProjectionMatrix");
+	shader->uniform_material_index = glGetUniformLocation(shader->program_id, "u_MaterialIndex");
+	materialmanager_program(shader->program_id);
+
+	// Texture units are fixed per kind (see texture.h), material textures are bound to them without bindless ones.
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_BaseColorSampler"), TEXTURE_KIND_ALBEDO);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_NormalSampler"), TEXTURE_KIND_NORMAL);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_MetallicRoughnessSampler"), TEXTURE_KIND_METALLIC_ROUGHNESS);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_OcclusionSampler"), TEXTURE_KIND_OCCLUSION);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_EmissiveSampler"), TEXTURE_KIND_EMISSION);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_GGXEnvSampler"), TEXTURE_KIND_ENVIRONMENT_GGX);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_GGXLUT"), TEXTURE_KIND_ENVIRONMENT_GGX_LUT);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_CharlieEnvSampler"), TEXTURE_KIND_ENVIRONMENT_CHARLIE);
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_CharlieLUT"), TEXTURE_KIND_ENVIRONMENT_CHARLIE_LUT);
+
+	bind_uniform_block(shader, "Irradiance", ENVIRONMENT_IRRADIANCE_BINDING);
+	bind_uniform_block(shader, "Frame", SHADER_FRAME_BINDING);
+	bind_uniform_block(shader, "Lights", SHADER_LIGHTS_BINDING);
+
+	shader->uniform_instance_offset = glGetUniformLocation(shader->program_id, "u_InstanceOffset");
+	glUniform1i(glGetUniformLocation(shader->program_id, "u_Instances"), SHADER_INSTANCES_UNIT);
+
 	shader->uniform_model_matrix = glGetUniformLocation(shader->program_id, "u_ModelMatrix");
-	shader->uniform_normal_matrix = glGetUniformLocation(shader->program_id, "u_NormalMatrix");
-	shader->uniform_exposure = glGetUniformLocation(shader->program_id, "u_Exposure");
 }
 
 struct shader *shader_load_from_files(const struct shader_options *options, const char *vertex_filepath, const char *fragment_filepath, const char *compute_filepath) {
@@ -170,7 +165,176 @@ struct shader *shader_load_from_files(const struct shader_options *options, cons
 	return shader;
 }
 
+// Linked programs are kept on disk (see `glGetProgramBinary`), this saves compiling the same shaders on every launch.
+// Bump the version whenever the way programs get built changes without their sources changing (e.g. attribute bindings).
+#define PROGRAM_BINARY_MAGIC 0x4250534c // "LSPB"
+#define PROGRAM_BINARY_VERSION 2
+
+struct program_binary_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+static bool program_binary_supported(void) {
+	static int supported = -1;
+
+	if (supported == -1) {
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0;
+	}
+
+	return supported;
+}
+
+static uint64_t program_binary_key(const struct shader_options *options, const unsigned char *vertex_content, size_t vertex_length, const unsigned char *fragment_content, size_t fragment_length, const unsigned char *compute_content, size_t compute_length) {
+	uint64_t key = UTILS_HASH_SEED;
+	uint32_t version = PROGRAM_BINARY_VERSION;
+	uint64_t options_hash = shader_options_hash(options);
+
+	key = utils_hash(&version, sizeof version, key);
+	key = utils_hash(&options_hash, sizeof options_hash, key);
+
+	// Lengths are included so that moving bytes from one stage to another changes the key.
+	key = utils_hash(&vertex_length, sizeof vertex_length, key);
+	key = utils_hash(vertex_content, vertex_length, key);
+	key = utils_hash(&fragment_length, sizeof fragment_length, key);
+	key = utils_hash(fragment_content, fragment_length, key);
+	key = utils_hash(&compute_length, sizeof compute_length, key);
+	key = utils_hash(compute_content, compute_length, key);
+
+	// Sources are compiled differently depending on what the driver supports, see compile_shader().
+	bool capabilities[] = {materialmanager_storage(), texture_bindless(), indirect_enabled()};
+	key = utils_hash(capabilities, sizeof capabilities, key);
+
+	// Binaries are only valid for the driver that produced them.
+	const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+	for (size_t i = 0; i < ARRAY_COUNT(driver_strings); i++) {
+		const char *string = (const char *) glGetString(driver_strings[i]);
+		if (string) {
+			key = utils_hash(string, strlen(string) + 1, key);
+		}
+	}
+
+	return key;
+}
+
+static GLuint load_program_binary(uint64_t key) {
+	if (!program_binary_supported()) {
+		return 0;
+	}
+
+	char path[256];
+	if (!cache_path(path, sizeof path, "program", key)) {
+		return 0;
+	}
+
+	size_t size;
+	unsigned char *data = cache_read(path, &size);
+	if (!data) {
+		return 0;
+	}
+
+	struct program_binary_header header = {0};
+	if (size >= sizeof header) {
+		memcpy(&header, data, sizeof header);
+	}
+
+	bool valid = size >= sizeof header
+		&& header.magic == PROGRAM_BINARY_MAGIC
+		&& header.version == PROGRAM_BINARY_VERSION
+		&& header.key == key
+		&& header.length == size - sizeof header;
+
+	if (!valid) {
+		free(data);
+		cache_remove(path);
+		return 0;
+	}
+
+	GLuint program_id = glCreateProgram();
+	if (!program_id) {
+		free(data);
+		return 0;
+	}
+
+	glProgramBinary(program_id, header.format, data + sizeof header, header.length);
+	free(data);
+
+	// Drivers are free to reject binaries at any time (e.g. after an update), the caller falls back to the sources.
+	GLint success;
+	glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+	if (success != GL_TRUE) {
+		glDeleteProgram(program_id);
+		cache_remove(path);
+		return 0;
+	}
+
+	return program_id;
+}
+
+static void save_program_binary(GLuint program_id, uint64_t key) {
+	if (!program_binary_supported()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	unsigned char *data = malloc(sizeof (struct program_binary_header) + length);
+	if (!data) {
+		return;
+	}
+
+	GLenum format;
+	glGetProgramBinary(program_id, length, NULL, &format, data + sizeof (struct program_binary_header));
+
+	struct program_binary_header header = {
+		.magic = PROGRAM_BINARY_MAGIC,
+		.version = PROGRAM_BINARY_VERSION,
+		.key = key,
+		.format = format,
+		.length = length,
+	};
+
+	memcpy(data, &header, sizeof header);
+
+	char path[256];
+	if (cache_path(path, sizeof path, "program", key)) {
+		cache_write(path, data, sizeof header + length);
+	}
+
+	free(data);
+}
+
+static struct shader *create_shader(GLuint program_id) {
+	struct shader *shader = malloc(sizeof *shader);
+	if (!shader) {
+		glDeleteProgram(program_id);
+		return NULL;
+	}
+
+	shader->program_id = program_id;
+
+	find_uniforms(shader);
+
+	return shader;
+}
+
 struct shader *shader_load_from_memory(const struct shader_options *options, const unsigned char *vertex_content, size_t vertex_length, const unsigned char *fragment_content, size_t fragment_length, const unsigned char *compute_content, size_t compute_length) {
+	// Try the program binary cache first, it skips compilation and linking entirely.
+	uint64_t key = program_binary_key(options, vertex_content, vertex_length, fragment_content, fragment_length, compute_content, compute_length);
+	GLuint cached_program_id = load_program_binary(key);
+	if (cached_program_id) {
+		return create_shader(cached_program_id);
+	}
+
 	GLuint vertex_shader_id = 0;
 	GLuint fragment_shader_id = 0;
 	GLuint compute_shader_id = 0;
@@ -241,6 +405,12 @@ struct shader *shader_load_from_memory(const struct shader_options *options, con
 	glBindAttribLocation(program_id, MESH_ATTRIBUTE_WEIGHTS, "a_Weight1");
 	glBindAttribLocation(program_id, MESH_ATTRIBUTE_JOINTS, "a_Joint1");
 	glBindAttribLocation(program_id, MESH_ATTRIBUTE_COLORS, "a_Color");
+	glBindAttribLocation(program_id, GEOMETRY_INSTANCE_ATTRIBUTE, "a_InstanceIndex");
+
+	// Let the driver know we'll be asking for the binary, some of them need to be told before linkage.
+	if (program_binary_supported()) {
+		glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 
 	glLinkProgram(program_id);
 
@@ -262,104 +432,95 @@ struct shader *shader_load_from_memory(const struct shader_options *options, con
 	glDeleteShader(fragment_shader_id);
 	glDeleteShader(compute_shader_id);
 
-	struct shader *shader = malloc(sizeof *shader);
-	if (!shader) {
-		glDeleteProgram(program_id);
-		return NULL;
-	}
-
-	shader->program_id = program_id;
-
-	find_uniforms(shader);
+	save_program_binary(program_id, key);
 
-	return shader;
+	return create_shader(program_id);
 }
 
-void shader_destroy(struct shader *shader) {
-	glDeleteProgram(shader->program_id);
-	free(shader);
-}
-
-void shader_bind_uniform_material(const struct shader *shader, const struct material *material) {
-	glUniform4fv(shader->uniform_base_color_factor, 1, material->base_color_factor);
-
-	if (material->base_color_texture) {
-		glUniform1i(shader->uniform_base_color_sampler, material->base_color_texture->gl_unit);
+// Every field of the options goes through this list, so that hashing and comparing never disagree.
+#define SHADER_OPTIONS_FIELDS(X) \
+	X(has_normals) X(has_uv_set1) X(has_tangents) X(has_weight_set1) X(has_joint_set1) X(has_color_vec3) X(has_color_vec4) X(has_octahedral_normals) \
+	X(has_base_color_map) X(has_normal_map) X(has_occlusion_map) X(has_emissive_map) X(has_metallic_roughness_map) \
+	X(material_metallicroughness) X(material_specularglossiness) \
+	X(material_unlit) X(use_hdr) X(use_ibl) X(use_punctual) X(light_count) \
+	X(use_skinning) X(joint_count) \
+	X(tonemap_uncharted) X(tonemap_hejlrichard) X(tonemap_aces) \
+	X(debug_output) X(debug_basecolor) X(debug_normal) X(debug_tangent) X(debug_metallic) X(debug_roughness) \
+	X(debug_occlusion) X(debug_fdiffuse) X(debug_fspecular) X(debug_femissive)
+
+uint64_t shader_options_hash(const struct shader_options *options) {
+	uint64_t hash = UTILS_HASH_SEED;
+
+	// No options is a permutation of its own.
+	if (!options) {
+		return hash;
 	}
 
-	if (material->metallic_roughness_texture) {
-		glUniform1i(shader->uniform_metallic_roughness_sampler, material->metallic_roughness_texture->gl_unit);
-	}
+	// Field by field, because the padding bytes of the structure are not guaranteed to be zeroed.
+	#define HASH_FIELD(field) hash = utils_hash(&options->field, sizeof options->field, hash);
+	SHADER_OPTIONS_FIELDS(HASH_FIELD)
+	#undef HASH_FIELD
 
-	glUniform1f(shader->uniform_metallic_factor, material->metallic_factor);
-	glUniform1f(shader->uniform_roughness_factor, material->roughness_factor);
+	return hash;
+}
 
-	if (material->normal_texture) {
-		glUniform1i(shader->uniform_normal_sampler, material->normal_texture->gl_unit);
+bool shader_options_equal(const struct shader_options *a, const struct shader_options *b) {
+	if (!a || !b) {
+		return a == b;
 	}
 
-	glUniform1f(shader->uniform_normal_scale, material->normal_scale);
+	#define COMPARE_FIELD(field) if (a->field != b->field) { return false; }
+	SHADER_OPTIONS_FIELDS(COMPARE_FIELD)
+	#undef COMPARE_FIELD
 
-	if (material->occlusion_texture) {
-		glUniform1i(shader->uniform_occlusion_sampler, material->occlusion_texture->gl_unit);
-	}
+	return true;
+}
 
-	glUniform1f(shader->uniform_occlusion_strength, material->occlusion_strength);
+void shader_destroy(struct shader *shader) {
+	glDeleteProgram(shader->program_id);
+	free(shader);
+}
 
-	if (material->emissive_texture) {
-		glUniform1i(shader->uniform_emissive_sampler, material->emissive_texture->gl_unit);
-	}
+void shader_bind_uniform_material(const struct shader *shader, const struct material *material) {
+	glUniform1i(shader->uniform_material_index, material->id);
+}
 
-	glUniform3fv(shader->uniform_emissive_factor, 1, material->emissive_factor);
+void shader_bind_uniform_model(const struct shader *shader, mat4 model_matrix) {
+	glUniformMatrix4fv(shader->uniform_model_matrix, 1, false, model_matrix[0]);
 }
 
-void shader_bind_uniform_environment(const struct shader *shader, const struct environment *environment) {
-	glUniform1i(shader->uniform_environment_mip_count, environment->mip_count);
-	glUniform1i(shader->uniform_environment_lambertian, environment->lambertian.gl_unit);
-	glUniform1i(shader->uniform_environment_ggx, environment->ggx.gl_unit);
-	glUniform1i(shader->uniform_environment_ggx_lut, environment->ggx_lut.gl_unit);
-	glUniform1i(shader->uniform_environment_charlie, environment->charlie.gl_unit);
-	glUniform1i(shader->uniform_environment_charlie_lut, environment->charlie_lut.gl_unit);
+void shader_bind_uniform_instances(const struct shader *shader, size_t first_instance) {
+	glUniform1i(shader->uniform_instance_offset, first_instance);
 }
 
-void shader_bind_uniform_camera(const struct shader *shader, const struct camera *camera) {
-	glUniform3fv(shader->uniform_camera, 1, camera->eye);
+void shader_frame_init(struct shader_frame *frame, mat4 view_projection_matrix, const struct camera *camera, const struct environment *environment, float exposure) {
+	*frame = (struct shader_frame) {0};
+	glm_mat4_copy(view_projection_matrix, frame->view_projection_matrix);
+	glm_vec3_copy((float *) camera->eye, frame->camera);
+	frame->exposure = exposure;
+	frame->mip_count = environment->mip_count;
 }
 
-void shader_bind_uniform_lights(const struct shader *shader, const struct light **lights, size_t count) {
-	for (size_t i = 0; i < count; i++) {
-		// TODO: This doesn't clean up old light uniforms when they're removed!
-		if (i >= MAX_LIGHTS) {
-			break;
-		}
+void shader_lights_init(struct shader_lights *lights, const struct light **scene_lights, size_t count) {
+	*lights = (struct shader_lights) {0};
 
-		const struct light *light = lights[i];
-
-		switch (light->type) {
-		    case LIGHT_TYPE_DIRECTIONAL:
-			    glUniform1i(shader->uniform_lights_type[i], light->type);
-			    glUniform3fv(shader->uniform_lights_position[i], 1, light->position);
-			    glUniform3fv(shader->uniform_lights_direction[i], 1, light->direction);
-			    glUniform3fv(shader->uniform_lights_color[i], 1, light->color);
-			    glUniform1f(shader->uniform_lights_intensity[i], light->intensity);
-			    break;
-
-		    case LIGHT_TYPE_POINT:
-			    glUniform1i(shader->uniform_lights_type[i], light->type);
-			    glUniform3fv(shader->uniform_lights_position[i], 1, light->position);
-			    glUniform3fv(shader->uniform_lights_color[i], 1, light->color);
-			    glUniform1f(shader->uniform_lights_intensity[i], light->intensity);
-			    break;
-
-		    // TODO: The other types of lights.
-		    default: break;
-		}
+	if (count > MAX_LIGHTS) {
+		count = MAX_LIGHTS;
 	}
-}
 
-void shader_bind_uniform_mvp(const struct shader *shader, mat4 view_projection_matrix, mat4 model_matrix, float exposure) {
-	glUniformMatrix4fv(shader->uniform_view_projection_matrix, 1, false, view_projection_matrix[0]);
-	glUniformMatrix4fv(shader->uniform_model_matrix, 1, false, model_matrix[0]);
-	glUniformMatrix4fv(shader->uniform_normal_matrix, 1, false, model_matrix[0]);
-	glUniform1f(shader->uniform_exposure, exposure);
+	for (size_t i = 0; i < count; i++) {
+		const struct light *light = scene_lights[i];
+		struct shader_light *uniform = &lights->lights[i];
+
+		glm_vec3_copy((float *) light->direction, uniform->direction);
+		uniform->range = light->range;
+		glm_vec3_copy((float *) light->color, uniform->color);
+		uniform->intensity = light->intensity;
+		glm_vec3_copy((float *) light->position, uniform->position);
+		uniform->inner_cone_cos = light->innerConeCos;
+		uniform->outer_cone_cos = light->outerConeCos;
+		uniform->type = light->type;
+	}
+
+	lights->count = count;
 }
@@ -0,0 +1,106 @@
+#include "client.h"
+
+// Shaders are shared between everything that asks for the same sources with the same options (the same #define permutation).
+// Sources are identified by their address; they're expected to be embedded (INCBIN) and thus stable for the lifetime of the program.
+
+struct entry {
+	uint64_t hash;
+	bool has_options;
+	struct shader_options options;
+	const unsigned char *vertex_content;
+	const unsigned char *fragment_content;
+	const unsigned char *compute_content;
+	struct shader *shader;
+	size_t uses;
+};
+
+static struct shadermanager {
+	struct entry *entries;
+	size_t used;
+	size_t capacity;
+} sm;
+
+static bool entry_matches(const struct entry *entry, uint64_t hash, const struct shader_options *options, const unsigned char *vertex_content, const unsigned char *fragment_content, const unsigned char *compute_content) {
+	if (entry->hash != hash) {
+		return false;
+	}
+
+	if (entry->vertex_content != vertex_content || entry->fragment_content != fragment_content || entry->compute_content != compute_content) {
+		return false;
+	}
+
+	// Hashes can collide, the options have to actually be the same.
+	return shader_options_equal(entry->has_options ? &entry->options : NULL, options);
+}
+
+struct shader *shadermanager_load_shader(const struct shader_options *options, const unsigned char *vertex_content, size_t vertex_length, const unsigned char *fragment_content, size_t fragment_length, const unsigned char *compute_content, size_t compute_length) {
+	uint64_t hash = shader_options_hash(options);
+
+	// Re-use the shader if that permutation was already compiled.
+	for (size_t i = 0; i < sm.used; i++) {
+		struct entry *entry = &sm.entries[i];
+		if (entry_matches(entry, hash, options, vertex_content, fragment_content, compute_content)) {
+			entry->uses++;
+			return entry->shader;
+		}
+	}
+
+	// Prepare storage for the new entry if there isn't enough space.
+	if (sm.used == sm.capacity) {
+		size_t new_capacity = sm.capacity + 1;
+
+		void *new_entries = realloc(sm.entries, new_capacity * sizeof *sm.entries);
+		if (!new_entries) {
+			return NULL;
+		}
+
+		sm.capacity = new_capacity;
+		sm.entries = new_entries;
+	}
+
+	// Compile the shader.
+	struct shader *shader = shader_load_from_memory(options, vertex_content, vertex_length, fragment_content, fragment_length, compute_content, compute_length);
+	if (!shader) {
+		return NULL;
+	}
+
+	// Store the shader.
+	struct entry *entry = &sm.entries[sm.used++];
+
+	entry->hash = hash;
+	entry->has_options = options != NULL;
+	if (options) {
+		entry->options = *options;
+	}
+	entry->vertex_content = vertex_content;
+	entry->fragment_content = fragment_content;
+	entry->compute_content = compute_content;
+	entry->shader = shader;
+	entry->uses = 1;
+
+	return shader;
+}
+
+void shadermanager_unload_shader(const struct shader *shader) {
+	for (size_t i = 0; i < sm.used; i++) {
+		struct entry *entry = &sm.entries[i];
+		if (entry->shader == shader) {
+			entry->uses--;
+
+			// Check if this was the last usage of this entry. If so, time to cleanup.
+			if (entry->uses == 0) {
+				shader_destroy(entry->shader);
+
+				// Replace the current entry with the last entry, unless we are the last entry.
+				bool is_last_entry = i == sm.used - 1;
+				if (!is_last_entry) {
+					*entry = sm.entries[sm.used - 1];
+				}
+
+				sm.used--;
+			}
+
+			return;
+		}
+	}
+}
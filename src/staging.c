@@ -0,0 +1,183 @@
+#include "client.h"
+
+// Core 4.1 headers don't know about buffer storage, it gets loaded by hand.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP buffer_storage_function)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// Everything written before `end` is being read by the GPU until the fence gets signaled.
+struct fence {
+	GLsync sync;
+	size_t end;
+};
+
+// Offsets are running totals of bytes written, the position in the ring is the offset modulo the ring size.
+static struct staging {
+	GLuint buffer;
+	unsigned char *mapping;
+
+	size_t head;
+	size_t tail;
+	size_t fenced;
+
+	// Oldest first, circular.
+	struct fence fences[STAGING_FENCES_MAX];
+	size_t fences_first;
+	size_t fences_count;
+} staging;
+
+static void fence(void) {
+	if (staging.fenced == staging.head || staging.fences_count == STAGING_FENCES_MAX) {
+		return;
+	}
+
+	struct fence *fence = &staging.fences[(staging.fences_first + staging.fences_count) % STAGING_FENCES_MAX];
+	fence->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence->end = staging.head;
+
+	staging.fences_count++;
+	staging.fenced = staging.head;
+}
+
+// Frees the ring space of the oldest fence, waiting for it when asked to.
+static bool retire(bool wait) {
+	if (staging.fences_count == 0) {
+		return false;
+	}
+
+	struct fence *fence = &staging.fences[staging.fences_first];
+
+	GLenum status = glClientWaitSync(fence->sync, 0, 0);
+	while (wait && status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync(fence->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+
+	glDeleteSync(fence->sync);
+
+	staging.tail = fence->end;
+	staging.fences_first = (staging.fences_first + 1) % STAGING_FENCES_MAX;
+	staging.fences_count--;
+
+	return true;
+}
+
+bool staging_init(void) {
+	if (!window_extension_supported("GL_ARB_buffer_storage")) {
+		return false;
+	}
+
+	buffer_storage_function buffer_storage = (buffer_storage_function) glfwGetProcAddress("glBufferStorage");
+	if (!buffer_storage) {
+		return false;
+	}
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &staging.buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+	buffer_storage(GL_COPY_READ_BUFFER, STAGING_RING_SIZE, NULL, flags);
+
+	staging.mapping = glMapBufferRange(GL_COPY_READ_BUFFER, 0, STAGING_RING_SIZE, flags);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if (!staging.mapping) {
+		glDeleteBuffers(1, &staging.buffer);
+		staging.buffer = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void staging_fini(void) {
+	if (!staging.mapping) {
+		return;
+	}
+
+	while (retire(true)) {
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glDeleteBuffers(1, &staging.buffer);
+
+	staging = (struct staging) {0};
+}
+
+bool staging_available(void) {
+	return staging.mapping != NULL;
+}
+
+// Copies the data into the ring and returns its offset in the staging buffer.
+// The copy out of the ring has to be issued before the next flush.
+bool staging_write(const void *data, size_t size, size_t *offset) {
+	if (!staging.mapping || size == 0 || size > STAGING_RING_SIZE) {
+		return false;
+	}
+
+	size_t start = (staging.head + STAGING_ALIGNMENT - 1) & ~(size_t) (STAGING_ALIGNMENT - 1);
+
+	// Allocations never straddle the end of the ring, skip to its beginning instead.
+	size_t position = start % STAGING_RING_SIZE;
+	if (position + size > STAGING_RING_SIZE) {
+		start += STAGING_RING_SIZE - position;
+		position = 0;
+	}
+
+	// Filled up within a single frame, fence what was written so far and wait for the GPU to catch up.
+	while (start + size - staging.tail > STAGING_RING_SIZE) {
+		fence();
+
+		if (!retire(true)) {
+			return false;
+		}
+	}
+
+	memcpy(staging.mapping + position, data, size);
+
+	staging.head = start + size;
+	*offset = position;
+
+	return true;
+}
+
+GLuint staging_buffer(void) {
+	return staging.buffer;
+}
+
+bool staging_upload_buffer(GLuint buffer, size_t offset, const void *data, size_t size) {
+	size_t source;
+	if (!staging_write(data, size, &source)) {
+		return false;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, staging.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, offset, size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return true;
+}
+
+// Called once per frame, after all the frame's copies have been issued.
+void staging_flush(void) {
+	if (!staging.mapping) {
+		return;
+	}
+
+	fence();
+
+	while (retire(false)) {
+	}
+}
@@ -1,18 +1,46 @@
 #include "client.h"
 
-void texture_init(struct texture *texture, enum texture_kind kind, size_t width, size_t height, bool mipmapping, enum texture_type type, enum texture_format format, enum texture_format_internal format_internal) {
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Compressed formats past what the core 4.1 headers know about.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+typedef GLuint64 (APIENTRYP get_texture_handle_function)(GLuint texture);
+typedef void (APIENTRYP make_texture_handle_resident_function)(GLuint64 handle);
+typedef void (APIENTRYP make_texture_handle_non_resident_function)(GLuint64 handle);
+
+static struct {
+	bool checked;
+	bool supported;
+	get_texture_handle_function get_texture_handle;
+	make_texture_handle_resident_function make_resident;
+	make_texture_handle_non_resident_function make_non_resident;
+} bindless;
+
+static void describe(struct texture *texture, enum texture_kind kind, size_t width, size_t height, bool mipmapping, enum texture_type type, enum texture_format format, enum texture_format_internal format_internal) {
 	texture->gl_id = 0;
+	texture->gl_handle = 0;
 	texture->kind = kind;
 	texture->width = width;
 	texture->height = height;
-	texture->levels = 1;
-
-	// Automatic levels when mipmappign is enabled.
-	if (mipmapping) {
-		while ((width | height) >> texture->levels) {
-			texture->levels++;
-		}
-	}
+	texture->levels = mipmapping ? texture_levels_count(width, height) : 1;
+	texture->base_level = 0;
+	texture->wanted_level = texture->levels;
+	texture->last_used = 0;
 
 	texture->gl_unit = texture->kind;
 
@@ -32,6 +60,7 @@ void texture_init(struct texture *texture, enum texture_kind kind, size_t width,
 	switch (type) {
 	    case TEXTURE_TYPE_FLOAT: texture->gl_type = GL_FLOAT; break;
 	    case TEXTURE_TYPE_UNSIGNED_BYTE: texture->gl_type = GL_UNSIGNED_BYTE; break;
+	    case TEXTURE_TYPE_HALF_FLOAT: texture->gl_type = GL_HALF_FLOAT; break;
 	}
 
 	// Translate our data formats to OpenGL data formats.
@@ -50,23 +79,43 @@ void texture_init(struct texture *texture, enum texture_kind kind, size_t width,
 	    case TEXTURE_FORMAT_INTERNAL_RGBA16F: texture->gl_internal_format = GL_RGBA16F; break;
 	    case TEXTURE_FORMAT_INTERNAL_RGB32F: texture->gl_internal_format = GL_RGB32F; break;
 	    case TEXTURE_FORMAT_INTERNAL_RGBA32F: texture->gl_internal_format = GL_RGBA32F; break;
+	    case TEXTURE_FORMAT_INTERNAL_BC1: texture->gl_internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+	    case TEXTURE_FORMAT_INTERNAL_BC3: texture->gl_internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+	    case TEXTURE_FORMAT_INTERNAL_BC5: texture->gl_internal_format = GL_COMPRESSED_RG_RGTC2; break;
+	    case TEXTURE_FORMAT_INTERNAL_BC7: texture->gl_internal_format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
 	}
+}
 
+static bool is_compressed(const struct texture *texture) {
+	switch (texture->gl_internal_format) {
+	    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	    case GL_COMPRESSED_RG_RGTC2:
+	    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		    return true;
+	    default:
+		    return false;
+	}
+}
+
+static void create(struct texture *texture) {
 	glGenTextures(1, &texture->gl_id);
 
 	texture_switch(texture);
 
-	// Pre-allocate the storage for the pixel data.
-	texture_replace_data(texture, 0, width, height, NULL);
-
 	// Wrapping.
 	// glTexParameteri(texture->gl_target, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	// glTexParameteri(texture->gl_target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	if (texture->gl_target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(texture->gl_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(texture->gl_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(texture->gl_target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
 
 	// Filtering.
 	// `NEAREST` is generally faster than `LINEAR`, but it can produce textured images with sharper edges
 	// because the transition between texture elements is not as smooth.
-	glTexParameteri(texture->gl_target, GL_TEXTURE_MIN_FILTER, mipmapping ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(texture->gl_target, GL_TEXTURE_MIN_FILTER, texture->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 	glTexParameteri(texture->gl_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	// Anisotropic filtering.
@@ -74,20 +123,56 @@ void texture_init(struct texture *texture, enum texture_kind kind, size_t width,
 	texture_anisotropic_filtering(texture, 16);
 }
 
+void texture_init(struct texture *texture, enum texture_kind kind, size_t width, size_t height, bool mipmapping, enum texture_type type, enum texture_format format, enum texture_format_internal format_internal) {
+	describe(texture, kind, width, height, mipmapping, type, format, format_internal);
+	create(texture);
+
+	// Pre-allocate the storage for the pixel data.
+	texture_replace_data(texture, 0, width, height, NULL);
+}
+
+static void release_handle(struct texture *texture) {
+	if (texture->gl_handle) {
+		bindless.make_non_resident(texture->gl_handle);
+		texture->gl_handle = 0;
+	}
+}
+
 void texture_fini(struct texture *texture) {
+	release_handle(texture);
 	glDeleteTextures(1, &texture->gl_id);
 }
 
 bool texture_init_from_file(struct texture *texture, enum texture_kind kind, const char *filepath) {
 	if (kind == TEXTURE_KIND_EQUIRECTANGULAR) {
+		// Radiance files decode straight to half floats, a quarter of the memory of stbi_loadf() and no conversion on upload.
+		size_t size;
+		unsigned char *mapped = cache_map(filepath, &size);
+		if (mapped && hdr_detect(mapped, size)) {
+			struct texture_image image;
+			bool ok = hdr_decode(&image, mapped, size, true);
+			if (ok) {
+				ok = texture_init_streaming(texture, kind, &image, 0);
+				texture_image_fini(&image);
+			}
+
+			cache_unmap(mapped, size);
+			return ok;
+		}
+
+		if (mapped) {
+			cache_unmap(mapped, size);
+		}
+
 		// Equirectangular things are always flipped down for some reason.
-		stbi_set_flip_vertically_on_load(true);
+		// The setting is per-thread, images could be decoding on worker threads at the same time.
+		stbi_set_flip_vertically_on_load_thread(true);
 
 		int width, height, components;
 		float *data = stbi_loadf(filepath, &width, &height, &components, 0);
 
 		// We have to unconditionally revert that setting back, otherwise stbi will incorrectly flip future images when they get loaded.
-		stbi_set_flip_vertically_on_load(false);
+		stbi_set_flip_vertically_on_load_thread(false);
 
 		if (!data) {
 			return false;
@@ -121,33 +206,614 @@ bool texture_init_from_file(struct texture *texture, enum texture_kind kind, con
 	return false;
 }
 
-bool texture_init_from_memory(struct texture *texture, enum texture_kind kind, const unsigned char *data, size_t size) {
-	int width, height, components;
+bool texture_image_decode(struct texture_image *image, const unsigned char *data, size_t size) {
+	image->type = TEXTURE_TYPE_UNSIGNED_BYTE;
+	image->compression = TEXTURE_COMPRESSION_NONE;
+	image->faces = 1;
+	image->levels = 1;
+
+	if (ktx_detect(data, size)) {
+		return ktx_decode(image, data, size);
+	}
+
+	if (dds_detect(data, size)) {
+		return dds_decode(image, data, size);
+	}
+
+	if (hdr_detect(data, size)) {
+		return hdr_decode(image, data, size, false);
+	}
+
+	image->pixels = stbi_load_from_memory(data, size, &image->width, &image->height, &image->components, 0);
+	if (!image->pixels) {
+		return false;
+	}
+
+	if (image->components != 3 && image->components != 4) {
+		fprintf(stderr, "Unsupported texture data format\n");
+		texture_image_fini(image);
+		return false;
+	}
+
+	image->size = (size_t) image->width * image->height * image->components;
+
+	return true;
+}
+
+static bool has_alpha(const struct texture_image *image) {
+	if (image->components != 4) {
+		return false;
+	}
+
+	size_t texels = (size_t) image->width * image->height;
+	for (size_t i = 0; i < texels; i++) {
+		if (image->pixels[i * 4 + 3] != 255) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void decode_job(void *data) {
+	struct texture_decode *decode = data;
+	decode->ok = texture_image_decode(decode->image, decode->data, decode->size);
+
+	// Failing these only costs memory, the image stays usable as it is.
+	bool uncompressed = decode->ok && decode->image->compression == TEXTURE_COMPRESSION_NONE && texture_image_is_8bit_2d(decode->image);
+
+	if (uncompressed && decode->mipmaps && decode->image->levels == 1) {
+		struct texture_image chain;
+		if (texture_image_mipmaps(decode->image, &chain, decode->content, decode->filter)) {
+			texture_image_fini(decode->image);
+			*decode->image = chain;
+		}
+	}
+
+	// Images with transparency need the alpha of BC3.
+	enum texture_compression compression = decode->compression;
+	if (compression == TEXTURE_COMPRESSION_BC1 && uncompressed && has_alpha(decode->image)) {
+		compression = TEXTURE_COMPRESSION_BC3;
+	}
+
+	struct texture_image compressed;
+	if (uncompressed && compression != TEXTURE_COMPRESSION_NONE && texture_image_compress(decode->image, &compressed, compression)) {
+		texture_image_fini(decode->image);
+		*decode->image = compressed;
+	}
+}
+
+void texture_images_decode(struct texture_decode *decodes, size_t count) {
+	struct jobs_batch batch = {0};
+
+	// PNG/JPEG decoding is entirely CPU bound and images are independent, one job each spreads them across the cores.
+	for (size_t i = 0; i < count; i++) {
+		jobs_submit(&batch, decode_job, &decodes[i]);
+	}
+
+	jobs_wait(&batch);
+}
+
+size_t texture_levels_count(size_t width, size_t height) {
+	size_t levels = 1;
+	while ((width | height) >> levels) {
+		levels++;
+	}
+
+	return levels;
+}
+
+static size_t component_size(enum texture_type type) {
+	switch (type) {
+	    case TEXTURE_TYPE_HALF_FLOAT: return 2;
+	    case TEXTURE_TYPE_FLOAT: return sizeof (float);
+	    default: return 1;
+	}
+}
+
+// Of a single face.
+static size_t level_size(const struct texture_image *image, int width, int height) {
+	switch (image->compression) {
+	    case TEXTURE_COMPRESSION_BC1: return compress_blocks_count(width, height) * 8;
+	    case TEXTURE_COMPRESSION_BC3:
+	    case TEXTURE_COMPRESSION_BC5:
+	    case TEXTURE_COMPRESSION_BC7: return compress_blocks_count(width, height) * 16;
+	    default: return (size_t) width * height * image->components * component_size(image->type);
+	}
+}
+
+bool texture_image_is_8bit_2d(const struct texture_image *image) {
+	return image->type == TEXTURE_TYPE_UNSIGNED_BYTE && image->faces == 1;
+}
+
+size_t texture_image_level(const struct texture_image *image, size_t level, int *width, int *height, size_t *offset) {
+	size_t skipped = 0;
+
+	for (size_t i = 0; i < level; i++) {
+		skipped += level_size(image, image->width >> i ? image->width >> i : 1, image->height >> i ? image->height >> i : 1) * image->faces;
+	}
+
+	int level_width = image->width >> level ? image->width >> level : 1;
+	int level_height = image->height >> level ? image->height >> level : 1;
+
+	if (width) {
+		*width = level_width;
+	}
+
+	if (height) {
+		*height = level_height;
+	}
+
+	if (offset) {
+		*offset = skipped;
+	}
+
+	return level_size(image, level_width, level_height);
+}
+
+// Tables between 8 bit sRGB and linear floats, built once per chain.
+// Going back indexes a 12 bit quantization of the linear value, finer than 8 bits where sRGB is steep.
+#define TEXTURE_LINEAR_STEPS 4096
+
+struct gamma_tables {
+	float to_linear[256];
+	unsigned char to_srgb[TEXTURE_LINEAR_STEPS];
+};
+
+static void gamma_tables_init(struct gamma_tables *tables) {
+	for (int i = 0; i < 256; i++) {
+		float value = i / 255.0f;
+		tables->to_linear[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	for (int i = 0; i < TEXTURE_LINEAR_STEPS; i++) {
+		float value = i / (float) (TEXTURE_LINEAR_STEPS - 1);
+		float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1 / 2.4f) - 0.055f;
+		tables->to_srgb[i] = (unsigned char) (srgb * 255.0f + 0.5f);
+	}
+}
+
+static inline float saturate(float value) {
+	return value < 0 ? 0 : value > 1 ? 1 : value;
+}
+
+static void unpack(const unsigned char *pixels, size_t count, int components, enum texture_content content, const struct gamma_tables *tables, float *output) {
+	for (size_t i = 0; i < count; i++) {
+		for (int c = 0; c < components; c++) {
+			unsigned char value = pixels[i * components + c];
+
+			if (c < 3 && content == TEXTURE_CONTENT_SRGB) {
+				output[i * components + c] = tables->to_linear[value];
+			} else if (c < 3 && content == TEXTURE_CONTENT_NORMAL) {
+				output[i * components + c] = value * (2 / 255.0f) - 1;
+			} else {
+				output[i * components + c] = value / 255.0f;
+			}
+		}
+	}
+}
+
+static void pack(const float *input, size_t count, int components, enum texture_content content, const struct gamma_tables *tables, unsigned char *pixels) {
+	for (size_t i = 0; i < count; i++) {
+		const float *texel = input + i * components;
+		float normal[3] = {0, 0, 1};
+
+		if (content == TEXTURE_CONTENT_NORMAL) {
+			float length = sqrtf(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+			if (length > 1e-6f) {
+				for (int c = 0; c < 3; c++) {
+					normal[c] = texel[c] / length;
+				}
+			}
+		}
+
+		for (int c = 0; c < components; c++) {
+			unsigned char *output = &pixels[i * components + c];
+
+			if (c < 3 && content == TEXTURE_CONTENT_SRGB) {
+				*output = tables->to_srgb[(int) (saturate(texel[c]) * (TEXTURE_LINEAR_STEPS - 1) + 0.5f)];
+			} else if (c < 3 && content == TEXTURE_CONTENT_NORMAL) {
+				*output = (unsigned char) (saturate(normal[c] * 0.5f + 0.5f) * 255.0f + 0.5f);
+			} else {
+				*output = (unsigned char) (saturate(texel[c]) * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+// 2x2 box filter over 8 bit values, the last row or column gets repeated for odd dimensions.
+// Four RGBA texels at a time with SSE2, eight RGB or RGBA ones with NEON.
+static void downsample_box(const unsigned char *source, int width, int height, int components, unsigned char *destination) {
+	int half_width = width > 1 ? width / 2 : 1;
+	int half_height = height > 1 ? height / 2 : 1;
+	size_t row = (size_t) width * components;
+
+	for (int y = 0; y < half_height; y++) {
+		const unsigned char *top = source + (size_t) (2 * y) * row;
+		const unsigned char *bottom = 2 * y + 1 < height ? top + row : top;
+		unsigned char *output = destination + (size_t) y * half_width * components;
+		int x = 0;
+
+#if defined(__SSE2__)
+		if (components == 4) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i rounding = _mm_set1_epi16(2);
+
+			for (; x + 4 <= half_width && 2 * x + 8 <= width; x += 4) {
+				__m128i top0 = _mm_loadu_si128((const __m128i *) (top + x * 8));
+				__m128i top1 = _mm_loadu_si128((const __m128i *) (top + x * 8 + 16));
+				__m128i bottom0 = _mm_loadu_si128((const __m128i *) (bottom + x * 8));
+				__m128i bottom1 = _mm_loadu_si128((const __m128i *) (bottom + x * 8 + 16));
+
+				// Vertical sums in 16 bits, two texels per register.
+				__m128i a = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero), _mm_unpacklo_epi8(bottom0, zero));
+				__m128i b = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero), _mm_unpackhi_epi8(bottom0, zero));
+				__m128i c = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero), _mm_unpacklo_epi8(bottom1, zero));
+				__m128i d = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero), _mm_unpackhi_epi8(bottom1, zero));
+
+				// Horizontal sums, each texel with its right neighbour in the upper half.
+				a = _mm_add_epi16(a, _mm_srli_si128(a, 8));
+				b = _mm_add_epi16(b, _mm_srli_si128(b, 8));
+				c = _mm_add_epi16(c, _mm_srli_si128(c, 8));
+				d = _mm_add_epi16(d, _mm_srli_si128(d, 8));
+
+				__m128i ab = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(a, b), rounding), 2);
+				__m128i cd = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(c, d), rounding), 2);
+				_mm_storeu_si128((__m128i *) (output + x * 4), _mm_packus_epi16(ab, cd));
+			}
+		}
+#elif defined(__ARM_NEON)
+		if (components == 4) {
+			for (; x + 8 <= half_width && 2 * x + 16 <= width; x += 8) {
+				uint8x16x4_t upper = vld4q_u8(top + x * 8);
+				uint8x16x4_t lower = vld4q_u8(bottom + x * 8);
+				uint8x8x4_t averaged;
+
+				for (int c = 0; c < 4; c++) {
+					uint16x8_t sum = vaddq_u16(vpaddlq_u8(upper.val[c]), vpaddlq_u8(lower.val[c]));
+					averaged.val[c] = vrshrn_n_u16(sum, 2);
+				}
+
+				vst4_u8(output + x * 4, averaged);
+			}
+		} else if (components == 3) {
+			for (; x + 8 <= half_width && 2 * x + 16 <= width; x += 8) {
+				uint8x16x3_t upper = vld3q_u8(top + x * 6);
+				uint8x16x3_t lower = vld3q_u8(bottom + x * 6);
+				uint8x8x3_t averaged;
+
+				for (int c = 0; c < 3; c++) {
+					uint16x8_t sum = vaddq_u16(vpaddlq_u8(upper.val[c]), vpaddlq_u8(lower.val[c]));
+					averaged.val[c] = vrshrn_n_u16(sum, 2);
+				}
+
+				vst3_u8(output + x * 3, averaged);
+			}
+		}
+#endif
+
+		for (; x < half_width; x++) {
+			size_t left = (size_t) (2 * x) * components;
+			size_t right = 2 * x + 1 < width ? left + components : left;
+
+			for (int c = 0; c < components; c++) {
+				output[x * components + c] = (top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) / 4;
+			}
+		}
+	}
+}
+
+// Filters for the content that can't be averaged as 8 bit values, separable and applied to floats.
+// The box is the same as downsample_box(), Kaiser is a windowed sinc with taps at -2.5 to 2.5 source texels from the output center.
+#define TEXTURE_FILTER_TAPS_MAX 6
+#define TEXTURE_KAISER_ALPHA 4.0f
+
+struct kernel {
+	int taps;
+	int first; // Offset of the first tap from twice the output coordinate.
+	float weights[TEXTURE_FILTER_TAPS_MAX];
+};
+
+static float bessel_i0(float x) {
+	float sum = 1, term = 1;
+	for (int k = 1; k < 16; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static void kernel_init(struct kernel *kernel, enum texture_filter filter) {
+	if (filter == TEXTURE_FILTER_BOX) {
+		*kernel = (struct kernel) {.taps = 2, .first = 0, .weights = {0.5f, 0.5f}};
+		return;
+	}
+
+	kernel->taps = TEXTURE_FILTER_TAPS_MAX;
+	kernel->first = -(TEXTURE_FILTER_TAPS_MAX / 2 - 1);
+
+	float total = 0;
+	for (int i = 0; i < kernel->taps; i++) {
+		float distance = i - (kernel->taps - 1) / 2.0f;
+		float x = (float) M_PI * distance / 2; // Cutoff at the new Nyquist frequency.
+		float window = distance / (kernel->taps / 2.0f);
+
+		kernel->weights[i] = sinf(x) / x * bessel_i0(TEXTURE_KAISER_ALPHA * sqrtf(1 - window * window)) / bessel_i0(TEXTURE_KAISER_ALPHA);
+		total += kernel->weights[i];
+	}
+
+	for (int i = 0; i < kernel->taps; i++) {
+		kernel->weights[i] /= total;
+	}
+}
+
+static inline int clamp_index(int index, int length) {
+	return index < 0 ? 0 : index >= length ? length - 1 : index;
+}
+
+static void filter_row(const float *input, int length, int count, int components, const struct kernel *kernel, float *output) {
+	for (int i = 0; i < count; i++) {
+		for (int c = 0; c < components; c++) {
+			float sum = 0;
+			for (int t = 0; t < kernel->taps; t++) {
+				sum += kernel->weights[t] * input[clamp_index(2 * i + kernel->first + t, length) * components + c];
+			}
+
+			output[i * components + c] = sum;
+		}
+	}
+}
+
+static void accumulate(float *restrict output, const float *restrict row, float weight, size_t count) {
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 factor = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(_mm_loadu_ps(row + i), factor)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(output + i, vmlaq_n_f32(vld1q_f32(output + i), vld1q_f32(row + i), weight));
+	}
+#endif
+
+	for (; i < count; i++) {
+		output[i] += row[i] * weight;
+	}
+}
+
+// Floats needed by downsample_filtered() for a level of the given width.
+static size_t filtered_buffer_size(int width, int components) {
+	size_t half_width = width > 1 ? width / 2 : 1;
+	return ((size_t) width + (TEXTURE_FILTER_TAPS_MAX + 1) * half_width) * components;
+}
+
+// Rows are filtered horizontally as the output needs them and kept in a window of `taps` rows, then combined vertically.
+// Output rows advance two source rows at a time so a row is only ever filtered once.
+static void downsample_filtered(const unsigned char *source, int width, int height, int components, enum texture_content content, const struct kernel *kernel, const struct gamma_tables *tables, float *buffer, unsigned char *destination) {
+	int half_width = width > 1 ? width / 2 : 1;
+	int half_height = height > 1 ? height / 2 : 1;
+	size_t row_floats = (size_t) half_width * components;
+
+	float *unpacked = buffer;
+	float *output = unpacked + (size_t) width * components;
+	float *rows = output + row_floats;
+
+	// Source row held by each slot of the window.
+	int held[TEXTURE_FILTER_TAPS_MAX];
+	for (int i = 0; i < kernel->taps; i++) {
+		held[i] = -1;
+	}
+
+	for (int y = 0; y < half_height; y++) {
+		memset(output, 0, row_floats * sizeof *output);
+
+		// Clamped rows of a window are consecutive, so they never share a slot.
+		for (int t = 0; t < kernel->taps; t++) {
+			int at = clamp_index(2 * y + kernel->first + t, height);
+			float *row = rows + (size_t) (at % kernel->taps) * row_floats;
+
+			if (held[at % kernel->taps] != at) {
+				unpack(source + (size_t) at * width * components, width, components, content, tables, unpacked);
+				filter_row(unpacked, width, half_width, components, kernel, row);
+				held[at % kernel->taps] = at;
+			}
+
+			accumulate(output, row, kernel->weights[t], row_floats);
+		}
+
+		pack(output, half_width, components, content, tables, destination + (size_t) y * row_floats);
+	}
+}
+
+bool texture_image_mipmaps(const struct texture_image *image, struct texture_image *chain, enum texture_content content, enum texture_filter filter) {
+	if (!texture_image_is_8bit_2d(image) || image->compression != TEXTURE_COMPRESSION_NONE) {
+		return false;
+	}
 
-	unsigned char *decoded = stbi_load_from_memory(data, size, &width, &height, &components, 0);
-	if (!decoded) {
+	*chain = *image;
+	chain->levels = texture_levels_count(image->width, image->height);
+
+	size_t offset;
+	chain->size = texture_image_level(chain, chain->levels - 1, NULL, NULL, &offset) + offset;
+	chain->pixels = malloc(chain->size);
+	if (!chain->pixels) {
 		return false;
 	}
 
-	enum texture_format format;
-	switch (components) {
-	    case 3: format = TEXTURE_FORMAT_RGB; break;
-	    case 4: format = TEXTURE_FORMAT_RGBA; break;
+	size_t size = texture_image_level(image, 0, NULL, NULL, NULL);
+	memcpy(chain->pixels, image->pixels, size);
+
+	// Linear content with a box filter stays in 8 bits, everything else goes through floats a few rows at a time.
+	bool filtered = content != TEXTURE_CONTENT_LINEAR || filter != TEXTURE_FILTER_BOX;
+	struct gamma_tables *tables = NULL;
+	float *buffer = NULL;
+	struct kernel kernel;
+
+	if (filtered) {
+		tables = malloc(sizeof *tables);
+		buffer = malloc(filtered_buffer_size(image->width, image->components) * sizeof *buffer);
+		if (!tables || !buffer) {
+			free(tables);
+			free(buffer);
+			free(chain->pixels);
+			return false;
+		}
+
+		gamma_tables_init(tables);
+		kernel_init(&kernel, filter);
+	}
+
+	// Each level from the previous one.
+	for (size_t level = 1; level < chain->levels; level++) {
+		int width, height;
+		size_t source, destination;
+		texture_image_level(chain, level - 1, &width, &height, &source);
+		texture_image_level(chain, level, NULL, NULL, &destination);
+
+		if (filtered) {
+			downsample_filtered(chain->pixels + source, width, height, chain->components, content, &kernel, tables, buffer, chain->pixels + destination);
+		} else {
+			downsample_box(chain->pixels + source, width, height, chain->components, chain->pixels + destination);
+		}
+	}
+
+	free(tables);
+	free(buffer);
+
+	return true;
+}
+
+enum texture_content texture_kind_content(enum texture_kind kind) {
+	switch (kind) {
+	    case TEXTURE_KIND_ALBEDO:
+	    case TEXTURE_KIND_EMISSION: return TEXTURE_CONTENT_SRGB;
+	    case TEXTURE_KIND_NORMAL: return TEXTURE_CONTENT_NORMAL;
+	    default: return TEXTURE_CONTENT_LINEAR;
+	}
+}
+
+bool texture_image_compress(const struct texture_image *image, struct texture_image *compressed, enum texture_compression compression) {
+	void (*encode)(const unsigned char *, int, int, int, unsigned char *);
+	switch (compression) {
+	    case TEXTURE_COMPRESSION_BC1: encode = compress_bc1; break;
+	    case TEXTURE_COMPRESSION_BC3: encode = compress_bc3; break;
+	    case TEXTURE_COMPRESSION_BC5: encode = compress_bc5; break;
+	    default: return false;
+	}
+
+	if (!texture_image_is_8bit_2d(image)) {
+		return false;
+	}
+
+	*compressed = *image;
+	compressed->compression = compression;
+
+	size_t offset;
+	compressed->size = texture_image_level(compressed, compressed->levels - 1, NULL, NULL, &offset) + offset;
+	compressed->pixels = malloc(compressed->size);
+	if (!compressed->pixels) {
+		return false;
+	}
+
+	for (size_t level = 0; level < image->levels; level++) {
+		int width, height;
+		size_t source, destination;
+		texture_image_level(image, level, &width, &height, &source);
+		texture_image_level(compressed, level, NULL, NULL, &destination);
+
+		encode(image->pixels + source, width, height, image->components, compressed->pixels + destination);
+	}
+
+	return true;
+}
+
+void texture_image_fini(struct texture_image *image) {
+	stbi_image_free(image->pixels);
+	image->pixels = NULL;
+}
+
+bool texture_init_from_image(struct texture *texture, enum texture_kind kind, const struct texture_image *image) {
+	// Compressed and HDR images can't have their mipmaps generated, images with levels don't need it.
+	if (image->compression != TEXTURE_COMPRESSION_NONE || image->levels > 1 || !texture_image_is_8bit_2d(image)) {
+		return texture_init_streaming(texture, kind, image, 0);
+	}
+
+	// The chain is made here rather than by glGenerateMipmap, which filters sRGB colors and normals as plain values.
+	struct texture_image chain;
+	if (!texture_image_mipmaps(image, &chain, texture_kind_content(kind), TEXTURE_FILTER_BOX)) {
+		return false;
+	}
+
+	bool ok = texture_init_streaming(texture, kind, &chain, 0);
+	texture_image_fini(&chain);
+
+	return ok;
+}
+
+bool texture_init_streaming(struct texture *texture, enum texture_kind kind, const struct texture_image *image, size_t base_level) {
+	enum texture_format format = TEXTURE_FORMAT_RGBA;
+	enum texture_format_internal format_internal;
+
+	switch (image->compression) {
+	    case TEXTURE_COMPRESSION_BC1: format_internal = TEXTURE_FORMAT_INTERNAL_BC1; break;
+	    case TEXTURE_COMPRESSION_BC3: format_internal = TEXTURE_FORMAT_INTERNAL_BC3; break;
+	    case TEXTURE_COMPRESSION_BC5: format_internal = TEXTURE_FORMAT_INTERNAL_BC5; break;
+	    case TEXTURE_COMPRESSION_BC7: format_internal = TEXTURE_FORMAT_INTERNAL_BC7; break;
 	    default:
-		    fprintf(stderr, "Unsupported texture data format\n");
-		    stbi_image_free(decoded);
-		    return false;
+		    if (image->components != 3 && image->components != 4) {
+			    fprintf(stderr, "Unsupported texture data format\n");
+			    return false;
+		    }
+
+		    format = image->components == 3 ? TEXTURE_FORMAT_RGB : TEXTURE_FORMAT_RGBA;
+		    format_internal = TEXTURE_FORMAT_INTERNAL_RGBA8;
+
+		    // Full floats are only ever lighting, half of them is plenty.
+		    if (image->type != TEXTURE_TYPE_UNSIGNED_BYTE) {
+			    format_internal = image->components == 3 ? TEXTURE_FORMAT_INTERNAL_RGB16F : TEXTURE_FORMAT_INTERNAL_RGBA16F;
+		    }
 	}
 
-	texture_init(texture, kind, width, height, true, TEXTURE_TYPE_UNSIGNED_BYTE, format, TEXTURE_FORMAT_INTERNAL_RGBA8);
-	texture_replace_data(texture, 0, width, height, decoded);
 
-	// Cleanup.
-	stbi_image_free(decoded);
+	// BC7 is core in 4.2 only.
+	if (image->compression == TEXTURE_COMPRESSION_BC7 && !window_extension_supported("GL_ARB_texture_compression_bptc")) {
+		fprintf(stderr, "BC7 textures are not supported by the driver\n");
+		return false;
+	}
+
+	describe(texture, kind, image->width, image->height, true, image->type, format, format_internal);
+
+	// Cubemaps have to be of a cubemap kind, and the other way around.
+	if ((image->faces == 6) != (texture->gl_target == GL_TEXTURE_CUBE_MAP)) {
+		fprintf(stderr, "Texture faces don't match its kind\n");
+		return false;
+	}
+
+	// Nothing is resident yet.
+	texture->levels = image->levels;
+	texture->base_level = texture->levels;
+	texture_stream_levels(texture, image, base_level);
 
 	return true;
 }
 
+bool texture_init_from_memory(struct texture *texture, enum texture_kind kind, const unsigned char *data, size_t size) {
+	struct texture_image image;
+	if (!texture_image_decode(&image, data, size)) {
+		return false;
+	}
+
+	bool ok = texture_init_from_image(texture, kind, &image);
+
+	// Cleanup.
+	texture_image_fini(&image);
+
+	return ok;
+}
+
 void texture_switch(const struct texture *texture) {
 	// Figure out what OpenGL texture unit a given texture should be assigned to (based on its kind).
 	// This is actually the recommended way to enumerate that constant.
@@ -156,10 +822,40 @@ void texture_switch(const struct texture *texture) {
 	glBindTexture(texture->gl_target, texture->gl_id);
 }
 
+static size_t pixels_size(const struct texture *texture, unsigned int width, unsigned int height) {
+	size_t components = texture->gl_format == GL_RGBA ? 4 : 3;
+	size_t size = texture->gl_type == GL_FLOAT ? sizeof (float) : texture->gl_type == GL_HALF_FLOAT ? 2 : 1;
+
+	return width * height * components * size;
+}
+
+static void upload_level(struct texture *texture, GLenum target, unsigned int level, unsigned int width, unsigned int height, const void *data, size_t size) {
+	// Pixels go through the staging ring when available, it then acts as the pixel unpack buffer.
+	size_t offset;
+	bool staged = data && staging_write(data, size, &offset);
+	if (staged) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer());
+		data = (const void *) (uintptr_t) offset;
+	}
+
+	// Rows are tightly packed, RGB rows (and small mip levels) aren't necessarily 4-byte aligned.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (is_compressed(texture)) {
+		glCompressedTexImage2D(target, level, texture->gl_internal_format, width, height, 0, size, data);
+	} else {
+		glTexImage2D(target, level, texture->gl_internal_format, width, height, 0, texture->gl_format, texture->gl_type, data);
+	}
+
+	if (staged) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
 void texture_replace_data(struct texture *texture, unsigned int level, unsigned int width, unsigned int height, const void *data) {
 	texture_switch(texture);
 
-	glTexImage2D(texture->gl_target, level, texture->gl_internal_format, width, height, 0, texture->gl_format, texture->gl_type, data);
+	upload_level(texture, texture->gl_target, level, width, height, data, pixels_size(texture, width, height));
 
 	// Mimapping.
 	if (level == 0 && texture->levels > 1) {
@@ -167,6 +863,39 @@ void texture_replace_data(struct texture *texture, unsigned int level, unsigned
 	}
 }
 
+void texture_stream_levels(struct texture *texture, const struct texture_image *image, size_t base_level) {
+	// Dropping levels means starting over with a new texture object, OpenGL can't free individual levels.
+	// So does adding some to a texture with a handle, its levels and parameters are frozen.
+	if ((base_level > texture->base_level || texture->gl_handle) && texture->gl_id) {
+		release_handle(texture);
+		glDeleteTextures(1, &texture->gl_id);
+		texture->gl_id = 0;
+		texture->base_level = texture->levels;
+	}
+
+	if (!texture->gl_id) {
+		create(texture);
+		glTexParameteri(texture->gl_target, GL_TEXTURE_MAX_LEVEL, texture->levels - 1);
+	} else {
+		texture_switch(texture);
+	}
+
+	// Levels between the new and the current base are missing.
+	for (size_t level = base_level; level < texture->base_level; level++) {
+		int width, height;
+		size_t offset;
+		size_t size = texture_image_level(image, level, &width, &height, &offset);
+
+		for (size_t face = 0; face < image->faces; face++) {
+			GLenum target = image->faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : texture->gl_target;
+			upload_level(texture, target, level, width, height, image->pixels + offset + face * size, size);
+		}
+	}
+
+	texture->base_level = base_level;
+	glTexParameteri(texture->gl_target, GL_TEXTURE_BASE_LEVEL, base_level);
+}
+
 void texture_anisotropic_filtering(struct texture *texture, float anisotropy) {
 	// Ensure the driver supports the anisotropic extension before we attempt to do anything.
 	if (!window_extension_supported("GL_EXT_texture_filter_anisotropic")) {
@@ -185,3 +914,33 @@ void texture_anisotropic_filtering(struct texture *texture, float anisotropy) {
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropy);
 	}
 }
+
+bool texture_bindless(void) {
+	if (bindless.checked) {
+		return bindless.supported;
+	}
+
+	bindless.checked = true;
+
+	if (!window_extension_supported("GL_ARB_bindless_texture")) {
+		return false;
+	}
+
+	bindless.get_texture_handle = (get_texture_handle_function) glfwGetProcAddress("glGetTextureHandleARB");
+	bindless.make_resident = (make_texture_handle_resident_function) glfwGetProcAddress("glMakeTextureHandleResidentARB");
+	bindless.make_non_resident = (make_texture_handle_non_resident_function) glfwGetProcAddress("glMakeTextureHandleNonResidentARB");
+	bindless.supported = bindless.get_texture_handle && bindless.make_resident && bindless.make_non_resident;
+
+	return bindless.supported;
+}
+
+GLuint64 texture_handle(struct texture *texture) {
+	if (!texture->gl_handle && texture->gl_id && texture_bindless()) {
+		texture->gl_handle = bindless.get_texture_handle(texture->gl_id);
+		if (texture->gl_handle) {
+			bindless.make_resident(texture->gl_handle);
+		}
+	}
+
+	return texture->gl_handle;
+}
@@ -0,0 +1,297 @@
+#include "client.h"
+
+// Textures are shared between everything that uses the same image for the same kind of texture.
+// Images are identified by the hash of their encoded content, which also catches the same image embedded in different models.
+// The kind is part of the key because it decides the texture unit the texture gets bound to.
+
+// Textures start out with only their coarsest levels resident. Finer ones get uploaded as the renderer asks for them,
+// one level per texture and frame, and the least recently used ones lose theirs again when over the budget.
+
+struct entry {
+	uint64_t hash;
+	enum texture_kind kind;
+	struct texture *texture; // Has to stay a pointer for address stability (we hand off these pointers).
+	size_t uses;
+
+	// Every level of the image, to stream them in again after eviction.
+	// Textures that couldn't get one are fully resident and never stream.
+	bool streaming;
+	struct texture_image image;
+
+	// What was loaded, without its pixels, to tell images apart when their hashes collide.
+	// Fully resident textures keep a hash of their pixels instead, their image doesn't stay around.
+	struct texture_image source;
+	uint64_t pixels_hash;
+};
+
+static struct texturemanager {
+	struct entry *entries;
+	size_t used;
+	size_t capacity;
+
+	size_t budget;
+	size_t resident; // In bytes, levels of streaming textures only.
+	uint64_t frame;
+} tm = {
+	.budget = TEXTUREMANAGER_BUDGET,
+};
+
+// The image belongs to the import, which doesn't stay around.
+// Single level images get their mip chain generated, which they normally already got at import.
+static bool copy_image(const struct texture_image *image, enum texture_kind kind, struct texture_image *copy) {
+	if (image->levels == 1 && image->compression == TEXTURE_COMPRESSION_NONE) {
+		return texture_image_mipmaps(image, copy, texture_kind_content(kind), TEXTURE_FILTER_BOX);
+	}
+
+	*copy = *image;
+	copy->pixels = malloc(image->size);
+	if (!copy->pixels) {
+		return false;
+	}
+
+	memcpy(copy->pixels, image->pixels, image->size);
+
+	return true;
+}
+
+// Compressed levels take as much VRAM as they take in memory, uncompressed ones are always stored as RGBA8.
+static size_t levels_size(const struct texture_image *image, size_t first, size_t last) {
+	size_t size = 0;
+	for (size_t i = first; i < last; i++) {
+		int width, height;
+		size_t length = texture_image_level(image, i, &width, &height, NULL);
+
+		size += image->compression == TEXTURE_COMPRESSION_NONE ? (size_t) width * height * 4 : length;
+	}
+
+	return size;
+}
+
+// Finest level that is still small enough to always be resident.
+static size_t initial_level(const struct texture_image *image) {
+	size_t size = image->width > image->height ? image->width : image->height;
+	size_t level = 0;
+	while (level + 1 < image->levels && size >> level > TEXTUREMANAGER_INITIAL_SIZE) {
+		level++;
+	}
+
+	return level;
+}
+
+static size_t finest_level_size(const struct texture_image *image) {
+	return texture_image_level(image, 0, NULL, NULL, NULL) * image->faces;
+}
+
+static uint64_t pixels_hash(const struct texture_image *image) {
+	return utils_hash(image->pixels, image->size, UTILS_HASH_SEED);
+}
+
+// Hashes can collide, the image has to actually be the same.
+static bool entry_matches(const struct entry *entry, uint64_t hash, enum texture_kind kind, const struct texture_image *image) {
+	if (entry->hash != hash || entry->kind != kind) {
+		return false;
+	}
+
+	const struct texture_image *source = &entry->source;
+	if (source->width != image->width || source->height != image->height || source->components != image->components
+	    || source->type != image->type || source->compression != image->compression || source->faces != image->faces
+	    || source->levels != image->levels || source->size != image->size) {
+		return false;
+	}
+
+	// The copy starts with the finest level as it was, whatever levels got generated after it.
+	if (entry->streaming) {
+		return memcmp(entry->image.pixels, image->pixels, finest_level_size(image)) == 0;
+	}
+
+	return entry->pixels_hash == pixels_hash(image);
+}
+
+static void stream_levels(struct entry *entry, size_t base_level) {
+	struct texture *texture = entry->texture;
+
+	tm.resident -= levels_size(&entry->image, texture->base_level, texture->levels);
+	texture_stream_levels(texture, &entry->image, base_level);
+	tm.resident += levels_size(&entry->image, texture->base_level, texture->levels);
+}
+
+// Drops the unneeded levels of the least recently used texture that has some.
+// Textures not used this frame go back to their initial level, the others to the level they were asked for.
+static bool evict(void) {
+	struct entry *victim = NULL;
+	size_t victim_level = 0;
+
+	for (size_t i = 0; i < tm.used; i++) {
+		struct entry *entry = &tm.entries[i];
+		struct texture *texture = entry->texture;
+		if (!entry->streaming) {
+			continue;
+		}
+
+		size_t needed = texture->last_used == tm.frame ? texture->wanted_level : texture->levels;
+		size_t level = initial_level(&entry->image);
+		if (needed < level) {
+			level = needed;
+		}
+
+		if (level <= texture->base_level) {
+			continue;
+		}
+
+		if (!victim || texture->last_used < victim->texture->last_used) {
+			victim = entry;
+			victim_level = level;
+		}
+	}
+
+	if (!victim) {
+		return false;
+	}
+
+	stream_levels(victim, victim_level);
+
+	return true;
+}
+
+struct texture *texturemanager_load_texture(uint64_t hash, enum texture_kind kind, const struct texture_image *image) {
+	// Ensure the entry doesn't already exist.
+	for (size_t i = 0; i < tm.used; i++) {
+		struct entry *entry = &tm.entries[i];
+		if (entry_matches(entry, hash, kind, image)) {
+			entry->uses++;
+			return entry->texture;
+		}
+	}
+
+	// Prepare storage for the new entry if there isn't enough space.
+	if (tm.used == tm.capacity) {
+		size_t new_capacity = tm.capacity ? tm.capacity * 2 : 16;
+
+		void *new_entries = realloc(tm.entries, new_capacity * sizeof *tm.entries);
+		if (!new_entries) {
+			return NULL;
+		}
+
+		tm.capacity = new_capacity;
+		tm.entries = new_entries;
+	}
+
+	// Upload the texture, only its coarsest levels when it can stream.
+	struct texture *texture = malloc(sizeof *texture);
+	if (!texture) {
+		return NULL;
+	}
+
+	struct texture_image copy;
+	bool streaming = copy_image(image, kind, &copy);
+	if (streaming) {
+		if (!texture_init_streaming(texture, kind, &copy, initial_level(&copy))) {
+			texture_image_fini(&copy);
+			free(texture);
+			return NULL;
+		}
+
+		tm.resident += levels_size(&copy, texture->base_level, texture->levels);
+	} else if (!texture_init_from_image(texture, kind, image)) {
+		free(texture);
+		return NULL;
+	}
+
+	// Store the texture.
+	struct entry *entry = &tm.entries[tm.used++];
+
+	entry->hash = hash;
+	entry->kind = kind;
+	entry->texture = texture;
+	entry->uses = 1;
+	entry->streaming = streaming;
+	entry->image = streaming ? copy : (struct texture_image) {0};
+	entry->source = *image;
+	entry->source.pixels = NULL;
+	entry->pixels_hash = streaming ? 0 : pixels_hash(image);
+
+	return texture;
+}
+
+void texturemanager_unload_texture(const struct texture *texture) {
+	for (size_t i = 0; i < tm.used; i++) {
+		struct entry *entry = &tm.entries[i];
+		if (entry->texture == texture) {
+			entry->uses--;
+
+			// Check if this was the last usage of this entry. If so, time to cleanup.
+			if (entry->uses == 0) {
+				if (entry->streaming) {
+					tm.resident -= levels_size(&entry->image, entry->texture->base_level, entry->texture->levels);
+					texture_image_fini(&entry->image);
+				}
+
+				texture_fini(entry->texture);
+				free(entry->texture);
+
+				// Replace the current entry with the last entry, unless we are the last entry.
+				bool is_last_entry = i == tm.used - 1;
+				if (!is_last_entry) {
+					*entry = tm.entries[tm.used - 1];
+				}
+
+				tm.used--;
+			}
+
+			return;
+		}
+	}
+}
+
+void texturemanager_request(struct texture *texture, size_t level) {
+	if (level < texture->wanted_level) {
+		texture->wanted_level = level;
+	}
+
+	texture->last_used = tm.frame;
+}
+
+void texturemanager_update(size_t upload_budget) {
+	size_t uploaded = 0;
+
+	for (size_t i = 0; i < tm.used && uploaded < upload_budget; i++) {
+		struct entry *entry = &tm.entries[i];
+		struct texture *texture = entry->texture;
+		if (!entry->streaming || texture->last_used != tm.frame || texture->wanted_level >= texture->base_level) {
+			continue;
+		}
+
+		// Make room by evicting others first, giving up when nothing else can go.
+		size_t size = levels_size(&entry->image, texture->base_level - 1, texture->base_level);
+		while (tm.resident + size > tm.budget && evict()) {
+		}
+
+		if (tm.resident + size > tm.budget) {
+			continue;
+		}
+
+		// Textures with a bindless handle start over with a new object, every resident level gets uploaded again.
+		size_t upload_size = texture->gl_handle ? levels_size(&entry->image, texture->base_level - 1, texture->levels) : size;
+
+		stream_levels(entry, texture->base_level - 1);
+		uploaded += upload_size;
+	}
+
+	// Requests are per frame.
+	for (size_t i = 0; i < tm.used; i++) {
+		tm.entries[i].texture->wanted_level = tm.entries[i].texture->levels;
+	}
+
+	tm.frame++;
+}
+
+void texturemanager_budget(size_t budget) {
+	tm.budget = budget;
+
+	while (tm.resident > tm.budget && evict()) {
+	}
+}
+
+size_t texturemanager_resident(void) {
+	return tm.resident;
+}
@@ -0,0 +1,580 @@
+#include "client.h"
+#include "tools.h"
+#include <time.h>
+
+#define TOOLS_DEFAULT_MODEL "assets/DamagedHelmet.glb"
+#define TOOLS_DEFAULT_ENVIRONMENT "assets/pisa.hdr"
+
+struct tool {
+	const char *name;
+	const char *usage;
+	int (*run)(int argc, char *argv[]);
+};
+
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parsed, with its buffers loaded.
+static cgltf_data *load_gltf(const char *filepath) {
+	cgltf_options options = {
+		.file = {
+			.read = cgltf_mapped_file_read,
+			.release = cgltf_mapped_file_release,
+		},
+	};
+	cgltf_data *gltf = NULL;
+
+	if (cgltf_parse_file(&options, filepath, &gltf) != cgltf_result_success || cgltf_load_buffers(&options, gltf, filepath) != cgltf_result_success) {
+		fprintf(stderr, "Unable to load %s\n", filepath);
+		cgltf_free(gltf);
+		return NULL;
+	}
+
+	return gltf;
+}
+
+static int benchmark_decode(int argc, char *argv[]) {
+	const char *filepath = argc > 1 ? argv[1] : TOOLS_DEFAULT_MODEL;
+	int iterations = argc > 2 ? atoi(argv[2]) : 3;
+	if (iterations <= 0) {
+		return EXIT_FAILURE;
+	}
+
+	cgltf_data *gltf = load_gltf(filepath);
+	if (!gltf) {
+		return EXIT_FAILURE;
+	}
+
+	struct texture_image *images = calloc(gltf->images_count, sizeof *images);
+	struct texture_decode *decodes = calloc(gltf->images_count, sizeof *decodes);
+	size_t count = 0;
+	size_t encoded_bytes = 0;
+
+	for (size_t i = 0; images && decodes && i < gltf->images_count; i++) {
+		const cgltf_buffer_view *view = gltf->images[i].buffer_view;
+		if (!view || !view->buffer->data) {
+			continue;
+		}
+
+		decodes[count].data = (const unsigned char *) view->buffer->data + view->offset;
+		decodes[count].size = view->size;
+		decodes[count].image = &images[count];
+		encoded_bytes += view->size;
+		count++;
+	}
+
+	printf("%s: %zu images, %.2f MB encoded, %zu workers\n", filepath, count, encoded_bytes / 1e6, jobs_worker_count());
+
+	for (int parallel = 0; parallel <= 1; parallel++) {
+		double best = DBL_MAX;
+		size_t decoded_bytes = 0;
+
+		for (int iteration = 0; iteration < iterations; iteration++) {
+			double start = now();
+
+			if (parallel) {
+				texture_images_decode(decodes, count);
+			} else {
+				for (size_t i = 0; i < count; i++) {
+					decodes[i].ok = texture_image_decode(decodes[i].image, decodes[i].data, decodes[i].size);
+				}
+			}
+
+			double elapsed = now() - start;
+			if (elapsed < best) {
+				best = elapsed;
+			}
+
+			decoded_bytes = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (decodes[i].ok) {
+					decoded_bytes += (size_t) images[i].width * images[i].height * images[i].components;
+				}
+
+				texture_image_fini(&images[i]);
+			}
+		}
+
+		printf("%-10s %8.2f ms %10.2f MB/s encoded %10.2f MB/s decoded\n",
+			parallel ? "parallel" : "serial",
+			best * 1e3,
+			encoded_bytes / 1e6 / best,
+			decoded_bytes / 1e6 / best
+		);
+	}
+
+	free(decodes);
+	free(images);
+	cgltf_free(gltf);
+
+	return EXIT_SUCCESS;
+}
+
+static int benchmark_mipmaps(int argc, char *argv[]) {
+	const char *filepath = argc > 1 ? argv[1] : TOOLS_DEFAULT_MODEL;
+	int iterations = argc > 2 ? atoi(argv[2]) : 3;
+	if (iterations <= 0) {
+		return EXIT_FAILURE;
+	}
+
+	cgltf_data *gltf = load_gltf(filepath);
+	if (!gltf) {
+		return EXIT_FAILURE;
+	}
+
+	struct texture_image *images = calloc(gltf->images_count, sizeof *images);
+	size_t count = 0;
+	size_t pixels = 0;
+
+	for (size_t i = 0; images && i < gltf->images_count; i++) {
+		const cgltf_buffer_view *view = gltf->images[i].buffer_view;
+		if (!view || !view->buffer->data) {
+			continue;
+		}
+
+		if (texture_image_decode(&images[count], (const unsigned char *) view->buffer->data + view->offset, view->size)) {
+			pixels += (size_t) images[count].width * images[count].height;
+			count++;
+		}
+	}
+
+	printf("%s: %zu images, %.2f Mpixels at the finest level\n", filepath, count, pixels / 1e6);
+
+	static const struct {
+		const char *name;
+		enum texture_content content;
+		enum texture_filter filter;
+	} variants[] = {
+		{"box linear", TEXTURE_CONTENT_LINEAR, TEXTURE_FILTER_BOX},
+		{"box srgb", TEXTURE_CONTENT_SRGB, TEXTURE_FILTER_BOX},
+		{"box normal", TEXTURE_CONTENT_NORMAL, TEXTURE_FILTER_BOX},
+		{"kaiser linear", TEXTURE_CONTENT_LINEAR, TEXTURE_FILTER_KAISER},
+		{"kaiser srgb", TEXTURE_CONTENT_SRGB, TEXTURE_FILTER_KAISER},
+		{"kaiser normal", TEXTURE_CONTENT_NORMAL, TEXTURE_FILTER_KAISER},
+	};
+
+	// Single threaded, the throughput of one worker.
+	for (size_t v = 0; v < sizeof variants / sizeof *variants; v++) {
+		double best = DBL_MAX;
+
+		for (int iteration = 0; iteration < iterations; iteration++) {
+			double start = now();
+
+			for (size_t i = 0; i < count; i++) {
+				struct texture_image chain;
+				if (texture_image_mipmaps(&images[i], &chain, variants[v].content, variants[v].filter)) {
+					texture_image_fini(&chain);
+				}
+			}
+
+			double elapsed = now() - start;
+			if (elapsed < best) {
+				best = elapsed;
+			}
+		}
+
+		printf("%-14s %8.2f ms %10.2f Mpixels/s\n", variants[v].name, best * 1e3, pixels / 1e6 / best);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		texture_image_fini(&images[i]);
+	}
+
+	free(images);
+	cgltf_free(gltf);
+
+	return EXIT_SUCCESS;
+}
+
+struct quantization_error {
+	const char *name;
+	const char *unit;
+	double max;
+	double sum;
+	size_t count;
+	size_t full_bytes;
+	size_t compact_bytes;
+};
+
+static void quantization_error_add(struct quantization_error *error, double value) {
+	error->max = value > error->max ? value : error->max;
+	error->sum += value;
+	error->count++;
+}
+
+static double angle_degrees(const float *a, const float *b) {
+	double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	double length = sqrt((a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) * (b[0] * b[0] + b[1] * b[1] + b[2] * b[2]));
+	double cosine = length > 0 ? dot / length : 1;
+	return acos(cosine > 1 ? 1 : cosine < -1 ? -1 : cosine) * 180 / M_PI;
+}
+
+// Same formats as MODEL_COMPACT_VERTICES, see model.c.
+static void measure_quantization(const cgltf_attribute *attribute, struct quantization_error errors[]) {
+	const cgltf_accessor *accessor = attribute->data;
+	if (attribute->index != 0 || !accessor->buffer_view || !accessor->buffer_view->buffer->data || accessor->component_type != cgltf_component_type_r_32f || accessor->normalized) {
+		return;
+	}
+
+	const char *data = (const char *) accessor->buffer_view->buffer->data + accessor->buffer_view->offset + accessor->offset;
+	size_t stride = accessor->stride;
+	size_t count = accessor->count;
+	int components = cgltf_num_components(accessor->type);
+
+	if (attribute->type == cgltf_attribute_type_normal && components == 3) {
+		int16_t *compact = malloc(count * 2 * sizeof *compact);
+		if (compact) {
+			quantize_octahedral(data, stride, count, compact);
+
+			for (size_t i = 0; i < count; i++) {
+				float decoded[3];
+				dequantize_octahedral(compact + i * 2, decoded);
+				quantization_error_add(&errors[0], angle_degrees((const float *) (data + i * stride), decoded));
+			}
+
+			errors[0].full_bytes += count * 3 * sizeof (float);
+			errors[0].compact_bytes += count * 2 * sizeof *compact;
+		}
+		free(compact);
+	} else if (attribute->type == cgltf_attribute_type_tangent && components == 4) {
+		int16_t *compact = malloc(count * 4 * sizeof *compact);
+		if (compact) {
+			quantize_snorm16(data, stride, count, 4, compact);
+
+			for (size_t i = 0; i < count; i++) {
+				float decoded[3];
+				for (int c = 0; c < 3; c++) {
+					decoded[c] = dequantize_snorm16(compact[i * 4 + c]);
+				}
+
+				quantization_error_add(&errors[1], angle_degrees((const float *) (data + i * stride), decoded));
+			}
+
+			errors[1].full_bytes += count * 4 * sizeof (float);
+			errors[1].compact_bytes += count * 4 * sizeof *compact;
+		}
+		free(compact);
+	} else if (attribute->type == cgltf_attribute_type_texcoord && components == 2) {
+		uint16_t *compact = malloc(count * 2 * sizeof *compact);
+		if (compact) {
+			quantize_half(data, stride, count, 2, compact);
+
+			for (size_t i = 0; i < count; i++) {
+				const float *uv = (const float *) (data + i * stride);
+				for (int c = 0; c < 2; c++) {
+					quantization_error_add(&errors[2], fabs(dequantize_half(compact[i * 2 + c]) - uv[c]));
+				}
+			}
+
+			errors[2].full_bytes += count * 2 * sizeof (float);
+			errors[2].compact_bytes += count * 2 * sizeof *compact;
+		}
+		free(compact);
+	} else if (attribute->type == cgltf_attribute_type_color && (components == 3 || components == 4)) {
+		uint8_t *compact = malloc(count * components);
+		if (compact) {
+			quantize_unorm8(data, stride, count, components, compact);
+
+			for (size_t i = 0; i < count; i++) {
+				const float *color = (const float *) (data + i * stride);
+				for (int c = 0; c < components; c++) {
+					quantization_error_add(&errors[3], fabs(dequantize_unorm8(compact[i * components + c]) - color[c]));
+				}
+			}
+
+			errors[3].full_bytes += count * components * sizeof (float);
+			errors[3].compact_bytes += count * components;
+		}
+		free(compact);
+	}
+}
+
+static int report_quantization(int argc, char *argv[]) {
+	const char *filepath = argc > 1 ? argv[1] : TOOLS_DEFAULT_MODEL;
+
+	cgltf_data *gltf = load_gltf(filepath);
+	if (!gltf) {
+		return EXIT_FAILURE;
+	}
+
+	struct quantization_error errors[] = {
+		{.name = "normals", .unit = "degrees"},
+		{.name = "tangents", .unit = "degrees"},
+		{.name = "uvs", .unit = "uv units"},
+		{.name = "colors", .unit = "color units"},
+	};
+
+	for (size_t i = 0; i < gltf->meshes_count; i++) {
+		for (size_t j = 0; j < gltf->meshes[i].primitives_count; j++) {
+			const cgltf_primitive *primitive = &gltf->meshes[i].primitives[j];
+
+			for (size_t k = 0; k < primitive->attributes_count; k++) {
+				measure_quantization(&primitive->attributes[k], errors);
+			}
+		}
+	}
+
+	printf("%s: compact vertex formats are %s\n", filepath, MODEL_COMPACT_VERTICES ? "enabled" : "disabled");
+
+	for (size_t i = 0; i < ARRAY_COUNT(errors); i++) {
+		const struct quantization_error *error = &errors[i];
+		if (error->count == 0) {
+			continue;
+		}
+
+		printf("%-10s max %10.6f mean %10.6f %-12s %8.2f MB -> %8.2f MB\n",
+			error->name,
+			error->max,
+			error->sum / error->count,
+			error->unit,
+			error->full_bytes / 1e6,
+			error->compact_bytes / 1e6
+		);
+	}
+
+	cgltf_free(gltf);
+
+	return EXIT_SUCCESS;
+}
+
+static void print_geometry_stats(const char *stage, const uint32_t *indices, size_t indices_count, size_t vertices_count, double elapsed) {
+	struct optimizer_stats stats = optimizer_analyze(indices, indices_count, vertices_count, OPTIMIZER_STATS_CACHE_SIZE);
+	printf("  %-10s ACMR %6.3f ATVR %6.3f %10.2f ms\n", stage, stats.acmr, stats.atvr, elapsed * 1e3);
+}
+
+static int report_geometry(int argc, char *argv[]) {
+	const char *filepath = argc > 1 ? argv[1] : TOOLS_DEFAULT_MODEL;
+
+	cgltf_data *gltf = load_gltf(filepath);
+	if (!gltf) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: FIFO cache of %d vertices\n", filepath, OPTIMIZER_STATS_CACHE_SIZE);
+
+	for (size_t i = 0; i < gltf->meshes_count; i++) {
+		for (size_t j = 0; j < gltf->meshes[i].primitives_count; j++) {
+			const cgltf_primitive *primitive = &gltf->meshes[i].primitives[j];
+			if (primitive->type != cgltf_primitive_type_triangles || !primitive->indices) {
+				continue;
+			}
+
+			const cgltf_accessor *positions = NULL;
+			for (size_t k = 0; k < primitive->attributes_count; k++) {
+				if (primitive->attributes[k].type == cgltf_attribute_type_position) {
+					positions = primitive->attributes[k].data;
+				}
+			}
+
+			if (!positions || !positions->buffer_view) {
+				continue;
+			}
+
+			size_t vertices_count = positions->count;
+			size_t indices_count = primitive->indices->count;
+			uint32_t *indices = malloc(indices_count * sizeof *indices);
+			uint32_t *remap = malloc(vertices_count * sizeof *remap);
+			float *unpacked = malloc(vertices_count * 3 * sizeof *unpacked);
+
+			if (indices && remap && unpacked) {
+				for (size_t k = 0; k < indices_count; k++) {
+					size_t index = cgltf_accessor_read_index(primitive->indices, k);
+					indices[k] = index < vertices_count ? index : 0;
+				}
+
+				cgltf_accessor_unpack_floats(positions, unpacked, vertices_count * 3);
+
+				printf("mesh %zu primitive %zu: %zu triangles, %zu vertices\n", i, j, indices_count / 3, vertices_count);
+				print_geometry_stats("original", indices, indices_count, vertices_count, 0);
+
+				double start = now();
+				optimizer_reorder_for_cache(indices, indices_count, vertices_count);
+				print_geometry_stats("cache", indices, indices_count, vertices_count, now() - start);
+
+				start = now();
+				optimizer_reorder_for_overdraw(indices, indices_count, unpacked, 3 * sizeof *unpacked, vertices_count, OPTIMIZER_OVERDRAW_THRESHOLD);
+				print_geometry_stats("overdraw", indices, indices_count, vertices_count, now() - start);
+
+				start = now();
+				size_t used = optimizer_reorder_for_fetch(indices, indices_count, vertices_count, remap);
+				print_geometry_stats("fetch", indices, indices_count, used, now() - start);
+			}
+
+			free(indices);
+			free(remap);
+			free(unpacked);
+		}
+	}
+
+	cgltf_free(gltf);
+
+	return EXIT_SUCCESS;
+}
+
+// Diffuse irradiance comes from spherical harmonics, checked against Lambertian prefiltering on the texels of the finest level.
+static void check_irradiance(const struct ibl_cubemap *source, const float sh[IBL_SH_COUNT][3], int width, int texels, const char *name) {
+	int step = width > texels ? width / texels : 1;
+	double max = 0, sum = 0;
+	size_t count = 0;
+	double start = now();
+
+	for (int face = 0; face < 6; face++) {
+		for (int y = step / 2; y < width; y += step) {
+			for (int x = step / 2; x < width; x += step) {
+				float direction[3], expected[3], color[3];
+				ibl_texel_direction(face, x, y, width, direction);
+				ibl_prefilter(source, IBL_DISTRIBUTION_LAMBERTIAN, 1, ENVIRONMENT_SAMPLE_COUNT, direction, expected);
+				ibl_irradiance_evaluate(sh, direction, color);
+
+				for (int c = 0; c < 3; c++) {
+					double error = fabs(color[c] - expected[c]) / fmax(fabs(expected[c]), 1e-3);
+					max = fmax(max, error);
+					sum += error;
+					count++;
+				}
+			}
+		}
+	}
+
+	printf("%-10s max %10.6f mean %10.6f relative %8.2f ms\n", name, max, sum / count, (now() - start) * 1e3);
+}
+
+// Checks the prefiltered maps the client cached against the CPU reference, on a grid of texels of every face and level.
+static int reference_ibl(int argc, char *argv[]) {
+	const char *filepath = argc > 1 ? argv[1] : TOOLS_DEFAULT_ENVIRONMENT;
+	int texels = argc > 2 ? atoi(argv[2]) : 4;
+	if (texels <= 0) {
+		return EXIT_FAILURE;
+	}
+
+	struct texture_image image;
+	uint64_t hash;
+	if (!environment_source_read(filepath, &image, &hash)) {
+		fprintf(stderr, "Unable to load %s\n", filepath);
+		return EXIT_FAILURE;
+	}
+
+	float sh[IBL_SH_COUNT][3];
+	struct ibl_cubemap source;
+	bool ok = ibl_irradiance_sh(&image, sh);
+	ok = ok && (image.faces == 6 ? ibl_cubemap_from_image(&source, &image) : ibl_cubemap_from_equirectangular(&source, &image, ENVIRONMENT_CUBEMAP_SIZE));
+	texture_image_fini(&image);
+
+	if (!ok) {
+		fprintf(stderr, "Unable to make a cubemap out of %s\n", filepath);
+		return EXIT_FAILURE;
+	}
+
+	char path[256];
+	size_t size = 0;
+	unsigned char *data = NULL;
+	if (cache_path(path, sizeof path, ENVIRONMENT_CACHE_CATEGORY, environment_cache_key(hash))) {
+		data = cache_map(path, &size);
+	}
+
+	struct texture_image layout = environment_cache_layout(true);
+	struct environment_cache_header header = {0};
+	if (data && size >= sizeof header) {
+		memcpy(&header, data, sizeof header);
+	}
+
+	if (header.magic != ENVIRONMENT_CACHE_MAGIC || header.version != ENVIRONMENT_CACHE_VERSION || header.length != size - sizeof header || header.length != layout.size * (IBL_DISTRIBUTION_COUNT - IBL_DISTRIBUTION_GGX)) {
+		fprintf(stderr, "No prefiltered maps cached for %s, run the client with it first\n", filepath);
+		if (data) {
+			cache_unmap(data, size);
+		}
+		ibl_cubemap_fini(&source);
+		return EXIT_FAILURE;
+	}
+
+	static const char *const names[] = {"lambertian", "ggx", "charlie"};
+
+	printf("%s: %zux%zu texels of each face and level, source of %d pixels with %zu levels\n", filepath, (size_t) texels, (size_t) texels, source.size, source.levels);
+
+	check_irradiance(&source, sh, layout.width, texels, names[IBL_DISTRIBUTION_LAMBERTIAN]);
+
+	for (enum ibl_distribution distribution = IBL_DISTRIBUTION_GGX; distribution < IBL_DISTRIBUTION_COUNT; distribution++) {
+		const uint16_t *gpu = (const uint16_t *) (data + sizeof header + (distribution - IBL_DISTRIBUTION_GGX) * layout.size);
+		double max = 0, sum = 0;
+		size_t count = 0;
+		double start = now();
+
+		for (size_t level = 0; level < layout.levels; level++) {
+			int width;
+			size_t offset;
+			size_t face_size = texture_image_level(&layout, level, &width, NULL, &offset);
+
+			float roughness = (float) level / (float) (layout.levels - 1);
+			uint32_t samples = ibl_sample_count(distribution, roughness, ENVIRONMENT_SAMPLE_COUNT);
+			int step = width > texels ? width / texels : 1;
+
+			for (int face = 0; face < 6; face++) {
+				for (int y = step / 2; y < width; y += step) {
+					for (int x = step / 2; x < width; x += step) {
+						float direction[3], color[3];
+						ibl_texel_direction(face, x, y, width, direction);
+						ibl_prefilter(&source, distribution, roughness, samples, direction, color);
+
+						const uint16_t *texel = gpu + (offset + face * face_size) / sizeof *gpu + ((size_t) y * width + x) * 3;
+						for (int c = 0; c < 3; c++) {
+							double expected = dequantize_half(texel[c]);
+							double error = fabs(color[c] - expected) / fmax(fabs(expected), 1e-3);
+							max = fmax(max, error);
+							sum += error;
+							count++;
+						}
+					}
+				}
+			}
+		}
+
+		printf("%-10s max %10.6f mean %10.6f relative %8.2f ms\n", names[distribution], max, sum / count, (now() - start) * 1e3);
+	}
+
+	cache_unmap(data, size);
+	ibl_cubemap_fini(&source);
+
+	return EXIT_SUCCESS;
+}
+
+static const struct tool tools[] = {
+	{"--benchmark-decode", "[model.glb] [iterations]", benchmark_decode},
+	{"--benchmark-mipmaps", "[model.glb] [iterations]", benchmark_mipmaps},
+	{"--report-quantization", "[model.glb]", report_quantization},
+	{"--report-geometry", "[model.glb]", report_geometry},
+	{"--reference-ibl", "[environment.hdr] [texels]", reference_ibl},
+};
+
+bool tools_exists(const char *name) {
+	for (size_t i = 0; i < ARRAY_COUNT(tools); i++) {
+		if (strcmp(tools[i].name, name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int tools_run(int argc, char *argv[]) {
+	for (size_t i = 0; i < ARRAY_COUNT(tools); i++) {
+		if (strcmp(tools[i].name, argv[0]) != 0) {
+			continue;
+		}
+
+		// Tools don't have a window, but they do have workers.
+		jobs_init();
+		int result = tools[i].run(argc, argv);
+		jobs_fini();
+
+		if (result != EXIT_SUCCESS) {
+			fprintf(stderr, "Usage: %s %s\n", tools[i].name, tools[i].usage);
+		}
+
+		return result;
+	}
+
+	return EXIT_FAILURE;
+}
@@ -220,6 +220,15 @@ static void render_debug_tools(struct ui *ui) {
 		}
 
 		igText("Moving bitmask: %d", client.moving);
+
+		igSeparator();
+
+		const struct renderer_stats *stats = &client.renderer.stats;
+		igText("Draws: %zu", stats->draws);
+		igText("Instances: %zu", stats->instances);
+		igText("Program switches: %zu", stats->programs);
+		igText("Material switches: %zu", stats->materials);
+		igText("Vertex array switches: %zu", stats->vertex_arrays);
 	}
 
 	igEnd();
@@ -294,7 +303,14 @@ static void render_scene_editor(struct ui *ui) {
 			char buffer[1024];
 			snprintf(buffer, sizeof buffer, "##entity-index-%zu", i);
 
-			if (igTreeNodeExStrStr(buffer, flags, "%s", entity->model->filepath)) {
+			const char *status = "";
+			switch (entity->model->state) {
+			    case MODEL_STATE_LOADING: status = " (loading)"; break;
+			    case MODEL_STATE_FAILED: status = " (failed)"; break;
+			    default: break;
+			}
+
+			if (igTreeNodeExStrStr(buffer, flags, "%s%s", entity->model->filepath, status)) {
 				igTreePop();
 			}
 
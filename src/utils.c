@@ -41,6 +41,19 @@ bool utils_ray_plane_intersection(vec3 plane_origin, vec3 plane_normal, vec3 ray
 	return false;
 }
 
+uint64_t utils_hash(const void *data, size_t size, uint64_t seed) {
+	// FNV-1a, 64 bits. Chaining calls by passing the previous result as the seed hashes the concatenation.
+	const unsigned char *bytes = data;
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
 float utils_closest_distance_between_two_rays(vec3 r1_origin, vec3 r1_direction, vec3 r2_origin, vec3 r2_direction, float *d1, float *d2) {
 	vec3 dp;
 	glm_vec3_sub(r2_origin, r1_origin, dp);
@@ -195,10 +208,8 @@ void utils_render_line(vec3 from, vec3 to, mat4 transform, vec4 color) {
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof vertices, vertices);
 
-	mat4 view_projection_matrix;
-	glm_mat4_mul(client.renderer.projection_matrix, client.camera.view_matrix, view_projection_matrix);
-
-	shader_bind_uniform_mvp(client.renderer.plain_shader, view_projection_matrix, transform, 1);
+	// The view-projection matrix comes from the frame's uniform buffer, see renderer.c.
+	shader_bind_uniform_model(client.renderer.plain_shader, transform);
 	glUniform4f(color_location, color[0], color[1], color[2], color[3]);
 
 	glDrawArrays(GL_LINES, 0, 2);